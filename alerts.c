@@ -0,0 +1,401 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <curl/curl.h>
+
+#include "alerts.h"
+#include "metrics.h"
+#include "logger.h"
+
+static const char *alert_kind_name (int kind)
+{
+    return (kind == ALERT_RAISED) ? "raised" : "cleared";
+}
+
+/* One event as a JSON object */
+static void alert_json (FILE *fp, const aevent_t *e)
+{
+    fprintf (fp, "{\"event\":\"%s\",\"uuid\":\"%s\",\"current\":%f,\"threshold\":%f,", alert_kind_name (e->kind),
+             e->uuid, e->current, e->threshold);
+    if (e->kind == ALERT_RAISED)
+        fprintf (fp, "\"avg\":%f,", e->avg);
+    fprintf (fp, "\"time_ns\":%lld}", (long long) e->stamp_ns);
+}
+
+/*******************************************************
+ *                                                     *
+ *                      Sinks                          *
+ *                                                     *
+ *******************************************************/
+
+/* stdout: the classic alert lines. Written directly, not through
+ * the logger, so the log level (-L) never drops a delivered alert.
+ * Only the alert thread delivers, off the polling path.
+ */
+static int stdout_deliver (asink_t *sink, const aevent_t *events, int n)
+{
+    int i = 0;
+    for (i = 0; i < n; i++) {
+        if (events[i].kind == ALERT_RAISED)
+            printf ("ALERT for machine %s, with avg = %f\n", events[i].uuid, events[i].avg);
+        else
+            printf ("Alert cleared for machine %s, current = %f\n", events[i].uuid, events[i].current);
+    }
+    fflush (stdout);
+    return n;
+}
+
+/* file:path, one JSON object per line, appended */
+static int file_open (asink_t *sink, const char *arg)
+{
+    sink->state = arg ? fopen (arg, "a") : NULL;
+    if (sink->state == NULL) {
+        printf ("ERROR: Could not open alert file %s\n", arg ? arg : "(none)");
+        return -1;
+    }
+    return 0;
+}
+
+static int file_deliver (asink_t *sink, const aevent_t *events, int n)
+{
+    int i = 0;
+    FILE *fp = (FILE *) sink->state;
+    for (i = 0; i < n; i++) {
+        alert_json (fp, &events[i]);
+        fputc ('\n', fp);
+    }
+    return (fflush (fp) == 0) ? n : 0;
+}
+
+static void file_close (asink_t *sink)
+{
+    fclose ((FILE *) sink->state);
+}
+
+/* socket:path, a Unix datagram of JSON lines per batch to a local listener */
+typedef struct socket_sink {
+    int             fd;
+    struct sockaddr_un addr;
+} ssink_t;
+
+static int socket_open (asink_t *sink, const char *arg)
+{
+    ssink_t *ss = (ssink_t *) calloc (1, sizeof (ssink_t));
+
+    if (ss == NULL || arg == NULL || strlen (arg) >= sizeof (ss->addr.sun_path)) {
+        printf ("ERROR: Bad alert socket %s\n", arg ? arg : "(none)");
+        free (ss);
+        return -1;
+    }
+    ss->addr.sun_family = AF_UNIX;
+    strcpy (ss->addr.sun_path, arg);
+    ss->fd = socket (AF_UNIX, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (ss->fd < 0) {
+        printf ("ERROR: Could not create alert socket: %s\n", strerror (errno));
+        free (ss);
+        return -1;
+    }
+    sink->state = ss;
+    return 0;
+}
+
+static int socket_deliver (asink_t *sink, const aevent_t *events, int n)
+{
+    int i = 0;
+    char *buf = NULL;
+    size_t len = 0;
+    ssink_t *ss = (ssink_t *) sink->state;
+
+    FILE *fp = open_memstream (&buf, &len);
+    if (fp == NULL)
+        return 0;
+    for (i = 0; i < n; i++) {
+        alert_json (fp, &events[i]);
+        fputc ('\n', fp);
+    }
+    fclose (fp);
+    ssize_t sent = sendto (ss->fd, buf, len, 0, (struct sockaddr *) &ss->addr, sizeof (ss->addr));
+    free (buf);
+    return (sent == (ssize_t) len) ? n : 0;
+}
+
+static void socket_close (asink_t *sink)
+{
+    ssink_t *ss = (ssink_t *) sink->state;
+    close (ss->fd);
+    free (ss);
+}
+
+/* webhook:url, a JSON array per batch POSTed from the delivery thread */
+typedef struct webhook_sink {
+    CURL            *curl;
+    struct curl_slist *headers;
+} wsink_t;
+
+static size_t webhook_discard (char *data, size_t size, size_t nmemb, void *ctx)
+{
+    return size * nmemb;
+}
+
+static int webhook_open (asink_t *sink, const char *arg)
+{
+    wsink_t *ws = (wsink_t *) calloc (1, sizeof (wsink_t));
+
+    if (ws == NULL || arg == NULL || (ws->curl = curl_easy_init ()) == NULL) {
+        printf ("ERROR: Could not set up alert webhook %s\n", arg ? arg : "(none)");
+        free (ws);
+        return -1;
+    }
+    ws->headers = curl_slist_append (NULL, "Content-Type: application/json");
+    curl_easy_setopt (ws->curl, CURLOPT_URL, arg);
+    curl_easy_setopt (ws->curl, CURLOPT_HTTPHEADER, ws->headers);
+    curl_easy_setopt (ws->curl, CURLOPT_WRITEFUNCTION, webhook_discard);
+    curl_easy_setopt (ws->curl, CURLOPT_TIMEOUT_MS, 2000L);
+    curl_easy_setopt (ws->curl, CURLOPT_NOSIGNAL, 1L);
+    sink->state = ws;
+    return 0;
+}
+
+static int webhook_deliver (asink_t *sink, const aevent_t *events, int n)
+{
+    int i = 0;
+    char *buf = NULL;
+    size_t len = 0;
+    long http_code = 0;
+    wsink_t *ws = (wsink_t *) sink->state;
+
+    FILE *fp = open_memstream (&buf, &len);
+    if (fp == NULL)
+        return 0;
+    fputc ('[', fp);
+    for (i = 0; i < n; i++) {
+        if (i)
+            fputc (',', fp);
+        alert_json (fp, &events[i]);
+    }
+    fputc (']', fp);
+    fclose (fp);
+
+    curl_easy_setopt (ws->curl, CURLOPT_POSTFIELDS, buf);
+    curl_easy_setopt (ws->curl, CURLOPT_POSTFIELDSIZE, (long) len);
+    CURLcode res = curl_easy_perform (ws->curl);
+    curl_easy_getinfo (ws->curl, CURLINFO_RESPONSE_CODE, &http_code);
+    free (buf);
+    return (res == CURLE_OK && http_code < 400) ? n : 0;
+}
+
+static void webhook_close (asink_t *sink)
+{
+    wsink_t *ws = (wsink_t *) sink->state;
+    curl_easy_cleanup (ws->curl);
+    curl_slist_free_all (ws->headers);
+    free (ws);
+}
+
+static const asink_t sink_kinds[] = {
+    {"stdout", NULL, stdout_deliver, NULL},
+    {"file", file_open, file_deliver, file_close},
+    {"socket", socket_open, socket_deliver, socket_close},
+    {"webhook", webhook_open, webhook_deliver, webhook_close},
+};
+
+/* Sets up the sink named by spec, "kind[:argument]" */
+static int alerts_add_sink (alerts_t *a, const char *spec)
+{
+    int i = 0;
+    size_t klen = strcspn (spec, ":");
+    const char *arg = spec[klen] ? spec + klen + 1 : NULL;
+
+    if (a->nsinks == ALERT_MAX_SINKS) {
+        printf ("ERROR: Too many alert sinks\n");
+        return -1;
+    }
+    for (i = 0; i < (int) (sizeof (sink_kinds) / sizeof (sink_kinds[0])); i++) {
+        if (strlen (sink_kinds[i].kind) == klen && strncmp (sink_kinds[i].kind, spec, klen) == 0) {
+            asink_t *sink = &a->sinks[a->nsinks];
+            *sink = sink_kinds[i];
+            if (sink->open && sink->open (sink, arg) < 0)
+                return -1;
+            a->nsinks++;
+            return 0;
+        }
+    }
+    printf ("ERROR: Unknown alert sink %s (stdout, file:path, socket:path, webhook:url)\n", spec);
+    return -1;
+}
+
+/*******************************************************
+ *                                                     *
+ *                    Delivery                         *
+ *                                                     *
+ *******************************************************/
+
+/* Takes up to ALERT_BATCH queued events at once and hands them to
+ * every sink
+ */
+static void *alerts_thread (void *arg)
+{
+    alerts_t *a = (alerts_t *) arg;
+    aevent_t batch[ALERT_BATCH];
+    qbackoff_t backoff = {0};
+    int i = 0;
+
+    for (;;) {
+        int n = 0;
+        aevent_t *e;
+        while (n < ALERT_BATCH && (e = (aevent_t *) mpsc_peek (&a->queue)) != NULL) {
+            batch[n++] = *e;
+            mpsc_release (&a->queue);
+        }
+        if (n == 0) {
+            if (__atomic_load_n (&a->stop, __ATOMIC_ACQUIRE))
+                break;
+            qbackoff_wait (&backoff);
+            continue;
+        }
+        qbackoff_reset (&backoff);
+
+        for (i = 0; i < a->nsinks; i++) {
+            int done = a->sinks[i].deliver (&a->sinks[i], batch, n);
+            a->sinks[i].delivered += done;
+            a->sinks[i].failed += n - done;
+        }
+        a->batches++;
+    }
+    return NULL;
+}
+
+/* alerts_init()
+ * Opens the sinks named by specs (stdout if there are none) and starts
+ * the delivery thread. cooldown is in seconds.
+ */
+int alerts_init (alerts_t *a, int size, char **specs, int nspecs, double cooldown)
+{
+    int i = 0;
+    int rc = -1;
+
+    memset (a, 0, sizeof (alerts_t));
+    a->size = size;
+    a->cooldown_ns = (int64_t) (cooldown * 1e9);
+    a->active = (uint8_t *) calloc (size > 0 ? size : 1, sizeof (uint8_t));
+    a->reported = (uint8_t *) calloc (size > 0 ? size : 1, sizeof (uint8_t));
+    a->last_raise = (int64_t *) calloc (size > 0 ? size : 1, sizeof (int64_t));
+    if (!a->active || !a->reported || !a->last_raise) {
+        printf ("ERROR: Could not allocate the alert state\n");
+        return rc;
+    }
+    if (mpsc_init (&a->queue, ALERT_QUEUE, sizeof (aevent_t)) < 0)
+        return rc;
+
+    if (nspecs == 0 && alerts_add_sink (a, "stdout") < 0)
+        return rc;
+    for (i = 0; i < nspecs; i++) {
+        if (alerts_add_sink (a, specs[i]) < 0)
+            return rc;
+    }
+
+    if (pthread_create (&a->thread, NULL, alerts_thread, a) != 0) {
+        printf ("ERROR: Could not start the alert thread\n");
+        return rc;
+    }
+
+    rc = 0;
+    return rc;
+}
+
+static void alerts_queue (alerts_t *a, int kind, int idx, const char *uuid, double current, double threshold,
+                          double avg, int64_t stamp_ns)
+{
+    aevent_t *e = (aevent_t *) mpsc_claim (&a->queue);
+
+    if (e == NULL) {
+        __atomic_fetch_add (&a->dropped, 1, __ATOMIC_RELAXED);
+        return;
+    }
+    e->kind = kind;
+    e->idx = idx;
+    snprintf (e->uuid, sizeof (e->uuid), "%s", uuid);
+    e->current = current;
+    e->threshold = threshold;
+    e->avg = avg;
+    e->stamp_ns = stamp_ns;
+    mpsc_publish (&a->queue, e);
+    __atomic_fetch_add ((kind == ALERT_RAISED) ? &a->raised : &a->cleared, 1, __ATOMIC_RELAXED);
+    metrics_add ((kind == ALERT_RAISED) ? MC_ALERTS_RAISED : MC_ALERTS_CLEARED, 1);
+}
+
+static int alerts_cooling (alerts_t *a, int idx, int64_t stamp_ns)
+{
+    return a->last_raise[idx] != 0 && stamp_ns - a->last_raise[idx] < a->cooldown_ns;
+}
+
+/* alerts_check()
+ * Feeds a reading of machine idx to its alert state. A raise within
+ * the cooldown is held back and reported by the first reading after
+ * the cooldown that is above the threshold again, so avg is always
+ * the rolling average of a reading above it. Only one
+ * thread may check a given machine; different machines may be
+ * checked concurrently. Never blocks.
+ */
+void alerts_check (alerts_t *a, int idx, const char *uuid, double current, double threshold, double avg, int64_t stamp_ns)
+{
+    if (!a->active[idx]) {
+        if (current <= threshold)
+            return;
+        a->active[idx] = 1;
+        if (alerts_cooling (a, idx, stamp_ns)) {
+            __atomic_fetch_add (&a->suppressed, 1, __ATOMIC_RELAXED);
+            return;
+        }
+    } else if (current < (1 - ALERT_HYSTERESIS) * threshold) {
+        a->active[idx] = 0;
+        if (a->reported[idx])
+            alerts_queue (a, ALERT_CLEARED, idx, uuid, current, threshold, avg, stamp_ns);
+        a->reported[idx] = 0;
+        return;
+    } else if (a->reported[idx] || current <= threshold || alerts_cooling (a, idx, stamp_ns)) {
+        return;
+    }
+
+    a->reported[idx] = 1;
+    a->last_raise[idx] = stamp_ns;
+    alerts_queue (a, ALERT_RAISED, idx, uuid, current, threshold, avg, stamp_ns);
+}
+
+void alerts_print (alerts_t *a)
+{
+    int i = 0;
+    int active = 0;
+
+    for (i = 0; i < a->size; i++)
+        active += a->active[i];
+    LOG (LOG_INFO, "Alerts: %lld raised, %lld cleared, %lld within cooldown, %lld dropped, %d machines above threshold, %lld batches\n",
+            (long long) a->raised, (long long) a->cleared, (long long) a->suppressed, (long long) a->dropped,
+            active, (long long) a->batches);
+    for (i = 0; i < a->nsinks; i++)
+        LOG (LOG_INFO, "  sink %s: %lld delivered, %lld failed\n", a->sinks[i].kind,
+                (long long) a->sinks[i].delivered, (long long) a->sinks[i].failed);
+}
+
+/* alerts_close()
+ * Delivers what is queued, stops the thread and closes the sinks
+ */
+void alerts_close (alerts_t *a)
+{
+    int i = 0;
+
+    __atomic_store_n (&a->stop, 1, __ATOMIC_RELEASE);
+    pthread_join (a->thread, NULL);
+    for (i = 0; i < a->nsinks; i++) {
+        if (a->sinks[i].close)
+            a->sinks[i].close (&a->sinks[i]);
+    }
+    mpsc_free (&a->queue);
+    free (a->active);
+    free (a->reported);
+    free (a->last_raise);
+}
@@ -0,0 +1,75 @@
+#ifndef ALERTS_H
+#define ALERTS_H
+
+#include <stdint.h>
+#include <pthread.h>
+#include "queue.h"
+
+/* Alert subsystem.
+ * The threshold check runs where the reading is applied and only
+ * state changes leave it: a machine raises an alert when its current
+ * goes above the threshold and clears it once the current fell below
+ * (1 - ALERT_HYSTERESIS) * threshold; a machine raising again within
+ * the cooldown of its last alert is reported once the cooldown is
+ * over, if it is still above the threshold. Events go through
+ * an MPSC queue to a delivery thread that hands them in batches to
+ * the sinks. A full queue drops the event rather than wait.
+ */
+
+#define ALERT_HYSTERESIS 0.05           /* Share of the threshold to fall below to clear */
+#define ALERT_BATCH 64                  /* Events per delivery */
+#define ALERT_QUEUE 4096                /* Events in flight */
+#define ALERT_MAX_SINKS 8
+
+typedef enum {
+    ALERT_RAISED,                       /* Current went above the threshold */
+    ALERT_CLEARED                       /* Current is back below the threshold */
+} akind_t;
+
+typedef struct alert_event {
+    int             kind;               /* akind_t */
+    int             idx;                /* Machine */
+    char            uuid[37];           /* uuid of the machine */
+    double          current;            /* Reading that changed the state */
+    double          threshold;          /* Threshold of the machine */
+    double          avg;                /* Rolling average, raised events only */
+    int64_t         stamp_ns;           /* Epoch nanoseconds of the reading */
+} aevent_t;
+
+typedef struct alert_sink asink_t;
+
+/* A destination of alerts, named by "kind[:argument]" */
+struct alert_sink {
+    const char      *kind;              /* stdout, file, socket or webhook */
+    int             (*open) (asink_t *sink, const char *arg);
+    int             (*deliver) (asink_t *sink, const aevent_t *events, int n);
+    void            (*close) (asink_t *sink);
+    void            *state;             /* Owned by the sink */
+    int64_t         delivered;          /* Events delivered */
+    int64_t         failed;             /* Events the sink could not deliver */
+};
+
+typedef struct alerts {
+    int             size;               /* Number of machines */
+    uint8_t         *active;            /* Machine is above its threshold */
+    uint8_t         *reported;          /* Its raise was reported */
+    int64_t         *last_raise;        /* Stamp of its last reported raise */
+    int64_t         cooldown_ns;        /* Quiet time after a reported raise */
+    mpsc_t          queue;              /* Events to deliver */
+    asink_t         sinks[ALERT_MAX_SINKS];
+    int             nsinks;             /* Sinks in use */
+    pthread_t       thread;             /* Delivery thread */
+    int             stop;               /* Thread exits once the queue is empty */
+    int64_t         raised;             /* Raise events queued, atomic */
+    int64_t         cleared;            /* Clear events queued, atomic */
+    int64_t         suppressed;         /* Raises held back by the cooldown, atomic */
+    int64_t         dropped;            /* Events lost to a full queue, atomic */
+    int64_t         batches;            /* Deliveries */
+} alerts_t;
+
+int alerts_init (alerts_t *a, int size, char **specs, int nspecs, double cooldown);
+void alerts_check (alerts_t *a, int idx, const char *uuid, double current, double threshold, double avg, int64_t stamp_ns);
+void alerts_print (alerts_t *a);
+void alerts_close (alerts_t *a);
+
+#endif
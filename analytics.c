@@ -0,0 +1,327 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "analytics.h"
+#include "kernels.h"
+#include "logger.h"
+
+/*******************************************************
+ *                                                     *
+ *                   Timestops                         *
+ *                                                     *
+ *******************************************************/
+
+/* find_next_long_timestop()
+ * The timestop after current_hour (its index in timestops) and the one
+ * before it. Timestops are hours of the day in any order; the nearest
+ * one ahead, wrapping over midnight, is the next. An hour that is a
+ * timestop itself is its own previous one.
+ */
+int find_next_long_timestop (int *timestops, int wsize, int current_hour, int *next_timestop, int *prev_timestop, int *index)
+{
+    int i = 0;
+    int ahead = 25, behind = 25;
+
+    for (i = 0; i < wsize; i++) {
+        if (current_hour == timestops[i]) {
+            *index = (i + 1 < wsize) ? i + 1 : 0;
+            *next_timestop = timestops[*index];
+            *prev_timestop = current_hour;
+            return 0;
+        }
+        int fwd = (timestops[i] - current_hour + 24) % 24;
+        int back = (current_hour - timestops[i] + 24) % 24;
+        if (fwd < ahead) {
+            ahead = fwd;
+            *index = i;
+            *next_timestop = timestops[i];
+        }
+        if (back < behind) {
+            behind = back;
+            *prev_timestop = timestops[i];
+        }
+    }
+    return (wsize > 0) ? 0 : -1;
+}
+
+/*******************************************************
+ *                                                     *
+ *                 Math Operations                     *
+ *                                                     *
+ *******************************************************/
+double air_density (double temp, double humd, double pres)
+{
+    /* calculate saturated vapor pressure */
+    double Psv = 611.2 * pow (2.718, (16.67 * temp) / (temp + 243.5));
+    double Pv = (humd / 100) * Psv;
+    double Pd = (pres*100) - Pv;
+    double Rv = 461.4964;
+    double Rd = 287.0531;
+    double Tk = temp + 273.15;
+    double rho = (Pd / (Rd * Tk)) + (Pv / (Rv * Tk));
+    
+    return rho;
+}
+
+/* A type without current (no machines of it or all idle) has no
+ * ratio: NAN, which the summaries skip
+ */
+int air_density_current_ratio (double rho, double *currents, double *ratios)
+{   
+    int i = 0;
+    for (i = 0; i < registry.ntypes; i++) {
+        ratios[i] = (currents[i] > 0) ? rho / currents[i] : NAN;
+    }
+    return 0;
+}
+
+int compute_variance (double *values, int size, double *variance)
+{
+    double mean = 0;
+
+    kern.mean_var (values, size, &mean, variance);
+    return 0;
+}
+
+/*******************************************************
+ *                                                     *
+ *                 Period Operation                    *
+ *                                                     *
+ *******************************************************/
+
+int compute_short_period_averages (fleet_t *fleet, sensor_t *sensor, hring_t *pshort_hist, int64_t start_time, int64_t end_time)
+{
+    LOG (LOG_INFO, "================Computing short period averages======================\n");
+    int i = 0;
+    
+    double temp_avg;
+    double pres_avg;
+    double humd_avg;
+    double rho;
+    int nsensor = sensor->size - 1;
+
+    double type_sum[registry.ntypes];
+    double type_avg[registry.ntypes];
+    double *machine_avg = fleet->pavg;
+    memset (type_sum, 0, sizeof (type_sum));
+    memset (type_avg, 0, sizeof (type_avg));
+
+    /* Compute average energy consumption of all the machines */
+    for (i = 0; i < fleet->size; i++) {
+        // Compute for this machine
+        double *window = &fleet->period[(size_t) i * fleet->pstride];
+        int nsamples = fleet->phead[i] - 1;
+        machine_avg[i] = (nsamples > 0) ? kern.sum (window, nsamples) / nsamples : 0;
+
+        // Adjust: the last sample opens the next period
+        if (nsamples >= 0) {
+            window[0] = window[nsamples];
+            fleet->phead[i] = 1;
+        }
+    }
+
+    /* Sum up the machine averages per machine type; unclassified
+     * machines land in the CMP_ALL group which is replaced by the total
+     */
+    kern.group_sum (machine_avg, fleet->type, fleet->size, type_sum, registry.ntypes);
+    type_sum[CMP_ALL] = kern.sum (machine_avg, fleet->size);
+
+    /* Compute total average */
+    for (i = 0; i < registry.ntypes; i++) {
+        type_avg[i] = (num_machines[i] > 0) ? type_sum[i] / num_machines[i] : 0; 
+    }
+
+    /* Compute average temp, humidty and pressure, and the air density
+     * of every reading: rho is not linear, the density of the average
+     * conditions is not the average density
+     */
+    if (nsensor > 0) {
+        temp_avg = kern.sum (sensor->temperature, nsensor) / nsensor;
+        humd_avg = kern.sum (sensor->humidity, nsensor) / nsensor;
+        pres_avg = kern.sum (sensor->pressure, nsensor) / nsensor;
+        kern.air_density (sensor->temperature, sensor->humidity, sensor->pressure, sensor->rho, nsensor);
+        rho = kern.sum (sensor->rho, nsensor) / nsensor;
+    
+        // adjust: the last reading opens the next period
+        sensor->temperature[0] = sensor->temperature[nsensor];
+        sensor->humidity[0] = sensor->humidity[nsensor];
+        sensor->pressure[0] = sensor->pressure[nsensor];
+        sensor->size = 1;
+    } else {
+        temp_avg = 0;
+        humd_avg = 0;
+        pres_avg = 0;
+        rho = 0;
+    }
+
+    /* make an entry, replacing the oldest one once the history is full */
+    phist_t *entry = hring_push (pshort_hist);
+    entry->starttime = start_time;
+    entry->endtime = end_time;
+    entry->avg_temperature = temp_avg;
+    entry->avg_humidity = humd_avg;
+    entry->avg_pressure = pres_avg;
+    entry->rho = rho;
+    for (i = 0; i < registry.ntypes; i++) {
+        entry->avg_current[i] = type_avg[i];
+    }
+    /* the type currents are period averages, so the mean of the per
+     * reading ratios is the mean density over the current */
+    air_density_current_ratio (entry->rho, entry->avg_current, entry->rho_cur_ratio);
+
+    return 0;
+}
+
+/* compute_long_period_averages()
+ * Averages the short period records pushed since *mark into a new
+ * long period record, and moves *mark to the newest short record
+ */
+int compute_long_period_averages (hring_t *pshort_hist, hring_t *plong_hist, int64_t *mark, int64_t starttime, int64_t endtime) 
+{
+    LOG (LOG_INFO, "================Computing LONG period averages======================\n");
+    int rc = -1;
+    int i = 0, j = 0;
+    double rho_sum = 0;
+    double temp_sum = 0;
+    double pres_sum = 0;
+    double humd_sum = 0;
+    double type_sum[registry.ntypes];
+    int count = hring_since (pshort_hist, *mark);
+ 
+    if (count == 0) {
+        LOG (LOG_INFO, "No new data in short history\n");
+        return 0;
+    }
+    *mark = pshort_hist->total;
+    memset (type_sum, 0, sizeof (type_sum));
+    
+    for (j = 0; j < count; j++) {
+        phist_t *shist = hring_get (pshort_hist, j);
+        temp_sum += shist->avg_temperature;
+        pres_sum += shist->avg_pressure;
+        humd_sum += shist->avg_humidity;
+        rho_sum += shist->rho;
+        for (i = 0; i < registry.ntypes; i++) {
+            type_sum[i] += shist->avg_current[i];
+        }
+    }
+
+    /* make an entry, replacing the oldest one once the history is full */
+    phist_t *entry = hring_push (plong_hist);
+    entry->starttime = starttime;
+    entry->endtime = endtime;
+    entry->avg_temperature = temp_sum / count;
+    entry->avg_humidity = humd_sum / count;
+    entry->avg_pressure = pres_sum / count;
+    entry->rho = rho_sum / count;
+    for (i = 0; i < registry.ntypes; i++) {
+        entry->avg_current[i] = type_sum[i] / count;
+    }
+    air_density_current_ratio (entry->rho, entry->avg_current, entry->rho_cur_ratio);   
+
+    rc = 0;
+    return rc;
+}
+
+/* Only finite values enter the running moments: one inf or NAN would
+ * stay in them after its record left. Adding and evicting skip the
+ * same values, so the moments stay those of the finite ones.
+ */
+static void summary_add (moments_t *m, double x)
+{
+    if (isfinite (x))
+        moments_add (m, x);
+}
+
+static void summary_remove (moments_t *m, double x)
+{
+    if (isfinite (x))
+        moments_remove (m, x);
+}
+
+/* Refreshes the reported values from the running moments */
+static void refresh_operations_summary (opsum_t *summary)
+{
+    int i;
+    for (i = 0; i < registry.ntypes; i++) {
+        summary->avg_current[i] = summary->current_m[i].mean;
+        summary->avg_ratio[i] = summary->ratio_m[i].mean;
+        summary->variance[i] = moments_var (&summary->ratio_m[i]);
+    }
+    summary->avg_temp = summary->temp_m.mean;
+    summary->avg_humd = summary->humd_m.mean;
+    summary->avg_pres = summary->pres_m.mean;
+    summary->avg_rho = summary->rho_m.mean;
+    summary->rho_variance = moments_var (&summary->rho_m);
+}
+
+/* Allocates the per-type arrays of a summary, once at startup */
+int init_operations_summary (opsum_t *summary)
+{
+    int n = registry.ntypes;
+
+    memset (summary, 0, sizeof (opsum_t));
+    summary->avg_current = (double *) calloc (3 * n, sizeof (double));
+    summary->current_m = (moments_t *) calloc (2 * n, sizeof (moments_t));
+    if (!summary->avg_current || !summary->current_m) {
+        printf ("ERROR: Could not allocate the operations summary\n");
+        return -1;
+    }
+    summary->avg_ratio = summary->avg_current + n;
+    summary->variance = summary->avg_current + 2 * n;
+    summary->ratio_m = summary->current_m + n;
+    return 0;
+}
+
+void free_operations_summary (opsum_t *summary)
+{
+    free (summary->avg_current);
+    free (summary->current_m);
+}
+
+/* update_operations_summary()
+ * Folds a new long period record into the summary. The running
+ * moments make this O(types), however long the history is.
+ */
+int update_operations_summary (opsum_t *summary, const phist_t *added) 
+{
+    int rc = -1;
+    int i;
+
+    for (i = 0; i < registry.ntypes; i++) {
+        summary_add (&summary->current_m[i], added->avg_current[i]);
+        summary_add (&summary->ratio_m[i], added->rho_cur_ratio[i]);
+    }
+    summary_add (&summary->temp_m, added->avg_temperature);
+    summary_add (&summary->humd_m, added->avg_humidity);
+    summary_add (&summary->pres_m, added->avg_pressure);
+    summary_add (&summary->rho_m, added->rho);
+    refresh_operations_summary (summary);
+
+    rc = 0;
+    return rc;
+}
+
+/* evict_operations_summary()
+ * Takes a long period record that leaves the history out of the summary
+ */
+int evict_operations_summary (opsum_t *summary, const phist_t *evicted) 
+{
+    int rc = -1;
+    int i;
+
+    for (i = 0; i < registry.ntypes; i++) {
+        summary_remove (&summary->current_m[i], evicted->avg_current[i]);
+        summary_remove (&summary->ratio_m[i], evicted->rho_cur_ratio[i]);
+    }
+    summary_remove (&summary->temp_m, evicted->avg_temperature);
+    summary_remove (&summary->humd_m, evicted->avg_humidity);
+    summary_remove (&summary->pres_m, evicted->avg_pressure);
+    summary_remove (&summary->rho_m, evicted->rho);
+    refresh_operations_summary (summary);
+
+    rc = 0;
+    return rc;
+}
@@ -0,0 +1,32 @@
+#ifndef ANALYTICS_H
+#define ANALYTICS_H
+
+#include "machinepark.h"
+#include "fleet.h"
+#include "hring.h"
+#include "registry.h"
+
+/* Period analytics: air density, the short and long period averages
+ * of the fleet and the operations summaries of every timestop.
+ * The machine types come from the registry and the fleet counts per
+ * type from num_machines, both owned by the program.
+ */
+
+extern treg_t registry;                 /* Machine types */
+extern int *num_machines;               /* Machines per type, [CMP_ALL] = the whole fleet */
+
+int find_next_long_timestop (int *timestops, int wsize, int current_hour, int *next_timestop, int *prev_timestop, int *index);
+
+double air_density (double temp, double humd, double pres);
+int air_density_current_ratio (double rho, double *currents, double *ratios);
+int compute_variance (double *values, int size, double *variance);
+
+int compute_short_period_averages (fleet_t *fleet, sensor_t *sensor, hring_t *pshort_hist, int64_t start_time, int64_t end_time);
+int compute_long_period_averages (hring_t *pshort_hist, hring_t *plong_hist, int64_t *mark, int64_t starttime, int64_t endtime);
+
+int init_operations_summary (opsum_t *summary);
+void free_operations_summary (opsum_t *summary);
+int update_operations_summary (opsum_t *summary, const phist_t *added);
+int evict_operations_summary (opsum_t *summary, const phist_t *evicted);
+
+#endif
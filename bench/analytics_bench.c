@@ -0,0 +1,405 @@
+/* Period analytics per fleet size and history length: time and heap
+ * allocations of every operation, one JSON object per line
+ *
+ * Build with `make bench` and run
+ * ./bench/analytics_bench [fleet-sizes] [history-lengths] [min-ms]
+ * e.g. ./bench/analytics_bench 243,1000,10000 61,601 50
+ *
+ * history is the samples per machine of a short period for the short
+ * averages and the sensor series, the short records folded into a
+ * long period, the long records already in a summary and the
+ * timestops to search. Allocations are counted by wrapping malloc,
+ * calloc and realloc at link time. The summary is first checked to
+ * recover once a period with an idle type has left it.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#include "analytics.h"
+#include "kernels.h"
+#include "logger.h"
+
+#define MAX_PARAMS 16
+
+treg_t registry;
+int *num_machines;
+
+volatile double sink;
+
+/*******************************************************
+ *                                                     *
+ *                Allocation Counting                  *
+ *                                                     *
+ *******************************************************/
+
+static long allocs;
+
+void *__real_malloc (size_t size);
+void *__real_calloc (size_t n, size_t size);
+void *__real_realloc (void *ptr, size_t size);
+
+void *__wrap_malloc (size_t size)
+{
+    allocs++;
+    return __real_malloc (size);
+}
+
+void *__wrap_calloc (size_t n, size_t size)
+{
+    allocs++;
+    return __real_calloc (n, size);
+}
+
+void *__wrap_realloc (void *ptr, size_t size)
+{
+    allocs++;
+    return __real_realloc (ptr, size);
+}
+
+/*******************************************************
+ *                                                     *
+ *                   Harness                           *
+ *                                                     *
+ *******************************************************/
+
+static double now_ns ()
+{
+    struct timespec ts;
+    clock_gettime (CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/* Fixed seed so every run sees the same data */
+static unsigned long long rng = 42;
+
+static double uniform (double lo, double hi)
+{
+    rng = rng * 6364136223846793005ULL + 1442695040888963407ULL;
+    return lo + (hi - lo) * ((rng >> 11) * (1.0 / 9007199254740992.0));
+}
+
+/* State of one (fleet, history) case */
+typedef struct bench_case {
+    int         fleet;
+    int         history;
+    fleet_t     machines;
+    sensor_t    sensor;
+    hring_t     pshort;
+    hring_t     plong;
+    opsum_t     summary;
+    int         *timestops;
+    double      *temps;                 /* Sensor series for air_density */
+    double      *humds;
+    double      *press;
+    double      *values;                /* Fleet values for compute_variance */
+    int64_t     mark;
+    long        op;                     /* Operations run so far */
+} bcase_t;
+
+typedef void (*bench_op_t) (bcase_t *bc);
+typedef void (*bench_reset_t) (bcase_t *bc);
+
+/* Runs op until min_ms have passed and prints the result line. Ops
+ * with a reset are timed one by one with the reset untimed before
+ * each, the others in batches so the clock does not dominate.
+ */
+static void run (const char *name, bcase_t *bc, bench_op_t op, bench_reset_t reset, double min_ms)
+{
+    int k = 0;
+    int batch = reset ? 1 : 256;
+    long ops = 0;
+    long allocs_run = 0;
+    double spent = 0;
+
+    /* warm up */
+    if (reset)
+        reset (bc);
+    op (bc);
+
+    while (spent < min_ms * 1e6) {
+        if (reset)
+            reset (bc);
+        long a = allocs;
+        double start = now_ns ();
+        for (k = 0; k < batch; k++)
+            op (bc);
+        spent += now_ns () - start;
+        allocs_run += allocs - a;
+        ops += batch;
+    }
+    printf ("{\"bench\":\"%s\",\"fleet\":%d,\"history\":%d,\"kernels\":\"%s\",\"ops\":%ld,\"ns_per_op\":%.1f,\"allocs_per_op\":%.2f}\n",
+            name, bc->fleet, bc->history, kern.name, ops, spent / ops, (double) allocs_run / ops);
+    fflush (stdout);
+}
+
+/*******************************************************
+ *                                                     *
+ *                  Operations                         *
+ *                                                     *
+ *******************************************************/
+
+static void op_air_density (bcase_t *bc)
+{
+    int i = bc->op++ % bc->history;
+    sink = air_density (bc->temps[i], bc->humds[i], bc->press[i]);
+}
+
+/* One op is the density of all history readings */
+static void op_air_density_series (bcase_t *bc)
+{
+    kern.air_density (bc->temps, bc->humds, bc->press, bc->sensor.rho, bc->history);
+    sink = bc->sensor.rho[0];
+}
+
+static void op_ratio (bcase_t *bc)
+{
+    phist_t *rec = hring_get (&bc->pshort, 0);
+    air_density_current_ratio (rec->rho, rec->avg_current, rec->rho_cur_ratio);
+    sink = rec->rho_cur_ratio[1];
+}
+
+static void op_variance (bcase_t *bc)
+{
+    double var = 0;
+    compute_variance (bc->values, bc->fleet, &var);
+    sink = var;
+}
+
+/* A short period worth of samples in every window */
+static void reset_short (bcase_t *bc)
+{
+    int i = 0;
+    for (i = 0; i < bc->fleet; i++)
+        bc->machines.phead[i] = bc->history + 1;
+    bc->sensor.size = bc->history + 1;
+}
+
+static void op_short (bcase_t *bc)
+{
+    int64_t start = 0, end = 0;
+    compute_short_period_averages (&bc->machines, &bc->sensor, &bc->pshort, start, end);
+}
+
+static void op_long (bcase_t *bc)
+{
+    int64_t start = 0, end = 0;
+    bc->mark = bc->pshort.total - bc->history;
+    compute_long_period_averages (&bc->pshort, &bc->plong, &bc->mark, start, end);
+}
+
+/* The summary keeps history records: the oldest leaves as one arrives */
+static void op_summary (bcase_t *bc)
+{
+    phist_t *rec = hring_get (&bc->plong, bc->op++ % bc->plong.size);
+    evict_operations_summary (&bc->summary, rec);
+    update_operations_summary (&bc->summary, rec);
+    sink = bc->summary.avg_rho;
+}
+
+/* The current hour is never a timestop, the search scans them all */
+static void op_timestop (bcase_t *bc)
+{
+    int next = 0, prev = 0, index = 0;
+    find_next_long_timestop (bc->timestops, bc->history, 2 * (bc->op++ % 12) + 1, &next, &prev, &index);
+    sink = next;
+}
+
+/*******************************************************
+ *                                                     *
+ *                     Checks                          *
+ *                                                     *
+ *******************************************************/
+
+/* A period in which a type has no current gives that type no ratio.
+ * Once the period leaves the summary every value has to be finite
+ * again. Returns the number of values that are not.
+ */
+static int check_idle_type_evicted ()
+{
+    int i = 0, bad = 0;
+    int n = registry.ntypes;
+    hring_t ring;
+    opsum_t summary;
+
+    if (hring_init (&ring, 3, n) < 0 || init_operations_summary (&summary) < 0)
+        return 1;
+    for (i = 0; i < 3; i++) {
+        phist_t *rec = hring_push (&ring);
+        int j = 0;
+        for (j = 0; j < n; j++)
+            rec->avg_current[j] = 10 + i + j;
+        rec->avg_current[1] = (i == 1) ? 0 : rec->avg_current[1];
+        rec->avg_temperature = 20;
+        rec->avg_humidity = 40;
+        rec->avg_pressure = 1010;
+        rec->rho = 1.2;
+        air_density_current_ratio (rec->rho, rec->avg_current, rec->rho_cur_ratio);
+        update_operations_summary (&summary, rec);
+    }
+
+    /* evict the oldest and the idle period, index 0 is the newest */
+    evict_operations_summary (&summary, hring_get (&ring, 2));
+    evict_operations_summary (&summary, hring_get (&ring, 1));
+
+    for (i = 0; i < n; i++)
+        bad += !isfinite (summary.avg_current[i]) + !isfinite (summary.avg_ratio[i]) + !isfinite (summary.variance[i]);
+    bad += !isfinite (summary.avg_rho) + !isfinite (summary.rho_variance);
+    if (bad)
+        printf ("ERROR: %d summary values not finite after evicting an idle type\n", bad);
+
+    free_operations_summary (&summary);
+    hring_free (&ring);
+    return bad;
+}
+
+/*******************************************************
+ *                                                     *
+ *                     Setup                           *
+ *                                                     *
+ *******************************************************/
+
+static int case_init (bcase_t *bc, int fleet, int history)
+{
+    int i = 0, j = 0;
+
+    memset (bc, 0, sizeof (bcase_t));
+    bc->fleet = fleet;
+    bc->history = history;
+    if (fleet_init (&bc->machines, fleet, history + 1, 300, 5) < 0)
+        return -1;
+
+    /* machines of every type, with a short period of samples each */
+    memset (num_machines, 0, sizeof (int) * registry.ntypes);
+    for (i = 0; i < fleet; i++) {
+        bc->machines.type[i] = 1 + i % (registry.ntypes - 1);
+        num_machines[bc->machines.type[i]]++;
+        double *window = &bc->machines.period[(size_t) i * bc->machines.pstride];
+        for (j = 0; j <= history; j++)
+            window[j] = uniform (5, 25);
+    }
+    num_machines[CMP_ALL] = fleet;
+
+    bc->sensor.temperature = (double *) malloc (sizeof (double) * (history + 1));
+    bc->sensor.humidity = (double *) malloc (sizeof (double) * (history + 1));
+    bc->sensor.pressure = (double *) malloc (sizeof (double) * (history + 1));
+    bc->sensor.rho = (double *) malloc (sizeof (double) * (history + 1));
+    bc->temps = (double *) malloc (sizeof (double) * history);
+    bc->humds = (double *) malloc (sizeof (double) * history);
+    bc->press = (double *) malloc (sizeof (double) * history);
+    bc->values = (double *) malloc (sizeof (double) * fleet);
+    bc->timestops = (int *) malloc (sizeof (int) * history);
+    for (i = 0; i <= history; i++) {
+        bc->sensor.temperature[i] = uniform (15, 30);
+        bc->sensor.humidity[i] = uniform (30, 70);
+        bc->sensor.pressure[i] = uniform (990, 1030);
+    }
+    for (i = 0; i < history; i++) {
+        bc->temps[i] = bc->sensor.temperature[i];
+        bc->humds[i] = bc->sensor.humidity[i];
+        bc->press[i] = bc->sensor.pressure[i];
+        bc->timestops[i] = (2 * i) % 24;
+    }
+    for (i = 0; i < fleet; i++)
+        bc->values[i] = uniform (5, 25);
+
+    /* history records in both rings and the summary */
+    if (hring_init (&bc->pshort, history, registry.ntypes) < 0
+            || hring_init (&bc->plong, history, registry.ntypes) < 0
+            || init_operations_summary (&bc->summary) < 0)
+        return -1;
+    for (i = 0; i < history; i++) {
+        reset_short (bc);
+        op_short (bc);
+        int64_t start = 0, end = 0;
+        bc->mark = bc->pshort.total - 1;
+        compute_long_period_averages (&bc->pshort, &bc->plong, &bc->mark, start, end);
+        update_operations_summary (&bc->summary, hring_get (&bc->plong, 0));
+    }
+    return 0;
+}
+
+static void case_free (bcase_t *bc)
+{
+    fleet_free (&bc->machines);
+    hring_free (&bc->pshort);
+    hring_free (&bc->plong);
+    free_operations_summary (&bc->summary);
+    free (bc->sensor.temperature);
+    free (bc->sensor.humidity);
+    free (bc->sensor.pressure);
+    free (bc->sensor.rho);
+    free (bc->temps);
+    free (bc->humds);
+    free (bc->press);
+    free (bc->values);
+    free (bc->timestops);
+}
+
+/* Comma separated list of positive numbers */
+static int parse_list (const char *arg, int *out)
+{
+    int n = 0;
+    char *end = NULL;
+    while (*arg && n < MAX_PARAMS) {
+        out[n] = strtol (arg, &end, 10);
+        if (end == arg || out[n] <= 0)
+            return -1;
+        n++;
+        arg = (*end == ',') ? end + 1 : end;
+    }
+    return n;
+}
+
+int main (int argc, char *argv[])
+{
+    int i = 0, j = 0;
+    int fleets[MAX_PARAMS] = {243, 1000, 10000};
+    int histories[MAX_PARAMS] = {61, 601};
+    int nfleets = 3, nhistories = 2;
+    double min_ms = 50;
+
+    if (argc > 1)
+        nfleets = parse_list (argv[1], fleets);
+    if (argc > 2)
+        nhistories = parse_list (argv[2], histories);
+    if (argc > 3)
+        min_ms = strtod (argv[3], NULL);
+    if (nfleets <= 0 || nhistories <= 0) {
+        printf ("Usage: %s [fleet-sizes] [history-lengths] [min-ms]\n", argv[0]);
+        return -1;
+    }
+
+    logger_level = LOG_ERROR;
+    kernels_init (NULL);
+    if (treg_load (&registry, NULL) < 0)
+        return -1;
+    num_machines = (int *) calloc (registry.ntypes, sizeof (int));
+    if (check_idle_type_evicted () > 0)
+        return -1;
+
+    for (i = 0; i < nfleets; i++) {
+        for (j = 0; j < nhistories; j++) {
+            bcase_t bc;
+            if (case_init (&bc, fleets[i], histories[j]) < 0) {
+                printf ("ERROR: Could not set up %d machines with %d samples\n", fleets[i], histories[j]);
+                return -1;
+            }
+            run ("air_density", &bc, op_air_density, NULL, min_ms);
+            run ("air_density_series", &bc, op_air_density_series, NULL, min_ms);
+            run ("air_density_current_ratio", &bc, op_ratio, NULL, min_ms);
+            run ("compute_variance", &bc, op_variance, NULL, min_ms);
+            run ("compute_short_period_averages", &bc, op_short, reset_short, min_ms);
+            run ("compute_long_period_averages", &bc, op_long, NULL, min_ms);
+            run ("update_operations_summary", &bc, op_summary, NULL, min_ms);
+            run ("find_next_long_timestop", &bc, op_timestop, NULL, min_ms);
+            case_free (&bc);
+        }
+    }
+
+    free (num_machines);
+    treg_free (&registry);
+    return 0;
+}
@@ -0,0 +1,75 @@
+/* Machine classification cost per name: strstr chain vs the
+ * registry automaton, for growing numbers of patterns
+ *
+ * Build with `make bench` and run ./bench/classify_bench [names]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "registry.h"
+
+volatile int sink;
+
+static double now_ns ()
+{
+    struct timespec ts;
+    clock_gettime (CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+int main (int argc, char *argv[])
+{
+    int i = 0, j = 0, p = 0;
+    long n = 200000;
+    static const int npatterns[] = {10, 100, 1000, 10000};
+    char path[] = "/tmp/classify_bench.XXXXXX";
+    char (*names)[48];
+
+    if (argc > 1)
+        n = strtol (argv[1], NULL, 10);
+    names = malloc (sizeof (*names) * n);
+
+    printf ("patterns  strstr ns/name  automaton ns/name  states\n");
+    for (p = 0; p < (int) (sizeof (npatterns) / sizeof (npatterns[0])); p++) {
+        int np = npatterns[p];
+        char (*patterns)[16] = malloc (sizeof (*patterns) * np);
+        int fd = mkstemp (path);
+        FILE *fp = fdopen (fd, "w");
+
+        /* Model codes like the real park: "<vendor> <model>-<number>" */
+        for (i = 0; i < np; i++) {
+            snprintf (patterns[i], sizeof (patterns[i]), "MX-%d", 1000 + i * 7);
+            fprintf (fp, "%s\tType %d\n", patterns[i], i);
+        }
+        fclose (fp);
+        for (i = 0; i < n; i++)
+            snprintf (names[i], sizeof (names[i]), "Vendor Machine MX-%d [#%d]", 1000 + (rand () % np) * 7, i);
+
+        double start = now_ns ();
+        for (i = 0; i < n; i++) {
+            for (j = 0; j < np && !strstr (names[i], patterns[j]); j++)
+                ;
+            sink = j;
+        }
+        double chain = (now_ns () - start) / n;
+
+        treg_t reg;
+        if (treg_load (&reg, path) < 0)
+            return -1;
+        start = now_ns ();
+        for (i = 0; i < n; i++)
+            sink = treg_classify (&reg, names[i]);
+        double automaton = (now_ns () - start) / n;
+
+        printf ("%8d  %14.1f  %17.1f  %6d\n", np, chain, automaton, reg.nstates);
+        treg_free (&reg);
+        unlink (path);
+        strcpy (path, "/tmp/classify_bench.XXXXXX");
+        free (patterns);
+    }
+    free (names);
+    return 0;
+}
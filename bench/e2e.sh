@@ -0,0 +1,28 @@
+#!/bin/sh
+# End-to-end load benchmark: the monitor against the local simulator
+#
+# Build with `make all sim` and run
+#     ./bench/e2e.sh [machines] [latency-ms] [ticks] [max-inflight]
+# Prints tick duration percentiles, requests/s and CPU per tick.
+
+MACHINES=${1:-243}
+LATENCY=${2:-2}
+TICKS=${3:-20}
+INFLIGHT=${4:-64}
+PORT=${PORT:-8199}
+DIR=$(dirname "$0")/..
+
+"$DIR/sim/simulator" -p "$PORT" -n "$MACHINES" -l "$LATENCY" -d exp -s 60 > /dev/null &
+SIM=$!
+trap 'kill $SIM 2>/dev/null' EXIT INT TERM
+sleep 0.5
+
+CACHE=$(mktemp)
+OUT=$(mktemp)
+"$DIR/machinepark" -u "http://127.0.0.1:$PORT/api/v1" -C "$CACHE" -c "$INFLIGHT" \
+    -n "$TICKS" -f 1 0 > "$OUT"
+echo "$MACHINES machines, $LATENCY ms mean latency, $INFLIGHT in flight"
+grep "^Time to first tick" "$OUT"
+grep "^Connections" "$OUT" | tail -1
+grep "^Ticks" "$OUT"
+rm -f "$CACHE" "$CACHE.tmp" "$OUT"
@@ -0,0 +1,121 @@
+/* Footprint and aggregation speed of the compressed history
+ * against raw 16 byte (value, timestamp) samples
+ *
+ * Build with `make bench` and run ./bench/gorilla_bench [machines] [hours]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#include "ghist.h"
+#include "sitetime.h"
+
+typedef struct {
+    double value;
+    int64_t ts;
+} raw_t;
+
+volatile double sink;
+
+static double now_ns ()
+{
+    struct timespec ts;
+    clock_gettime (CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+int main (int argc, char *argv[])
+{
+    int i = 0, r = 0;
+    int nmachines = 243;
+    double hours = 24;
+    int64_t t0 = 1483261260 * NS_PER_SEC;
+    int64_t ts = t0, period = 5 * NS_PER_SEC;
+
+    if (argc > 1)
+        nmachines = strtol (argv[1], NULL, 10);
+    if (argc > 2)
+        hours = strtod (argv[2], NULL);
+    long nticks = (long) (hours * 3600 / 5);
+
+    /* Machines report a value rounded like the API, which holds for a
+     * few ticks and drifts. Samples are stamped with the tick deadline
+     * in epoch ns, as the monitor does; now and then a tick runs late
+     * and the next deadline is skipped.
+     */
+    ghist_t hist;
+    ghist_init (&hist, nmachines, (int64_t) (hours * NS_PER_HOUR));
+    raw_t *raw = malloc (sizeof (raw_t) * nmachines * nticks);
+    double *level = malloc (sizeof (double) * nmachines);
+    for (i = 0; i < nmachines; i++)
+        level[i] = 5 + (rand () % 1000) / 100.0;
+
+    double start = now_ns ();
+    for (r = 0; r < nticks; r++) {
+        ts += (rand () % 100 == 0) ? 2 * period : period;
+        for (i = 0; i < nmachines; i++) {
+            if (rand () % 4 == 0)
+                level[i] += (rand () % 200 - 100) / 1000.0;
+            double value = round (level[i] * 1000) / 1000;
+            raw[(size_t) i * nticks + r].value = value;
+            raw[(size_t) i * nticks + r].ts = ts;
+            ghist_push (&hist, i, ts, value);
+        }
+    }
+    double encode = (now_ns () - start) / hist.nsamples;
+
+    double bytes = (double) hist.nblocks * GBLOCK_BYTES;
+    double raw_bytes = (double) hist.nsamples * sizeof (raw_t);
+    printf ("%d machines, %.1f h at 5 s: %lld samples\n", nmachines, hours, (long long) hist.nsamples);
+    printf ("raw        %10.1f KiB  16.00 bytes/sample\n", raw_bytes / 1024);
+    printf ("compressed %10.1f KiB  %5.2f bytes/sample  %.2f bits/sample  %.1fx\n",
+            bytes / 1024, bytes / hist.nsamples, bytes * 8 / hist.nsamples, raw_bytes / bytes);
+    printf ("encode     %10.1f ns/sample\n", encode);
+
+    /* Mean of the last hour of every machine */
+    int64_t from = ts - NS_PER_HOUR, to = ts + 1;
+    double sum = 0, total = 0;
+    int64_t count = 0, samples = 0;
+
+    start = now_ns ();
+    for (i = 0; i < nmachines; i++) {
+        ghist_aggregate (&hist, i, from, to, &sum, &count);
+        total += sum;
+        samples += count;
+    }
+    double gdt = now_ns () - start;
+    sink = total;
+
+    double rtotal = 0;
+    int64_t rsamples = 0;
+    start = now_ns ();
+    for (i = 0; i < nmachines; i++) {
+        raw_t *row = &raw[(size_t) i * nticks];
+        for (r = 0; r < nticks; r++) {
+            if (row[r].ts >= from && row[r].ts < to) {
+                rtotal += row[r].value;
+                rsamples++;
+            }
+        }
+    }
+    double rdt = now_ns () - start;
+    sink = rtotal;
+
+    /* Whole retention, every sample decoded */
+    start = now_ns ();
+    for (i = 0; i < nmachines; i++)
+        ghist_aggregate (&hist, i, 0, INT64_MAX, &sum, &count);
+    double fdt = now_ns () - start;
+
+    printf ("last hour  compressed %.2f ms  raw scan %.2f ms  (%lld/%lld samples, means %.4f/%.4f)\n",
+            gdt / 1e6, rdt / 1e6, (long long) samples, (long long) rsamples,
+            samples ? total / samples : 0, rsamples ? rtotal / rsamples : 0);
+    printf ("full scan  compressed %.2f ns/sample\n", fdt / hist.nsamples);
+
+    ghist_free (&hist);
+    free (raw);
+    free (level);
+    return 0;
+}
@@ -0,0 +1,234 @@
+/* Aggregation kernels per fleet size: scalar vs SSE2 vs AVX2
+ *
+ * Build with `make bench` and run ./bench/kernels_bench [repeats]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#include "kernels.h"
+
+#define NGROUPS 11  // as many as components_t
+#define PSAMPLES 61 // samples per machine in a 5 minute period
+
+static const char *sets[] = {"scalar", "sse2", "avx2"};
+static const int sizes[] = {243, 1000, 10000, 100000};
+
+volatile double sink;
+
+static double now_ns ()
+{
+    struct timespec ts;
+    clock_gettime (CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/* One short period worth of work: per machine means over the
+ * period window, then per type sums of the means
+ */
+static double bench_period (const double *period, const int32_t *type, double *avg, int n, long reps)
+{
+    long r = 0;
+    int i = 0;
+    double sums[NGROUPS];
+    double start = now_ns ();
+
+    for (r = 0; r < reps; r++) {
+        for (i = 0; i < n; i++)
+            avg[i] = kern.sum (&period[(size_t) i * PSAMPLES], PSAMPLES) / PSAMPLES;
+        kern.group_sum (avg, type, n, sums, NGROUPS);
+        sink = sums[1];
+    }
+    return (now_ns () - start) / reps;
+}
+
+static double bench_sum (const double *x, int n, long reps)
+{
+    long r = 0;
+    double start = now_ns ();
+
+    for (r = 0; r < reps; r++)
+        sink = kern.sum (x, n);
+    return (now_ns () - start) / reps;
+}
+
+static double bench_mean_var (const double *x, int n, long reps)
+{
+    long r = 0;
+    double mean, var;
+    double start = now_ns ();
+
+    for (r = 0; r < reps; r++) {
+        kern.mean_var (x, n, &mean, &var);
+        sink = var;
+    }
+    return (now_ns () - start) / reps;
+}
+
+static double bench_group_sum (const double *x, const int32_t *type, int n, long reps)
+{
+    long r = 0;
+    double sums[NGROUPS];
+    double start = now_ns ();
+
+    for (r = 0; r < reps; r++) {
+        kern.group_sum (x, type, n, sums, NGROUPS);
+        sink = sums[1];
+    }
+    return (now_ns () - start) / reps;
+}
+
+/* air_density() of the analytics, exact power */
+static double air_density_pow (double temp, double humd, double pres)
+{
+    double Psv = 611.2 * pow (2.718, (16.67 * temp) / (temp + 243.5));
+    double Pv = (humd / 100) * Psv;
+    double Pd = (pres*100) - Pv;
+    double Tk = temp + 273.15;
+    return (Pd / (287.0531 * Tk)) + (Pv / (461.4964 * Tk));
+}
+
+/* Time per reading of the air density kernel and its largest
+ * relative error against the exact power
+ */
+static double bench_air_density (const double *t, const double *h, const double *p, double *rho, int n, long reps,
+                                 double *max_err)
+{
+    long r = 0;
+    int i = 0;
+    double start = now_ns ();
+
+    for (r = 0; r < reps; r++) {
+        kern.air_density (t, h, p, rho, n);
+        sink = rho[0];
+    }
+    double ns = (now_ns () - start) / reps / n;
+
+    *max_err = 0;
+    for (i = 0; i < n; i++) {
+        double ref = air_density_pow (t[i], h[i], p[i]);
+        double err = fabs (rho[i] - ref) / ref;
+        if (err > *max_err)
+            *max_err = err;
+    }
+    return ns;
+}
+
+static double bench_air_density_pow (const double *t, const double *h, const double *p, int n, long reps)
+{
+    long r = 0;
+    int i = 0;
+    double start = now_ns ();
+
+    for (r = 0; r < reps; r++) {
+        for (i = 0; i < n; i++)
+            sink = air_density_pow (t[i], h[i], p[i]);
+    }
+    return (now_ns () - start) / reps / n;
+}
+
+/* Checks every kernel set against the scalar one
+ */
+static int check (const double *x, const int32_t *type, int n)
+{
+    int g = 0;
+    double ref_sum, ref_mean, ref_var, ref_groups[NGROUPS];
+    double sum, mean, var, groups[NGROUPS];
+
+    kernels_init ("scalar");
+    ref_sum = kern.sum (x, n);
+    kern.mean_var (x, n, &ref_mean, &ref_var);
+    kern.group_sum (x, type, n, ref_groups, NGROUPS);
+    kernels_init (NULL);
+    sum = kern.sum (x, n);
+    kern.mean_var (x, n, &mean, &var);
+    kern.group_sum (x, type, n, groups, NGROUPS);
+
+    if (fabs (sum - ref_sum) > 1e-9 * fabs (ref_sum) || fabs (mean - ref_mean) > 1e-9 * fabs (ref_mean)
+        || fabs (var - ref_var) > 1e-9 * fabs (ref_var)) {
+        printf ("ERROR: %s kernels disagree with scalar at n = %d\n", kern.name, n);
+        return -1;
+    }
+    for (g = 0; g < NGROUPS; g++) {
+        if (fabs (groups[g] - ref_groups[g]) > 1e-9 * fabs (ref_groups[g])) {
+            printf ("ERROR: %s group_sum disagrees with scalar at n = %d\n", kern.name, n);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int main (int argc, char *argv[])
+{
+    int s = 0, k = 0, i = 0;
+    long repeats = 20000000;
+    if (argc > 1)
+        repeats = strtol (argv[1], NULL, 10);
+
+    int nmax = sizes[sizeof (sizes) / sizeof (sizes[0]) - 1];
+    double *x = (double *) malloc (sizeof (double) * nmax);
+    double *avg = (double *) malloc (sizeof (double) * nmax);
+    double *period = (double *) malloc (sizeof (double) * nmax * PSAMPLES);
+    int32_t *type = (int32_t *) malloc (sizeof (int32_t) * nmax);
+
+    srand (42);
+    for (i = 0; i < nmax; i++) {
+        x[i] = 5 + 20.0 * rand () / RAND_MAX;
+        type[i] = 1 + rand () % (NGROUPS - 1);
+    }
+    for (i = 0; i < nmax * PSAMPLES; i++)
+        period[i] = 5 + 20.0 * rand () / RAND_MAX;
+
+    for (s = 0; s < (int) (sizeof (sizes) / sizeof (sizes[0])); s++) {
+        if (check (x, type, sizes[s]) < 0)
+            return -1;
+    }
+
+    printf ("machines  kernels   sum ns  mean_var ns  group_sum ns  period us\n");
+    for (s = 0; s < (int) (sizeof (sizes) / sizeof (sizes[0])); s++) {
+        int n = sizes[s];
+        long reps = repeats / n;
+        for (k = 0; k < (int) (sizeof (sets) / sizeof (sets[0])); k++) {
+            if (kernels_init (sets[k]) < 0)
+                continue;
+            printf ("%8d  %-7s %8.0f  %11.0f  %12.0f  %9.1f\n", n, kern.name,
+                    bench_sum (x, n, reps), bench_mean_var (x, n, reps),
+                    bench_group_sum (x, type, n, reps),
+                    bench_period (period, type, avg, n, reps / PSAMPLES + 1) / 1e3);
+        }
+    }
+
+    /* air density of a sensor series, against the exact power per reading */
+    int nread = 10000;
+    double *t = (double *) malloc (sizeof (double) * nread);
+    double *h = (double *) malloc (sizeof (double) * nread);
+    double *p = (double *) malloc (sizeof (double) * nread);
+    double *rho = (double *) malloc (sizeof (double) * nread);
+    for (i = 0; i < nread; i++) {
+        t[i] = -30 + 80.0 * rand () / RAND_MAX;
+        h[i] = 100.0 * rand () / RAND_MAX;
+        p[i] = 950 + 100.0 * rand () / RAND_MAX;
+    }
+    long reps = repeats / nread / 10 + 1;
+    printf ("\nreadings  kernels   air_density ns/reading  max rel error\n");
+    printf ("%8d  %-7s %24.2f  %13s\n", nread, "pow", bench_air_density_pow (t, h, p, nread, reps), "-");
+    for (k = 0; k < (int) (sizeof (sets) / sizeof (sets[0])); k++) {
+        double err = 0;
+        if (kernels_init (sets[k]) < 0)
+            continue;
+        double ns = bench_air_density (t, h, p, rho, nread, reps, &err);
+        printf ("%8d  %-7s %24.2f  %13.2e\n", nread, kern.name, ns, err);
+    }
+
+    free (x);
+    free (avg);
+    free (period);
+    free (type);
+    free (t);
+    free (h);
+    free (p);
+    free (rho);
+    return 0;
+}
@@ -0,0 +1,105 @@
+/* Parse cost per payload: streaming extractor vs json-c DOM
+ *
+ * Build with `make bench` and run ./bench/parse_bench [iterations]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "json.h"
+#include "jscan.h"
+
+static const char *machine_payload =
+    "{\"name\":\"DMG DMU 40eVo [#50]\",\"timestamp\":\"2017-01-30T12:54:29.614533\","
+    "\"current\":12.17,\"state\":\"working\",\"location\":\"52.123,8.567\","
+    "\"current_alert\":14.0,\"type\":\"mill\"}";
+
+static const char *sensor_payload =
+    "{\"pressure\":[\"2017-01-30T12:54:30\",1011.94],"
+    "\"temperature\":[\"2017-01-30T12:54:30\",21.34],"
+    "\"humidity\":[\"2017-01-30T12:54:30\",45.23]}";
+
+static const jfield_t machine_fields[] = {
+    {"current", JF_NUMBER},
+    {"current_alert", JF_NUMBER},
+};
+static const jspec_t machine_spec = {machine_fields, 2};
+
+static const jfield_t sensor_fields[] = {
+    {"temperature", JF_PAIR},
+    {"pressure", JF_PAIR},
+    {"humidity", JF_PAIR},
+};
+static const jspec_t sensor_spec = {sensor_fields, 3};
+
+volatile double sink;
+
+static double now_ns ()
+{
+    struct timespec ts;
+    clock_gettime (CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/* Streaming extraction, fed in fragments of at most step bytes
+ */
+static double bench_jscan (const char *payload, const jspec_t *spec, size_t step, long iters)
+{
+    long i = 0;
+    size_t off = 0;
+    size_t len = strlen (payload);
+    jscan_t scan;
+    double start = now_ns ();
+
+    for (i = 0; i < iters; i++) {
+        jscan_init (&scan, spec);
+        for (off = 0; off < len; off += step)
+            jscan_feed (&scan, payload + off, (len - off < step) ? len - off : step);
+        if (jscan_finish (&scan) < 0)
+            abort ();
+        sink = scan.values[0].number + scan.values[1].number;
+    }
+    return (now_ns () - start) / iters;
+}
+
+/* DOM parse with json-c and the same lookups as the monitor
+ */
+static double bench_jsonc (const char *payload, const jspec_t *spec, long iters)
+{
+    long i = 0;
+    int j = 0;
+    double start = now_ns ();
+
+    for (i = 0; i < iters; i++) {
+        json_object *jdetail = json_tokener_parse (payload);
+        double sum = 0;
+        for (j = 0; j < spec->nfields; j++) {
+            json_object *tmp = NULL;
+            json_object_object_get_ex (jdetail, spec->fields[j].key, &tmp);
+            if (spec->fields[j].kind == JF_PAIR)
+                tmp = json_object_array_get_idx (tmp, 1);
+            sum += json_object_get_double (tmp);
+        }
+        sink = sum;
+        json_object_put (jdetail);
+    }
+    return (now_ns () - start) / iters;
+}
+
+int main (int argc, char *argv[])
+{
+    long iters = 1000000;
+    if (argc > 1)
+        iters = strtol (argv[1], NULL, 10);
+
+    printf ("payload   parser          ns/payload\n");
+    printf ("machine   jscan           %10.1f\n", bench_jscan (machine_payload, &machine_spec, (size_t) -1, iters));
+    printf ("machine   jscan/16B-frags %10.1f\n", bench_jscan (machine_payload, &machine_spec, 16, iters));
+    printf ("machine   json-c          %10.1f\n", bench_jsonc (machine_payload, &machine_spec, iters / 4));
+    printf ("sensor    jscan           %10.1f\n", bench_jscan (sensor_payload, &sensor_spec, (size_t) -1, iters));
+    printf ("sensor    jscan/16B-frags %10.1f\n", bench_jscan (sensor_payload, &sensor_spec, 16, iters));
+    printf ("sensor    json-c          %10.1f\n", bench_jsonc (sensor_payload, &sensor_spec, iters / 4));
+
+    return 0;
+}
@@ -0,0 +1,95 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "fleet.h"
+
+/*******************************************************
+ *                                                     *
+ *                   Fleet Store                       *
+ *                                                     *
+ *******************************************************/
+
+/* Zeroed allocation of a column, aligned and padded to a cache line
+ */
+static void *column_alloc (size_t nmemb, size_t size)
+{
+    size_t bytes = nmemb * size;
+    bytes = (bytes + FLEET_ALIGN - 1) / FLEET_ALIGN * FLEET_ALIGN;
+    if (bytes == 0)
+        bytes = FLEET_ALIGN;
+
+    void *column = aligned_alloc (FLEET_ALIGN, bytes);
+    if (column)
+        memset (column, 0, bytes);
+    return column;
+}
+
+/* fleet_init()
+ * Allocates the columns for size machines with room for
+ * period_samples in each period window and rolling windows
+ * of span seconds sampled every frequency seconds
+ */
+int fleet_init (fleet_t *fleet, int size, int period_samples, double span, double frequency)
+{
+    int i = 0;
+    int wcap = 0;
+    int64_t span_ns = (int64_t) (span * 1e9);
+
+    memset (fleet, 0, sizeof (fleet_t));
+    fleet->size = size;
+    fleet->pstride = (period_samples + 7) / 8 * 8;
+
+    fleet->current = (double *) column_alloc (size, sizeof (double));
+    fleet->threshold = (double *) column_alloc (size, sizeof (double));
+    fleet->type = (int32_t *) column_alloc (size, sizeof (int32_t));
+    fleet->phead = (int32_t *) column_alloc (size, sizeof (int32_t));
+    fleet->fresh = (uint8_t *) column_alloc (size, sizeof (uint8_t));
+    fleet->avgwin = (rwin_t *) column_alloc (size, sizeof (rwin_t));
+    fleet->period = (double *) column_alloc ((size_t) size * fleet->pstride, sizeof (double));
+    fleet->pavg = (double *) column_alloc (size, sizeof (double));
+    fleet->meta = (mmeta_t *) calloc (size > 0 ? size : 1, sizeof (mmeta_t));
+
+    /* all rolling windows share one slab */
+    wcap = rwin_capacity (span_ns, frequency);
+    fleet->avgwin_slab = (cw_t *) column_alloc ((size_t) size * wcap, sizeof (cw_t));
+
+    if (!fleet->current || !fleet->threshold || !fleet->type || !fleet->phead || !fleet->fresh
+            || !fleet->avgwin || !fleet->period || !fleet->pavg || !fleet->meta || !fleet->avgwin_slab) {
+        printf ("ERROR: Could not allocate the fleet store for %d machines\n", size);
+        fleet_free (fleet);
+        return -1;
+    }
+
+    for (i = 0; i < size; i++) {
+        fleet->type[i] = CMP_ALL;
+        rwin_init_with (&fleet->avgwin[i], span_ns, &fleet->avgwin_slab[(size_t) i * wcap], wcap);
+    }
+
+    return 0;
+}
+
+void fleet_free (fleet_t *fleet)
+{
+    int i = 0;
+
+    for (i = 0; fleet->meta && i < fleet->size; i++) {
+        free (fleet->meta[i].name);
+        free (fleet->meta[i].url);
+    }
+    for (i = 0; fleet->avgwin && i < fleet->size; i++) {
+        rwin_free (&fleet->avgwin[i]);
+    }
+    free (fleet->current);
+    free (fleet->threshold);
+    free (fleet->type);
+    free (fleet->phead);
+    free (fleet->fresh);
+    free (fleet->avgwin);
+    free (fleet->period);
+    free (fleet->pavg);
+    free (fleet->meta);
+    free (fleet->avgwin_slab);
+    memset (fleet, 0, sizeof (fleet_t));
+}
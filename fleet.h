@@ -0,0 +1,42 @@
+#ifndef FLEET_H
+#define FLEET_H
+
+#include <stdint.h>
+#include "machinepark.h"
+#include "rwin.h"
+
+/* Struct-of-arrays store of the machine park.
+ * Hot per-machine data lives in dense, cache-line aligned columns
+ * indexed by machine, so fleet-wide passes are linear scans.
+ * Cold metadata (uuid, name, url) is kept apart in meta.
+ */
+
+#define FLEET_ALIGN 64
+
+typedef struct machine_meta {
+    char            uuid[37];               /* uuid with a null character */
+    char            *name;                  /* Name of the machine */
+    char            *url;                   /* Detail url of the machine */
+} mmeta_t;
+
+typedef struct fleet {
+    int             size;                   /* Number of machines */
+    /* hot columns */
+    double          *current;               /* The current value */
+    double          *threshold;             /* The current threshold */
+    int32_t         *type;                  /* Machine type such as mill, lathe etc */
+    int32_t         *phead;                 /* Samples in the period window */
+    uint8_t         *fresh;                 /* A new reading arrived this tick */
+    rwin_t          *avgwin;                /* Rolling windows of the last seconds_history */
+    double          *period;                /* Period windows, machine i at i * pstride */
+    int             pstride;                /* Row stride of period, multiple of a cache line */
+    double          *pavg;                  /* Machine averages of the last period */
+    /* cold data */
+    mmeta_t         *meta;                  /* Metadata of the machines */
+    cw_t            *avgwin_slab;           /* Backing storage of the rolling windows */
+} fleet_t;
+
+int fleet_init (fleet_t *fleet, int size, int period_samples, double span, double frequency);
+void fleet_free (fleet_t *fleet);
+
+#endif
@@ -0,0 +1,245 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ghist.h"
+
+#define GHIST_MAGIC "MPGH0002"
+#define GHIST_MAGIC_SECONDS "MPGH0001"   /* Saved with epoch second timestamps */
+
+/*******************************************************
+ *                                                     *
+ *               Compressed History                    *
+ *                                                     *
+ *******************************************************/
+
+/* ghist_init()
+ * Creates nseries empty series keeping retention each, in the unit
+ * of the timestamps pushed.
+ * The caller names the series through their key.
+ */
+int ghist_init (ghist_t *hist, int nseries, int64_t retention)
+{
+    memset (hist, 0, sizeof (ghist_t));
+    hist->series = (gseries_t *) calloc (nseries, sizeof (gseries_t));
+    if (hist->series == NULL) {
+        printf ("ERROR: Could not allocate compressed history\n");
+        return -1;
+    }
+    hist->nseries = nseries;
+    hist->retention = retention;
+    return 0;
+}
+
+static gblock_t *ghist_block (ghist_t *hist)
+{
+    gblock_t *block = hist->free;
+    if (block)
+        hist->free = block->next;
+    else
+        block = (gblock_t *) malloc (sizeof (gblock_t));
+    if (block) {
+        gblock_init (block);
+        hist->nblocks++;
+    }
+    return block;
+}
+
+static void ghist_link (ghist_t *hist, gseries_t *series, gblock_t *block)
+{
+    block->next = NULL;
+    if (series->tail)
+        series->tail->next = block;
+    else
+        series->head = block;
+    series->tail = block;
+}
+
+/* ghist_push()
+ * Appends a sample to series s and recycles the blocks that fell
+ * out of the retention
+ */
+int ghist_push (ghist_t *hist, int s, int64_t ts, double value)
+{
+    gseries_t *series = &hist->series[s];
+
+    if (series->tail == NULL || gblock_append (series->tail, ts, value) < 0) {
+        gblock_t *block = ghist_block (hist);
+        if (block == NULL) {
+            printf ("ERROR: Could not allocate a history block\n");
+            return -1;
+        }
+        ghist_link (hist, series, block);
+        gblock_append (block, ts, value);
+    }
+    hist->nsamples++;
+
+    while (series->head != series->tail && series->head->last_ts < ts - hist->retention) {
+        gblock_t *old = series->head;
+        series->head = old->next;
+        hist->nblocks--;
+        hist->nsamples -= old->count;
+        old->next = hist->free;
+        hist->free = old;
+    }
+    return 0;
+}
+
+/* ghist_aggregate()
+ * Sum and count of the samples of series s with from <= ts < to,
+ * decoded block by block without materialising them
+ */
+void ghist_aggregate (ghist_t *hist, int s, int64_t from, int64_t to, double *sum, int64_t *count)
+{
+    gblock_t *block;
+
+    *sum = 0;
+    *count = 0;
+    for (block = hist->series[s].head; block; block = block->next)
+        gblock_aggregate (block, from, to, sum, count);
+}
+
+/*******************************************************
+ *                                                     *
+ *                    Persistence                      *
+ *                                                     *
+ *******************************************************/
+
+/* The file holds the magic, the number of series and per series its
+ * key, its number of blocks and the encoded blocks, oldest first
+ */
+int ghist_save (ghist_t *hist, const char *path)
+{
+    int i = 0;
+    char tmp[512];
+    gblock_t *block;
+
+    snprintf (tmp, sizeof (tmp), "%s.tmp", path);
+    FILE *fp = fopen (tmp, "w");
+    if (fp == NULL) {
+        printf ("ERROR: Could not write history %s\n", tmp);
+        return -1;
+    }
+    fwrite (GHIST_MAGIC, 8, 1, fp);
+    fwrite (&hist->nseries, sizeof (int), 1, fp);
+    for (i = 0; i < hist->nseries; i++) {
+        int32_t nblocks = 0;
+        for (block = hist->series[i].head; block; block = block->next)
+            nblocks++;
+        fwrite (hist->series[i].key, GHIST_KEY, 1, fp);
+        fwrite (&nblocks, sizeof (nblocks), 1, fp);
+        for (block = hist->series[i].head; block; block = block->next)
+            fwrite (block, GBLOCK_BYTES, 1, fp);
+    }
+    if (fclose (fp) != 0 || rename (tmp, path) != 0) {
+        printf ("ERROR: Could not write history %s\n", path);
+        return -1;
+    }
+    return 0;
+}
+
+static int gseries_compare (const void *a, const void *b)
+{
+    return strncmp ((*(gseries_t * const *) a)->key, (*(gseries_t * const *) b)->key, GHIST_KEY);
+}
+
+/* A block read from a file holds no more bits than fit in it, and
+ * enough for its samples: 128 for the first, at least 2 for the others
+ */
+static int gblock_valid (const gblock_t *block)
+{
+    if (block->nbits > GBLOCK_WORDS * 64)
+        return 0;
+    return block->count == 0 || 128 + 2 * ((uint64_t) block->count - 1) <= block->nbits;
+}
+
+/* ghist_load()
+ * Loads the series saved in path into the series of hist with the
+ * same key; saved series without a match are skipped. A missing file,
+ * or one saved before timestamps were ns, is an empty history.
+ */
+int ghist_load (ghist_t *hist, const char *path)
+{
+    int i = 0, j = 0;
+    int nseries = 0;
+    int loaded = 0;
+    int failed = 0;
+    char magic[8] = {0};
+    gseries_t key;
+
+    FILE *fp = fopen (path, "r");
+    if (fp == NULL)
+        return 0;
+    if (fread (magic, 8, 1, fp) == 1 && memcmp (magic, GHIST_MAGIC_SECONDS, 8) == 0) {
+        printf ("History %s has second timestamps, starting empty\n", path);
+        fclose (fp);
+        return 0;
+    }
+    if (memcmp (magic, GHIST_MAGIC, 8) != 0 || fread (&nseries, sizeof (int), 1, fp) != 1) {
+        printf ("ERROR: %s is not a history file\n", path);
+        fclose (fp);
+        return -1;
+    }
+
+    /* Series by key */
+    gseries_t **sorted = (gseries_t **) malloc (sizeof (gseries_t *) * hist->nseries);
+    for (i = 0; i < hist->nseries; i++)
+        sorted[i] = &hist->series[i];
+    qsort (sorted, hist->nseries, sizeof (gseries_t *), gseries_compare);
+
+    for (i = 0; i < nseries && !failed; i++) {
+        int32_t nblocks = 0;
+        gseries_t *kp = &key;
+        if (fread (key.key, GHIST_KEY, 1, fp) != 1 || fread (&nblocks, sizeof (nblocks), 1, fp) != 1)
+            break;
+        gseries_t **found = (gseries_t **) bsearch (&kp, sorted, hist->nseries, sizeof (gseries_t *), gseries_compare);
+        if (found && (*found)->head != NULL)
+            found = NULL;
+        for (j = 0; j < nblocks; j++) {
+            gblock_t *block = ghist_block (hist);
+            if (block == NULL) {
+                printf ("ERROR: Could not allocate a history block\n");
+                failed = 1;
+                break;
+            }
+            if (fread (block, GBLOCK_BYTES, 1, fp) != 1 || !gblock_valid (block)) {
+                printf ("ERROR: Corrupt block in history file %s\n", path);
+                hist->nblocks--;
+                free (block);
+                failed = 1;
+                break;
+            }
+            if (found) {
+                ghist_link (hist, *found, block);
+                hist->nsamples += block->count;
+            } else {
+                hist->nblocks--;
+                block->next = hist->free;
+                hist->free = block;
+            }
+        }
+        loaded += (found != NULL);
+    }
+    free (sorted);
+    fclose (fp);
+    return loaded;
+}
+
+void ghist_free (ghist_t *hist)
+{
+    int i = 0;
+    gblock_t *block, *next;
+
+    for (i = 0; i < hist->nseries; i++) {
+        for (block = hist->series[i].head; block; block = next) {
+            next = block->next;
+            free (block);
+        }
+    }
+    for (block = hist->free; block; block = next) {
+        next = block->next;
+        free (block);
+    }
+    free (hist->series);
+    memset (hist, 0, sizeof (ghist_t));
+}
@@ -0,0 +1,37 @@
+#ifndef GHIST_H
+#define GHIST_H
+
+#include <stdint.h>
+#include "gorilla.h"
+
+/* Long retention history of many series, Gorilla compressed.
+ * Every series is a chain of blocks, oldest first; blocks whose last
+ * sample is older than the retention are recycled whole through a
+ * free list, so steady state pushes do not allocate.
+ */
+
+#define GHIST_KEY 40                    /* Bytes per series key, null padded */
+
+typedef struct gseries {
+    gblock_t        *head;              /* Oldest block */
+    gblock_t        *tail;              /* Block being appended to */
+    char            key[GHIST_KEY];     /* Name of the series, e.g. a machine uuid */
+} gseries_t;
+
+typedef struct ghist {
+    gseries_t       *series;            /* All series */
+    int             nseries;            /* Number of series */
+    int64_t         retention;          /* Time of samples kept, in the unit of the timestamps */
+    gblock_t        *free;              /* Recycled blocks */
+    int64_t         nblocks;            /* Blocks in use */
+    int64_t         nsamples;           /* Samples in the blocks in use */
+} ghist_t;
+
+int ghist_init (ghist_t *hist, int nseries, int64_t retention);
+int ghist_push (ghist_t *hist, int s, int64_t ts, double value);
+void ghist_aggregate (ghist_t *hist, int s, int64_t from, int64_t to, double *sum, int64_t *count);
+int ghist_save (ghist_t *hist, const char *path);
+int ghist_load (ghist_t *hist, const char *path);
+void ghist_free (ghist_t *hist);
+
+#endif
@@ -0,0 +1,282 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "gorilla.h"
+
+/*******************************************************
+ *                                                     *
+ *                    Bitstream                        *
+ *                                                     *
+ *******************************************************/
+
+/* Appends the low n bits of v, n <= 64 */
+static inline void put_bits (gblock_t *b, uint64_t v, int n)
+{
+    uint32_t word = b->nbits >> 6;
+    int used = b->nbits & 63;
+    int room = 64 - used;
+
+    if (n == 0)
+        return;
+    if (n < 64)
+        v &= (1ULL << n) - 1;
+    if (n <= room) {
+        b->words[word] |= v << (room - n);
+    } else {
+        b->words[word] |= v >> (n - room);
+        b->words[word + 1] = v << (64 - (n - room));
+    }
+    b->nbits += n;
+}
+
+/* Reads n bits, n <= 64 */
+static inline uint64_t get_bits (gdec_t *d, int n)
+{
+    const uint64_t *words = d->block->words;
+    uint32_t word = d->pos >> 6;
+    int used = d->pos & 63;
+    int room = 64 - used;
+    uint64_t v;
+
+    if (n == 0)
+        return 0;
+    /* a corrupt block never reads past its bits: pos ends up beyond
+     * nbits and gdec_next() stops */
+    if (d->pos + (uint32_t) n > d->block->nbits) {
+        d->pos = d->block->nbits + 1;
+        return 0;
+    }
+    if (n <= room) {
+        v = words[word] << used;
+        v = (n == 64) ? v : v >> (64 - n);
+    } else {
+        v = (words[word] << used) >> (64 - n);
+        v |= words[word + 1] >> (64 - (n - room));
+    }
+    d->pos += n;
+    return v;
+}
+
+static inline int64_t sign_extend (uint64_t v, int n)
+{
+    return (int64_t) (v << (64 - n)) >> (64 - n);
+}
+
+static inline uint64_t double_bits (double value)
+{
+    uint64_t bits;
+    memcpy (&bits, &value, sizeof (bits));
+    return bits;
+}
+
+/* Readings carry a few decimals, which XOR badly: v * GORILLA_SCALE
+ * is an integer for them, and consecutive readings differ by a small
+ * step of it. Only values that decode back to the very same bits use
+ * the step.
+ */
+static inline int64_t decimal_scaled (double value)
+{
+    double scaled = value * GORILLA_SCALE;
+    return (int64_t) (scaled + (scaled < 0 ? -0.5 : 0.5));
+}
+
+static inline int decimal_exact (double value, int64_t *scaled)
+{
+    if (!(value > -GORILLA_DECIMAL_MAX && value < GORILLA_DECIMAL_MAX))
+        return 0;
+    *scaled = decimal_scaled (value);
+    return double_bits ((double) *scaled / GORILLA_SCALE) == double_bits (value);
+}
+
+/*******************************************************
+ *                                                     *
+ *                     Encoder                         *
+ *                                                     *
+ *******************************************************/
+
+void gblock_init (gblock_t *block)
+{
+    memset (block, 0, sizeof (gblock_t));
+}
+
+/* gblock_append()
+ * Encodes a sample, -1 if the block may not have room for it
+ */
+int gblock_append (gblock_t *b, int64_t ts, double value)
+{
+    uint64_t bits = double_bits (value);
+
+    if (b->nbits + GBLOCK_MAX_SAMPLE > GBLOCK_WORDS * 64)
+        return -1;
+
+    if (b->count == 0) {
+        put_bits (b, ts, 64);
+        put_bits (b, bits, 64);
+        b->first_ts = ts;
+        b->lead = 0xff;
+    } else {
+        /* Timestamp: delta of deltas in 0, 7, 9, 12 or 64 bits */
+        int64_t delta = ts - b->last_ts;
+        int64_t dod = delta - b->prev_delta;
+        if (dod == 0) {
+            put_bits (b, 0, 1);
+        } else if (dod >= -64 && dod <= 63) {
+            put_bits (b, 0x2, 2);
+            put_bits (b, dod, 7);
+        } else if (dod >= -256 && dod <= 255) {
+            put_bits (b, 0x6, 3);
+            put_bits (b, dod, 9);
+        } else if (dod >= -2048 && dod <= 2047) {
+            put_bits (b, 0xe, 4);
+            put_bits (b, dod, 12);
+        } else {
+            put_bits (b, 0xf, 4);
+            put_bits (b, dod, 64);
+        }
+        b->prev_delta = delta;
+
+        /* Value: a decimal step in 8, 14 or 24 bits, else XOR with
+         * the previous one, meaningful bits only
+         */
+        uint64_t x = bits ^ b->prev_bits;
+        int64_t cur, prev, step = INT64_MAX;
+        double prev_value;
+        memcpy (&prev_value, &b->prev_bits, sizeof (double));
+        if (x != 0 && decimal_exact (value, &cur) && decimal_exact (prev_value, &prev))
+            step = cur - prev;
+
+        if (x == 0) {
+            put_bits (b, 0, 1);
+        } else if (step >= -128 && step <= 127) {
+            put_bits (b, 0x4, 3);
+            put_bits (b, step, 8);
+        } else if (step >= -8192 && step <= 8191) {
+            put_bits (b, 0xa, 4);
+            put_bits (b, step, 14);
+        } else if (step >= -8388608 && step <= 8388607) {
+            put_bits (b, 0xb, 4);
+            put_bits (b, step, 24);
+        } else {
+            int lead = __builtin_clzll (x);
+            int trail = __builtin_ctzll (x);
+            if (lead > 31)
+                lead = 31;
+            if (b->lead != 0xff && lead >= b->lead && trail >= b->trail) {
+                put_bits (b, 0x6, 3);
+                put_bits (b, x >> b->trail, 64 - b->lead - b->trail);
+            } else {
+                int len = 64 - lead - trail;
+                put_bits (b, 0x7, 3);
+                put_bits (b, lead, 5);
+                put_bits (b, len & 63, 6);
+                put_bits (b, x >> trail, len);
+                b->lead = lead;
+                b->trail = trail;
+            }
+        }
+    }
+    b->prev_bits = bits;
+    b->last_ts = ts;
+    b->count++;
+    return 0;
+}
+
+/*******************************************************
+ *                                                     *
+ *                     Decoder                         *
+ *                                                     *
+ *******************************************************/
+
+void gdec_init (gdec_t *dec, const gblock_t *block)
+{
+    memset (dec, 0, sizeof (gdec_t));
+    dec->block = block;
+    dec->left = block->count;
+}
+
+/* gdec_next()
+ * Decodes the next sample, 0 at the end of the block
+ */
+int gdec_next (gdec_t *d, int64_t *ts, double *value)
+{
+    if (d->left == 0)
+        return 0;
+
+    if (d->left == d->block->count) {
+        d->ts = (int64_t) get_bits (d, 64);
+        d->bits = get_bits (d, 64);
+    } else {
+        int64_t dod;
+        if (get_bits (d, 1) == 0)
+            dod = 0;
+        else if (get_bits (d, 1) == 0)
+            dod = sign_extend (get_bits (d, 7), 7);
+        else if (get_bits (d, 1) == 0)
+            dod = sign_extend (get_bits (d, 9), 9);
+        else if (get_bits (d, 1) == 0)
+            dod = sign_extend (get_bits (d, 12), 12);
+        else
+            dod = (int64_t) get_bits (d, 64);
+        d->delta += dod;
+        d->ts += d->delta;
+
+        if (get_bits (d, 1) == 0) {
+            /* repeated value */
+        } else if (get_bits (d, 1) == 0) {
+            double prev;
+            int64_t step;
+            memcpy (&prev, &d->bits, sizeof (double));
+            if (get_bits (d, 1) == 0)
+                step = sign_extend (get_bits (d, 8), 8);
+            else if (get_bits (d, 1) == 0)
+                step = sign_extend (get_bits (d, 14), 14);
+            else
+                step = sign_extend (get_bits (d, 24), 24);
+            prev = (double) (decimal_scaled (prev) + step) / GORILLA_SCALE;
+            d->bits = double_bits (prev);
+        } else {
+            if (get_bits (d, 1)) {
+                d->lead = get_bits (d, 5);
+                int len = get_bits (d, 6);
+                if (len == 0)
+                    len = 64;
+                d->trail = 64 - d->lead - len;
+            }
+            int len = 64 - d->lead - d->trail;
+            d->bits ^= get_bits (d, len) << d->trail;
+        }
+    }
+    if (d->pos > d->block->nbits) {
+        d->left = 0;
+        return 0;
+    }
+    d->left--;
+    *ts = d->ts;
+    memcpy (value, &d->bits, sizeof (double));
+    return 1;
+}
+
+/* gblock_aggregate()
+ * Adds the samples with from <= timestamp < to to sum and count,
+ * decoding straight from the block
+ */
+void gblock_aggregate (const gblock_t *block, int64_t from, int64_t to, double *sum, int64_t *count)
+{
+    gdec_t dec;
+    int64_t ts;
+    double value;
+
+    if (block->count == 0 || block->last_ts < from || block->first_ts >= to)
+        return;
+    gdec_init (&dec, block);
+    while (gdec_next (&dec, &ts, &value)) {
+        if (ts >= to)
+            break;
+        if (ts >= from) {
+            *sum += value;
+            *count += 1;
+        }
+    }
+}
@@ -0,0 +1,57 @@
+#ifndef GORILLA_H
+#define GORILLA_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* Gorilla compression of (timestamp, value) series.
+ * Timestamps are stored as delta-of-deltas, so a regular cadence costs
+ * one bit per sample; values are XORed with their predecessor and only
+ * the meaningful bits are kept, so a repeated value costs one bit too.
+ * Values with at most three decimals, as the API reports them, are
+ * stored as the step from the previous one in units of 0.001 instead.
+ * Samples go into fixed-size, self-contained blocks that can be copied
+ * or written to disk as they are, and decoded sequentially.
+ */
+
+#define GBLOCK_WORDS 30                 /* Bitstream words per block */
+#define GBLOCK_MAX_SAMPLE 146           /* Worst case bits of one sample */
+#define GORILLA_SCALE 1000.0            /* Units per 1 of a decimal step */
+#define GORILLA_DECIMAL_MAX 1e12        /* Larger values always XOR */
+
+typedef struct gorilla_block {
+    uint32_t        count;              /* Samples in the block */
+    uint32_t        nbits;              /* Bits written */
+    int64_t         first_ts;           /* Timestamp of the first sample */
+    int64_t         last_ts;            /* Timestamp of the last sample */
+    int64_t         prev_delta;         /* Encoder: last timestamp delta */
+    uint64_t        prev_bits;          /* Encoder: last value */
+    uint8_t         lead;               /* Encoder: leading zeros of the last XOR window */
+    uint8_t         trail;              /* Encoder: trailing zeros of the last XOR window */
+    uint8_t         pad[6];
+    uint64_t        words[GBLOCK_WORDS];/* Bitstream, most significant bit first */
+    struct gorilla_block *next;         /* Chaining, not part of the encoding */
+} gblock_t;
+
+/* Bytes of a block that make up its encoding */
+#define GBLOCK_BYTES (offsetof (gblock_t, next))
+
+/* Sequential decoder over a block */
+typedef struct gorilla_decoder {
+    const gblock_t  *block;             /* Block being decoded */
+    uint32_t        pos;                /* Next bit to read */
+    uint32_t        left;               /* Samples left */
+    int64_t         ts;                 /* Last timestamp */
+    int64_t         delta;              /* Last timestamp delta */
+    uint64_t        bits;               /* Last value */
+    uint8_t         lead;               /* Leading zeros of the last XOR window */
+    uint8_t         trail;              /* Trailing zeros of the last XOR window */
+} gdec_t;
+
+void gblock_init (gblock_t *block);
+int gblock_append (gblock_t *block, int64_t ts, double value);
+void gdec_init (gdec_t *dec, const gblock_t *block);
+int gdec_next (gdec_t *dec, int64_t *ts, double *value);
+void gblock_aggregate (const gblock_t *block, int64_t from, int64_t to, double *sum, int64_t *count);
+
+#endif
@@ -0,0 +1,83 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "hring.h"
+
+/*******************************************************
+ *                                                     *
+ *                 History Ring                        *
+ *                                                     *
+ *******************************************************/
+
+/* hring_init()
+ * Creates an empty ring of cap records over ntypes machine types
+ */
+int hring_init (hring_t *ring, int cap, int ntypes)
+{
+    int i = 0;
+
+    ring->entries = (phist_t *) calloc (cap, sizeof (phist_t));
+    ring->values = (double *) calloc ((size_t) cap * 2 * ntypes, sizeof (double));
+    if (ring->entries == NULL || ring->values == NULL) {
+        printf ("ERROR: Could not allocate history ring\n");
+        return -1;
+    }
+    for (i = 0; i < cap; i++) {
+        ring->entries[i].avg_current = &ring->values[(size_t) i * 2 * ntypes];
+        ring->entries[i].rho_cur_ratio = &ring->values[(size_t) i * 2 * ntypes + ntypes];
+    }
+    ring->cap = cap;
+    ring->ntypes = ntypes;
+    ring->head = 0;
+    ring->size = 0;
+    ring->total = 0;
+    return 0;
+}
+
+/* hring_push()
+ * Returns the record to fill as the newest one, evicting the
+ * oldest record when the ring is full
+ */
+phist_t *hring_push (hring_t *ring)
+{
+    phist_t *entry = &ring->entries[ring->head];
+
+    ring->head += 1;
+    if (ring->head == ring->cap)
+        ring->head = 0;
+    if (ring->size < ring->cap)
+        ring->size += 1;
+    ring->total += 1;
+    return entry;
+}
+
+/* hring_copy()
+ * Copies the records of src into dst, a ring of the same shape
+ */
+void hring_copy (hring_t *dst, const hring_t *src)
+{
+    int i = 0;
+
+    for (i = 0; i < src->cap; i++) {
+        phist_t *d = &dst->entries[i];
+        double *avg_current = d->avg_current, *rho_cur_ratio = d->rho_cur_ratio;
+        *d = src->entries[i];
+        d->avg_current = avg_current;
+        d->rho_cur_ratio = rho_cur_ratio;
+    }
+    memcpy (dst->values, src->values, sizeof (double) * src->cap * 2 * src->ntypes);
+    dst->head = src->head;
+    dst->size = src->size;
+    dst->total = src->total;
+}
+
+void hring_free (hring_t *ring)
+{
+    free (ring->entries);
+    free (ring->values);
+    ring->entries = NULL;
+    ring->values = NULL;
+    ring->cap = 0;
+    ring->size = 0;
+}
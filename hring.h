@@ -0,0 +1,44 @@
+#ifndef HRING_H
+#define HRING_H
+
+#include <stdint.h>
+#include "machinepark.h"
+
+/* Fixed-capacity ring of period history records.
+ * Records are stored contiguously, their per-type arrays in one slab
+ * next to them; pushing into a full ring overwrites the oldest record,
+ * so nothing is allocated after hring_init().
+ */
+typedef struct history_ring {
+    phist_t     *entries;               /* Ring of records, oldest at head - size */
+    double      *values;                /* Per-type arrays of all records */
+    int         cap;                    /* Capacity of the ring */
+    int         head;                   /* Next insert position */
+    int         size;                   /* Records in the ring */
+    int         ntypes;                 /* Machine types of every record */
+    int64_t     total;                  /* Records ever pushed */
+} hring_t;
+
+int hring_init (hring_t *ring, int cap, int ntypes);
+phist_t *hring_push (hring_t *ring);
+void hring_copy (hring_t *dst, const hring_t *src);
+void hring_free (hring_t *ring);
+
+/* The i-th newest record, i < size (0 = newest)
+ */
+static inline phist_t *hring_get (hring_t *ring, int i)
+{
+    int idx = ring->head - 1 - i;
+    return &ring->entries[(idx < 0) ? idx + ring->cap : idx];
+}
+
+/* Number of records pushed since the ring had pushed mark records,
+ * bounded by what is still kept
+ */
+static inline int hring_since (hring_t *ring, int64_t mark)
+{
+    int64_t n = ring->total - mark;
+    return (n < ring->size) ? (int) n : ring->size;
+}
+
+#endif
@@ -0,0 +1,309 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "jscan.h"
+
+/*******************************************************
+ *                                                     *
+ *               Streaming Extraction                  *
+ *                                                     *
+ *******************************************************/
+
+enum { LX_BETWEEN, LX_STRING, LX_ESCAPE, LX_UNICODE, LX_SCALAR };
+enum { ROLE_NONE, ROLE_KEY, ROLE_VALUE, ROLE_PAIR0, ROLE_PAIR1 };
+
+void jscan_init (jscan_t *scan, const jspec_t *spec)
+{
+    scan->spec = spec;
+    scan->found = 0;
+    scan->error = 0;
+    scan->state = LX_BETWEEN;
+    scan->role = ROLE_NONE;
+    scan->depth = 0;
+    scan->objects = 0;
+    scan->expect_key = 0;
+    scan->field = -1;
+    scan->arr_idx = 0;
+    scan->toklen = 0;
+    scan->overflow = 0;
+    scan->hex_left = 0;
+}
+
+/* Exact powers of ten representable as doubles */
+static const double pow10_exact[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+/* Decimal to double. Numbers with at most 15 significant digits and
+ * a small exponent are converted exactly with one multiplication or
+ * division (Clinger's fast path), anything else goes to strtod.
+ * Returns 0 on success, -1 if tok is not a number.
+ */
+static int parse_number (const char *tok, int len, double *out)
+{
+    int i = 0;
+    int neg = 0;
+    int digits = 0;
+    int exp10 = 0;
+    uint64_t mant = 0;
+    char *end;
+
+    if (i < len && tok[i] == '-') {
+        neg = 1;
+        i++;
+    }
+    for (; i < len && tok[i] >= '0' && tok[i] <= '9'; i++, digits++)
+        mant = mant * 10 + (tok[i] - '0');
+    if (i < len && tok[i] == '.') {
+        for (i++; i < len && tok[i] >= '0' && tok[i] <= '9'; i++, digits++, exp10--)
+            mant = mant * 10 + (tok[i] - '0');
+    }
+    if (i == len && digits > 0 && digits <= 15 && exp10 >= -22) {
+        double value = (double) mant;
+        value = (exp10 < 0) ? value / pow10_exact[-exp10] : value;
+        *out = neg ? -value : value;
+        return 0;
+    }
+
+    /* exponents, long mantissas and non numbers */
+    *out = strtod (tok, &end);
+    if (len == 0 || *end != '\0')
+        return -1;
+    return 0;
+}
+
+static inline jkind_t field_kind (jscan_t *scan)
+{
+    return scan->spec->fields[scan->field].kind;
+}
+
+static inline int in_object (jscan_t *scan)
+{
+    return (scan->objects >> (scan->depth - 1)) & 1;
+}
+
+static inline void tok_push (jscan_t *scan, char c)
+{
+    if (scan->toklen < JSCAN_TOKLEN - 1)
+        scan->tok[scan->toklen++] = c;
+    else
+        scan->overflow = 1;
+}
+
+/* Decide what a string or scalar starting here is for
+ */
+static int token_role (jscan_t *scan, int is_string)
+{
+    if (scan->depth == 1) {
+        if (is_string && scan->expect_key && in_object (scan))
+            return ROLE_KEY;
+        if (scan->field < 0)
+            return ROLE_NONE;
+        if (is_string && field_kind (scan) == JF_STRING)
+            return ROLE_VALUE;
+        if (!is_string && field_kind (scan) == JF_NUMBER)
+            return ROLE_VALUE;
+    } else if (scan->depth == 2 && scan->field >= 0 && field_kind (scan) == JF_PAIR && !in_object (scan)) {
+        if (is_string && scan->arr_idx == 0)
+            return ROLE_PAIR0;
+        if (!is_string && scan->arr_idx == 1)
+            return ROLE_PAIR1;
+    }
+    return ROLE_NONE;
+}
+
+/* A string or scalar is complete
+ */
+static void token_end (jscan_t *scan)
+{
+    int i = 0;
+    jvalue_t *value;
+
+    if (scan->role == ROLE_NONE)
+        return;
+
+    scan->tok[scan->toklen] = '\0';
+    if (scan->role == ROLE_KEY) {
+        scan->field = -1;
+        for (i = 0; !scan->overflow && i < scan->spec->nfields; i++) {
+            if (strcmp (scan->spec->fields[i].key, scan->tok) == 0) {
+                scan->field = i;
+                break;
+            }
+        }
+        return;
+    }
+
+    value = &scan->values[scan->field];
+    switch (scan->role) {
+    case ROLE_VALUE:
+        if (field_kind (scan) == JF_STRING) {
+            memcpy (value->string, scan->tok, scan->toklen + 1);
+            scan->found |= 1u << scan->field;
+            break;
+        }
+        /* fall through for numbers */
+    case ROLE_PAIR1:
+        if (!scan->overflow && parse_number (scan->tok, scan->toklen, &value->number) == 0)
+            scan->found |= 1u << scan->field;
+        break;
+    case ROLE_PAIR0:
+        memcpy (value->string, scan->tok, scan->toklen + 1);
+        break;
+    }
+}
+
+/* Structural characters and the start of tokens
+ */
+static void between (jscan_t *scan, char c)
+{
+    switch (c) {
+    case ' ': case '\t': case '\n': case '\r':
+        return;
+    case '{':
+    case '[':
+        if (scan->depth == 0 && c == '[') {
+            scan->error = 1;
+            return;
+        }
+        if (scan->depth == 1 && scan->field >= 0 && (c == '{' || field_kind (scan) != JF_PAIR))
+            scan->field = -1;
+        if (scan->depth >= 64) {
+            scan->error = 1;
+            return;
+        }
+        if (c == '{')
+            scan->objects |= (uint64_t) 1 << scan->depth;
+        else
+            scan->objects &= ~((uint64_t) 1 << scan->depth);
+        scan->depth++;
+        if (scan->depth == 1)
+            scan->expect_key = 1;
+        if (scan->depth == 2)
+            scan->arr_idx = 0;
+        return;
+    case '}':
+    case ']':
+        if (scan->depth == 0 || in_object (scan) != (c == '}')) {
+            scan->error = 1;
+            return;
+        }
+        scan->depth--;
+        if (scan->depth == 1)
+            scan->field = -1;
+        return;
+    case ',':
+        if (scan->depth == 1) {
+            scan->expect_key = 1;
+            scan->field = -1;
+        } else if (scan->depth == 2) {
+            scan->arr_idx++;
+        }
+        return;
+    case ':':
+        if (scan->depth == 1)
+            scan->expect_key = 0;
+        return;
+    case '"':
+        scan->role = token_role (scan, 1);
+        scan->state = LX_STRING;
+        scan->toklen = 0;
+        scan->overflow = 0;
+        return;
+    default:
+        if (scan->depth == 0) {
+            scan->error = 1;
+            return;
+        }
+        scan->role = token_role (scan, 0);
+        scan->state = LX_SCALAR;
+        scan->toklen = 0;
+        scan->overflow = 0;
+        tok_push (scan, c);
+        return;
+    }
+}
+
+/* jscan_feed()
+ * Feeds the next fragment of the document. Can be called with
+ * fragments of any size, including single bytes.
+ */
+int jscan_feed (jscan_t *scan, const char *data, size_t len)
+{
+    size_t i = 0;
+
+    for (i = 0; i < len && !scan->error; i++) {
+        char c = data[i];
+        switch (scan->state) {
+        case LX_BETWEEN:
+            between (scan, c);
+            break;
+        case LX_STRING: {
+            /* take the plain run up to the next quote or escape in bulk */
+            size_t run = i;
+            while (run < len && data[run] != '"' && data[run] != '\\')
+                run++;
+            if (scan->role != ROLE_NONE && run > i) {
+                size_t n = run - i;
+                if (scan->toklen + n > JSCAN_TOKLEN - 1) {
+                    n = JSCAN_TOKLEN - 1 - scan->toklen;
+                    scan->overflow = 1;
+                }
+                memcpy (scan->tok + scan->toklen, data + i, n);
+                scan->toklen += n;
+            }
+            i = run;
+            if (i == len)
+                break;
+            if (data[i] == '"') {
+                token_end (scan);
+                scan->state = LX_BETWEEN;
+            } else {
+                scan->state = LX_ESCAPE;
+            }
+            break;
+        }
+        case LX_ESCAPE:
+            switch (c) {
+            case 'n': tok_push (scan, '\n'); break;
+            case 't': tok_push (scan, '\t'); break;
+            case 'r': tok_push (scan, '\r'); break;
+            case 'b': tok_push (scan, '\b'); break;
+            case 'f': tok_push (scan, '\f'); break;
+            case 'u': tok_push (scan, '?'); break;
+            default: tok_push (scan, c); break;
+            }
+            /* the four hex digits of \uXXXX are skipped */
+            scan->hex_left = (c == 'u') ? 4 : 0;
+            scan->state = (c == 'u') ? LX_UNICODE : LX_STRING;
+            break;
+        case LX_UNICODE:
+            if (--scan->hex_left == 0)
+                scan->state = LX_STRING;
+            break;
+        case LX_SCALAR:
+            if (c == ',' || c == '}' || c == ']' || c == ':' || c == ' ' || c == '\t' || c == '\n' || c == '\r') {
+                token_end (scan);
+                scan->state = LX_BETWEEN;
+                between (scan, c);
+            } else {
+                tok_push (scan, c);
+            }
+            break;
+        }
+    }
+
+    return scan->error ? -1 : 0;
+}
+
+/* jscan_finish()
+ * Ends the document. Returns the mask of extracted fields
+ * or -1 if the document was malformed or truncated.
+ */
+int jscan_finish (jscan_t *scan)
+{
+    if (scan->error || scan->depth != 0 || scan->state != LX_BETWEEN)
+        return -1;
+    return scan->found;
+}
@@ -0,0 +1,60 @@
+#ifndef JSCAN_H
+#define JSCAN_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Streaming extractor for flat JSON objects.
+ * Pulls a handful of top level fields out of a byte stream that
+ * may arrive in arbitrary fragments, without building a DOM and
+ * without allocating.
+ */
+
+#define JSCAN_MAX_FIELDS 8
+#define JSCAN_TOKLEN 128
+
+typedef enum {
+    JF_NUMBER,                              /* "key": 1.5 */
+    JF_STRING,                              /* "key": "text" */
+    JF_PAIR                                 /* "key": ["text", 1.5] */
+} jkind_t;
+
+typedef struct jscan_field {
+    const char      *key;                   /* Top level key */
+    jkind_t         kind;                   /* Expected shape of the value */
+} jfield_t;
+
+typedef struct jscan_spec {
+    const jfield_t  *fields;                /* Fields to extract */
+    int             nfields;                /* At most JSCAN_MAX_FIELDS */
+} jspec_t;
+
+typedef struct jscan_value {
+    double          number;                 /* JF_NUMBER, second element of JF_PAIR */
+    char            string[JSCAN_TOKLEN];   /* JF_STRING, first element of JF_PAIR */
+} jvalue_t;
+
+typedef struct jscan {
+    const jspec_t   *spec;                  /* What to extract */
+    jvalue_t        values[JSCAN_MAX_FIELDS]; /* Extracted values by field index */
+    unsigned        found;                  /* Bit i set when field i was extracted */
+    int             error;                  /* Malformed input seen */
+    /* lexer state */
+    int             state;                  /* In between tokens, string or scalar */
+    int             role;                   /* What the current token is for */
+    int             depth;                  /* Nesting depth */
+    uint64_t        objects;                /* Bit d set when depth d+1 is an object */
+    int             expect_key;             /* Next string at depth 1 is a key */
+    int             field;                  /* Field of the current depth 1 value, -1 if none */
+    int             arr_idx;                /* Element index inside a depth 2 array */
+    int             toklen;                 /* Bytes in tok */
+    int             overflow;               /* Token did not fit in tok */
+    int             hex_left;               /* Hex digits left of a \u escape */
+    char            tok[JSCAN_TOKLEN];      /* Current token */
+} jscan_t;
+
+void jscan_init (jscan_t *scan, const jspec_t *spec);
+int jscan_feed (jscan_t *scan, const char *data, size_t len);
+int jscan_finish (jscan_t *scan);
+
+#endif
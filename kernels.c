@@ -0,0 +1,391 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "kernels.h"
+#include "moments.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define KERNELS_X86 1
+#endif
+
+/*******************************************************
+ *                                                     *
+ *                  Air Density                        *
+ *                                                     *
+ *******************************************************/
+
+/* rho = Pd / (Rd Tk) + Pv / (Rv Tk) with the saturated vapour
+ * pressure Psv = 611.2 * 2.718^(16.67 T / (T + 243.5)), as air_density()
+ * computes it. The power is taken as 2^(log2 (2.718) * x): the integer
+ * part of the exponent goes straight into the exponent bits, the
+ * fraction f in [-0.5, 0.5] through a degree 8 Taylor polynomial of
+ * e^(f ln 2), which is within 2e-10 relative of the exact power.
+ */
+#define AD_LOG2_BASE 1.4425454561053042     /* log2 (2.718) */
+#define AD_EXP_LIMIT 1000.0                 /* |exponent| is clamped to this */
+#define AD_ROUND 6755399441055744.0         /* 1.5 * 2^52, rounds to integer when added */
+#define AD_RD 287.0531
+#define AD_RV 461.4964
+#define AD_C1 0.6931471805599453            /* ln2^k / k! */
+#define AD_C2 0.2402265069591007
+#define AD_C3 0.055504108664821576
+#define AD_C4 0.009618129107628477
+#define AD_C5 0.0013333558146428441
+#define AD_C6 0.00015403530393381606
+#define AD_C7 1.5252733804059838e-05
+#define AD_C8 1.3215486790144305e-06
+
+/* 2^x for |x| <= AD_EXP_LIMIT */
+static inline double ad_exp2 (double x)
+{
+    double r = x + AD_ROUND;
+    double n = r - AD_ROUND;
+    double f = x - n;
+    double p = AD_C8;
+    p = p * f + AD_C7;
+    p = p * f + AD_C6;
+    p = p * f + AD_C5;
+    p = p * f + AD_C4;
+    p = p * f + AD_C3;
+    p = p * f + AD_C2;
+    p = p * f + AD_C1;
+    p = p * f + 1.0;
+
+    uint64_t bits, nbits;
+    memcpy (&bits, &p, sizeof (bits));
+    memcpy (&nbits, &r, sizeof (nbits));
+    bits += nbits << 52;
+    memcpy (&p, &bits, sizeof (p));
+    return p;
+}
+
+static inline double ad_rho (double temp, double humd, double pres)
+{
+    double x = AD_LOG2_BASE * 16.67 * temp / (temp + 243.5);
+    x = (x > AD_EXP_LIMIT) ? AD_EXP_LIMIT : (x < -AD_EXP_LIMIT) ? -AD_EXP_LIMIT : x;
+    double Pv = humd * 0.01 * 611.2 * ad_exp2 (x);
+    double Pd = pres * 100 - Pv;
+    return (Pd * (1 / AD_RD) + Pv * (1 / AD_RV)) / (temp + 273.15);
+}
+
+/*******************************************************
+ *                                                     *
+ *                 Scalar Kernels                      *
+ *                                                     *
+ *******************************************************/
+
+static void air_density_scalar (const double *temp, const double *humd, const double *pres, double *rho, int n)
+{
+    int i = 0;
+    for (i = 0; i < n; i++)
+        rho[i] = ad_rho (temp[i], humd[i], pres[i]);
+}
+
+static double sum_scalar (const double *x, int n)
+{
+    int i = 0;
+    double s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+
+    for (; i + 4 <= n; i += 4) {
+        s0 += x[i];
+        s1 += x[i + 1];
+        s2 += x[i + 2];
+        s3 += x[i + 3];
+    }
+    for (; i < n; i++)
+        s0 += x[i];
+    return (s0 + s1) + (s2 + s3);
+}
+
+/* Single pass mean and population variance (Welford)
+ */
+static void mean_var_scalar (const double *x, int n, double *mean, double *var)
+{
+    int i = 0;
+    double m = 0, m2 = 0;
+
+    for (i = 0; i < n; i++) {
+        double delta = x[i] - m;
+        m += delta / (i + 1);
+        m2 += delta * (x[i] - m);
+    }
+    *mean = m;
+    *var = (n > 0) ? m2 / n : 0;
+}
+
+/* Grouped sums. Four banks of accumulators break the store to
+ * load dependency between neighbours of the same group. This beats
+ * masked AVX2 accumulation (one compare per group per vector) for
+ * the 11 machine types, so all kernel sets share it.
+ */
+static void group_sum_scalar (const double *x, const int32_t *group, int n, double *sums, int ngroups)
+{
+    int i = 0, g = 0;
+    double bank[4][ngroups];
+
+    memset (bank, 0, sizeof (bank));
+    for (; i + 4 <= n; i += 4) {
+        bank[0][group[i]] += x[i];
+        bank[1][group[i + 1]] += x[i + 1];
+        bank[2][group[i + 2]] += x[i + 2];
+        bank[3][group[i + 3]] += x[i + 3];
+    }
+    for (; i < n; i++)
+        bank[0][group[i]] += x[i];
+    for (g = 0; g < ngroups; g++)
+        sums[g] = (bank[0][g] + bank[1][g]) + (bank[2][g] + bank[3][g]);
+}
+
+#ifdef KERNELS_X86
+
+/*******************************************************
+ *                                                     *
+ *                  SSE2 Kernels                       *
+ *                                                     *
+ *******************************************************/
+
+__attribute__((target("sse2")))
+static double sum_sse2 (const double *x, int n)
+{
+    int i = 0;
+    __m128d a0 = _mm_setzero_pd (), a1 = _mm_setzero_pd ();
+    double out[2];
+
+    for (; i + 4 <= n; i += 4) {
+        a0 = _mm_add_pd (a0, _mm_loadu_pd (x + i));
+        a1 = _mm_add_pd (a1, _mm_loadu_pd (x + i + 2));
+    }
+    _mm_storeu_pd (out, _mm_add_pd (a0, a1));
+    double s = out[0] + out[1];
+    for (; i < n; i++)
+        s += x[i];
+    return s;
+}
+
+/* Welford on 2 x 2 independent lanes sharing the count,
+ * merged at the end
+ */
+__attribute__((target("sse2")))
+static void mean_var_sse2 (const double *x, int n, double *mean, double *var)
+{
+    int i = 0, l = 0;
+    double k = 0;
+    __m128d m0 = _mm_setzero_pd (), m1 = _mm_setzero_pd ();
+    __m128d q0 = _mm_setzero_pd (), q1 = _mm_setzero_pd ();
+    double lm[4], lq[4];
+
+    for (; i + 4 <= n; i += 4) {
+        k += 1;
+        __m128d inv = _mm_set1_pd (1.0 / k);
+        __m128d x0 = _mm_loadu_pd (x + i), x1 = _mm_loadu_pd (x + i + 2);
+        __m128d d0 = _mm_sub_pd (x0, m0), d1 = _mm_sub_pd (x1, m1);
+        m0 = _mm_add_pd (m0, _mm_mul_pd (d0, inv));
+        m1 = _mm_add_pd (m1, _mm_mul_pd (d1, inv));
+        q0 = _mm_add_pd (q0, _mm_mul_pd (d0, _mm_sub_pd (x0, m0)));
+        q1 = _mm_add_pd (q1, _mm_mul_pd (d1, _mm_sub_pd (x1, m1)));
+    }
+    _mm_storeu_pd (lm, m0);
+    _mm_storeu_pd (lm + 2, m1);
+    _mm_storeu_pd (lq, q0);
+    _mm_storeu_pd (lq + 2, q1);
+
+    moments_t acc = {k, lm[0], lq[0]};
+    for (l = 1; l < 4; l++) {
+        moments_t lane = {k, lm[l], lq[l]};
+        moments_merge (&acc, &lane);
+    }
+    for (; i < n; i++)
+        moments_add (&acc, x[i]);
+    *mean = acc.mean;
+    *var = moments_var (&acc);
+}
+
+/* air_density_scalar() on two samples at a time */
+__attribute__((target("sse2")))
+static void air_density_sse2 (const double *temp, const double *humd, const double *pres, double *rho, int n)
+{
+    int i = 0;
+    const __m128d round = _mm_set1_pd (AD_ROUND);
+
+    for (; i + 2 <= n; i += 2) {
+        __m128d t = _mm_loadu_pd (temp + i);
+        __m128d x = _mm_div_pd (_mm_mul_pd (_mm_set1_pd (AD_LOG2_BASE * 16.67), t), _mm_add_pd (t, _mm_set1_pd (243.5)));
+        x = _mm_min_pd (_mm_max_pd (x, _mm_set1_pd (-AD_EXP_LIMIT)), _mm_set1_pd (AD_EXP_LIMIT));
+        __m128d r = _mm_add_pd (x, round);
+        __m128d f = _mm_sub_pd (x, _mm_sub_pd (r, round));
+        __m128d p = _mm_set1_pd (AD_C8);
+        p = _mm_add_pd (_mm_mul_pd (p, f), _mm_set1_pd (AD_C7));
+        p = _mm_add_pd (_mm_mul_pd (p, f), _mm_set1_pd (AD_C6));
+        p = _mm_add_pd (_mm_mul_pd (p, f), _mm_set1_pd (AD_C5));
+        p = _mm_add_pd (_mm_mul_pd (p, f), _mm_set1_pd (AD_C4));
+        p = _mm_add_pd (_mm_mul_pd (p, f), _mm_set1_pd (AD_C3));
+        p = _mm_add_pd (_mm_mul_pd (p, f), _mm_set1_pd (AD_C2));
+        p = _mm_add_pd (_mm_mul_pd (p, f), _mm_set1_pd (AD_C1));
+        p = _mm_add_pd (_mm_mul_pd (p, f), _mm_set1_pd (1.0));
+        p = _mm_castsi128_pd (_mm_add_epi64 (_mm_castpd_si128 (p), _mm_slli_epi64 (_mm_castpd_si128 (r), 52)));
+
+        __m128d pv = _mm_mul_pd (_mm_mul_pd (_mm_loadu_pd (humd + i), _mm_set1_pd (0.01 * 611.2)), p);
+        __m128d pd = _mm_sub_pd (_mm_mul_pd (_mm_loadu_pd (pres + i), _mm_set1_pd (100)), pv);
+        __m128d num = _mm_add_pd (_mm_mul_pd (pd, _mm_set1_pd (1 / AD_RD)), _mm_mul_pd (pv, _mm_set1_pd (1 / AD_RV)));
+        _mm_storeu_pd (rho + i, _mm_div_pd (num, _mm_add_pd (t, _mm_set1_pd (273.15))));
+    }
+    for (; i < n; i++)
+        rho[i] = ad_rho (temp[i], humd[i], pres[i]);
+}
+
+/*******************************************************
+ *                                                     *
+ *                  AVX2 Kernels                       *
+ *                                                     *
+ *******************************************************/
+
+__attribute__((target("avx2")))
+static double sum_avx2 (const double *x, int n)
+{
+    int i = 0;
+    __m256d a0 = _mm256_setzero_pd (), a1 = _mm256_setzero_pd ();
+    __m256d a2 = _mm256_setzero_pd (), a3 = _mm256_setzero_pd ();
+    double out[4];
+
+    for (; i + 16 <= n; i += 16) {
+        a0 = _mm256_add_pd (a0, _mm256_loadu_pd (x + i));
+        a1 = _mm256_add_pd (a1, _mm256_loadu_pd (x + i + 4));
+        a2 = _mm256_add_pd (a2, _mm256_loadu_pd (x + i + 8));
+        a3 = _mm256_add_pd (a3, _mm256_loadu_pd (x + i + 12));
+    }
+    for (; i + 4 <= n; i += 4)
+        a0 = _mm256_add_pd (a0, _mm256_loadu_pd (x + i));
+    _mm256_storeu_pd (out, _mm256_add_pd (_mm256_add_pd (a0, a1), _mm256_add_pd (a2, a3)));
+    double s = (out[0] + out[1]) + (out[2] + out[3]);
+    for (; i < n; i++)
+        s += x[i];
+    return s;
+}
+
+/* Welford on 2 x 4 independent lanes sharing the count,
+ * merged at the end
+ */
+__attribute__((target("avx2")))
+static void mean_var_avx2 (const double *x, int n, double *mean, double *var)
+{
+    int i = 0, l = 0;
+    double k = 0;
+    __m256d m0 = _mm256_setzero_pd (), m1 = _mm256_setzero_pd ();
+    __m256d q0 = _mm256_setzero_pd (), q1 = _mm256_setzero_pd ();
+    double lm[8], lq[8];
+
+    for (; i + 8 <= n; i += 8) {
+        k += 1;
+        __m256d inv = _mm256_set1_pd (1.0 / k);
+        __m256d x0 = _mm256_loadu_pd (x + i), x1 = _mm256_loadu_pd (x + i + 4);
+        __m256d d0 = _mm256_sub_pd (x0, m0), d1 = _mm256_sub_pd (x1, m1);
+        m0 = _mm256_add_pd (m0, _mm256_mul_pd (d0, inv));
+        m1 = _mm256_add_pd (m1, _mm256_mul_pd (d1, inv));
+        q0 = _mm256_add_pd (q0, _mm256_mul_pd (d0, _mm256_sub_pd (x0, m0)));
+        q1 = _mm256_add_pd (q1, _mm256_mul_pd (d1, _mm256_sub_pd (x1, m1)));
+    }
+    _mm256_storeu_pd (lm, m0);
+    _mm256_storeu_pd (lm + 4, m1);
+    _mm256_storeu_pd (lq, q0);
+    _mm256_storeu_pd (lq + 4, q1);
+
+    moments_t acc = {k, lm[0], lq[0]};
+    for (l = 1; l < 8; l++) {
+        moments_t lane = {k, lm[l], lq[l]};
+        moments_merge (&acc, &lane);
+    }
+    for (; i < n; i++)
+        moments_add (&acc, x[i]);
+    *mean = acc.mean;
+    *var = moments_var (&acc);
+}
+
+/* air_density_scalar() on four samples at a time */
+__attribute__((target("avx2")))
+static void air_density_avx2 (const double *temp, const double *humd, const double *pres, double *rho, int n)
+{
+    int i = 0;
+    const __m256d round = _mm256_set1_pd (AD_ROUND);
+
+    for (; i + 4 <= n; i += 4) {
+        __m256d t = _mm256_loadu_pd (temp + i);
+        __m256d x = _mm256_div_pd (_mm256_mul_pd (_mm256_set1_pd (AD_LOG2_BASE * 16.67), t),
+                                   _mm256_add_pd (t, _mm256_set1_pd (243.5)));
+        x = _mm256_min_pd (_mm256_max_pd (x, _mm256_set1_pd (-AD_EXP_LIMIT)), _mm256_set1_pd (AD_EXP_LIMIT));
+        __m256d r = _mm256_add_pd (x, round);
+        __m256d f = _mm256_sub_pd (x, _mm256_sub_pd (r, round));
+        __m256d p = _mm256_set1_pd (AD_C8);
+        p = _mm256_add_pd (_mm256_mul_pd (p, f), _mm256_set1_pd (AD_C7));
+        p = _mm256_add_pd (_mm256_mul_pd (p, f), _mm256_set1_pd (AD_C6));
+        p = _mm256_add_pd (_mm256_mul_pd (p, f), _mm256_set1_pd (AD_C5));
+        p = _mm256_add_pd (_mm256_mul_pd (p, f), _mm256_set1_pd (AD_C4));
+        p = _mm256_add_pd (_mm256_mul_pd (p, f), _mm256_set1_pd (AD_C3));
+        p = _mm256_add_pd (_mm256_mul_pd (p, f), _mm256_set1_pd (AD_C2));
+        p = _mm256_add_pd (_mm256_mul_pd (p, f), _mm256_set1_pd (AD_C1));
+        p = _mm256_add_pd (_mm256_mul_pd (p, f), _mm256_set1_pd (1.0));
+        p = _mm256_castsi256_pd (_mm256_add_epi64 (_mm256_castpd_si256 (p), _mm256_slli_epi64 (_mm256_castpd_si256 (r), 52)));
+
+        __m256d pv = _mm256_mul_pd (_mm256_mul_pd (_mm256_loadu_pd (humd + i), _mm256_set1_pd (0.01 * 611.2)), p);
+        __m256d pd = _mm256_sub_pd (_mm256_mul_pd (_mm256_loadu_pd (pres + i), _mm256_set1_pd (100)), pv);
+        __m256d num = _mm256_add_pd (_mm256_mul_pd (pd, _mm256_set1_pd (1 / AD_RD)), _mm256_mul_pd (pv, _mm256_set1_pd (1 / AD_RV)));
+        _mm256_storeu_pd (rho + i, _mm256_div_pd (num, _mm256_add_pd (t, _mm256_set1_pd (273.15))));
+    }
+    for (; i < n; i++)
+        rho[i] = ad_rho (temp[i], humd[i], pres[i]);
+}
+
+#endif /* KERNELS_X86 */
+
+/*******************************************************
+ *                                                     *
+ *                 Runtime Dispatch                    *
+ *                                                     *
+ *******************************************************/
+
+static const kernels_t kernels_scalar = {"scalar", sum_scalar, mean_var_scalar, group_sum_scalar, air_density_scalar};
+#ifdef KERNELS_X86
+static const kernels_t kernels_sse2 = {"sse2", sum_sse2, mean_var_sse2, group_sum_scalar, air_density_sse2};
+static const kernels_t kernels_avx2 = {"avx2", sum_avx2, mean_var_avx2, group_sum_scalar, air_density_avx2};
+#endif
+
+kernels_t kern = {"scalar", sum_scalar, mean_var_scalar, group_sum_scalar, air_density_scalar};
+
+/* kernels_init()
+ * Selects the kernels: the named set if given and supported,
+ * otherwise the best set the CPU supports. Returns -1 for a set
+ * that is unknown or the CPU does not support.
+ */
+int kernels_init (const char *name)
+{
+    kern = kernels_scalar;
+#ifdef KERNELS_X86
+    __builtin_cpu_init ();
+    int sse2 = __builtin_cpu_supports ("sse2");
+    int avx2 = __builtin_cpu_supports ("avx2");
+
+    if (name && strcmp (name, "scalar") == 0)
+        return 0;
+    if (name && strcmp (name, "sse2") == 0) {
+        if (!sse2)
+            return -1;
+        kern = kernels_sse2;
+        return 0;
+    }
+    if (name && strcmp (name, "avx2") == 0 && !avx2)
+        return -1;
+    if (name && strcmp (name, "avx2") != 0)
+        return -1;
+
+    if (avx2)
+        kern = kernels_avx2;
+    else if (sse2)
+        kern = kernels_sse2;
+#else
+    if (name && strcmp (name, "scalar") != 0)
+        return -1;
+#endif
+    return 0;
+}
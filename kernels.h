@@ -0,0 +1,24 @@
+#ifndef KERNELS_H
+#define KERNELS_H
+
+#include <stdint.h>
+
+/* Aggregation kernels over the fleet columns and sample windows,
+ * and the air density of every sample of a sensor series.
+ * Every kernel has a scalar, an SSE2 and an AVX2 version; the best
+ * one supported by the CPU is selected at runtime by kernels_init().
+ */
+
+typedef struct kernels {
+    const char  *name;                                  /* "scalar", "sse2" or "avx2" */
+    double      (*sum) (const double *x, int n);        /* Sum of x[0..n) */
+    void        (*mean_var) (const double *x, int n, double *mean, double *var);
+    void        (*group_sum) (const double *x, const int32_t *group, int n, double *sums, int ngroups);
+    void        (*air_density) (const double *temp, const double *humd, const double *pres, double *rho, int n);
+} kernels_t;
+
+extern kernels_t kern;
+
+int kernels_init (const char *name);
+
+#endif
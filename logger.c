@@ -0,0 +1,228 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "logger.h"
+#include "queue.h"
+
+typedef struct log_record {
+    int             level;              /* llevel_t */
+    int             len;                /* Bytes of text */
+    char            text[LOGGER_RECORD - 2 * sizeof (int)];
+} lrec_t;
+
+/* The logger, one per process */
+static struct {
+    FILE            *out;               /* Where records go */
+    spsc_t          *rings[LOGGER_MAX_THREADS]; /* Ring of every thread that logged */
+    int             nrings;             /* Rings registered, atomic */
+    pthread_t       thread;             /* Writer thread */
+    int             running;            /* Records go through the rings */
+    int             stop;               /* Writer exits once the rings are empty */
+    int64_t         produced;           /* Records queued, atomic */
+    int64_t         written;            /* Records written and flushed, atomic */
+    int64_t         dropped;            /* Records lost to a full ring, atomic */
+    int64_t         limited;            /* Records cut by rate limits, atomic */
+    int64_t         reported;           /* Drops already reported, writer only */
+} lg;
+
+int logger_level = LOG_INFO;
+
+static __thread spsc_t *thread_ring;
+
+static const char *level_names[] = {"error", "warn", "info", "debug"};
+
+/* logger_parse_level()
+ * Level of a name such as "debug", -1 if unknown
+ */
+int logger_parse_level (const char *name)
+{
+    int i = 0;
+    for (i = 0; i <= LOG_DEBUG; i++) {
+        if (strcmp (name, level_names[i]) == 0)
+            return i;
+    }
+    return -1;
+}
+
+/*******************************************************
+ *                                                     *
+ *                     Producers                       *
+ *                                                     *
+ *******************************************************/
+
+/* Ring of the calling thread, created on its first record */
+static spsc_t *logger_ring ()
+{
+    if (thread_ring == NULL) {
+        int n = __atomic_load_n (&lg.nrings, __ATOMIC_RELAXED);
+        do {
+            if (n == LOGGER_MAX_THREADS)
+                return NULL;
+        } while (!__atomic_compare_exchange_n (&lg.nrings, &n, n + 1, 0, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED));
+        spsc_t *ring = (spsc_t *) malloc (sizeof (spsc_t));
+        if (ring == NULL || spsc_init (ring, LOGGER_RING, sizeof (lrec_t)) < 0)
+            return NULL;
+        __atomic_store_n (&lg.rings[n], ring, __ATOMIC_RELEASE);
+        thread_ring = ring;
+    }
+    return thread_ring;
+}
+
+/* Whether a call site still has room in this second */
+static int logger_allow (lrate_t *rate, int per_sec)
+{
+    struct timespec ts;
+    clock_gettime (CLOCK_MONOTONIC_COARSE, &ts);
+
+    if (ts.tv_sec != __atomic_load_n (&rate->second, __ATOMIC_RELAXED)) {
+        __atomic_store_n (&rate->second, ts.tv_sec, __ATOMIC_RELAXED);
+        __atomic_store_n (&rate->count, 0, __ATOMIC_RELAXED);
+    }
+    if (__atomic_fetch_add (&rate->count, 1, __ATOMIC_RELAXED) < per_sec)
+        return 1;
+    __atomic_fetch_add (&lg.limited, 1, __ATOMIC_RELAXED);
+    return 0;
+}
+
+/* logger_write()
+ * Formats a record into the ring of the calling thread. Use it
+ * through LOG() and LOG_RATE().
+ */
+void logger_write (int level, lrate_t *rate, int per_sec, const char *fmt, ...)
+{
+    va_list args;
+
+    if (rate && !logger_allow (rate, per_sec))
+        return;
+
+    va_start (args, fmt);
+    if (!__atomic_load_n (&lg.running, __ATOMIC_ACQUIRE)) {
+        vprintf (fmt, args);
+        va_end (args);
+        return;
+    }
+
+    spsc_t *ring = logger_ring ();
+    lrec_t *rec = ring ? (lrec_t *) spsc_claim (ring) : NULL;
+    if (rec == NULL) {
+        __atomic_fetch_add (&lg.dropped, 1, __ATOMIC_RELAXED);
+        va_end (args);
+        return;
+    }
+    int len = vsnprintf (rec->text, sizeof (rec->text), fmt, args);
+    va_end (args);
+    rec->level = level;
+    rec->len = (len < (int) sizeof (rec->text)) ? len : (int) sizeof (rec->text) - 1;
+    __atomic_fetch_add (&lg.produced, 1, __ATOMIC_RELAXED);
+    spsc_publish (ring);
+}
+
+/*******************************************************
+ *                                                     *
+ *                      Writer                         *
+ *                                                     *
+ *******************************************************/
+
+/* Writes out what every ring holds, returns the number of records */
+static int64_t logger_drain ()
+{
+    int i = 0;
+    int64_t n = 0;
+    int nrings = __atomic_load_n (&lg.nrings, __ATOMIC_ACQUIRE);
+
+    for (i = 0; i < nrings; i++) {
+        spsc_t *ring = __atomic_load_n (&lg.rings[i], __ATOMIC_ACQUIRE);
+        lrec_t *rec;
+        while (ring && (rec = (lrec_t *) spsc_peek (ring)) != NULL) {
+            fwrite (rec->text, 1, rec->len, lg.out);
+            spsc_release (ring);
+            n++;
+        }
+    }
+
+    int64_t dropped = __atomic_load_n (&lg.dropped, __ATOMIC_RELAXED);
+    if (dropped > lg.reported) {
+        fprintf (lg.out, "WARNING: logger dropped %lld records\n", (long long) (dropped - lg.reported));
+        lg.reported = dropped;
+    }
+    if (n > 0) {
+        fflush (lg.out);
+        __atomic_fetch_add (&lg.written, n, __ATOMIC_RELEASE);
+    }
+    return n;
+}
+
+static void *logger_thread (void *arg)
+{
+    qbackoff_t backoff = {0};
+
+    for (;;) {
+        if (logger_drain () > 0) {
+            qbackoff_reset (&backoff);
+            continue;
+        }
+        if (__atomic_load_n (&lg.stop, __ATOMIC_ACQUIRE))
+            break;
+        qbackoff_wait (&backoff);
+    }
+    return NULL;
+}
+
+/* logger_init()
+ * Starts the writer thread on out
+ */
+int logger_init (FILE *out)
+{
+    lg.out = out;
+    if (pthread_create (&lg.thread, NULL, logger_thread, NULL) != 0) {
+        printf ("ERROR: Could not start the logger\n");
+        return -1;
+    }
+    __atomic_store_n (&lg.running, 1, __ATOMIC_RELEASE);
+    return 0;
+}
+
+/* logger_flush()
+ * Waits until the records queued so far are written, e.g. before
+ * printing directly to the same stream
+ */
+void logger_flush (void)
+{
+    qbackoff_t backoff = {0};
+    int64_t target = __atomic_load_n (&lg.produced, __ATOMIC_ACQUIRE);
+
+    if (!__atomic_load_n (&lg.running, __ATOMIC_ACQUIRE))
+        return;
+    while (__atomic_load_n (&lg.written, __ATOMIC_ACQUIRE) < target)
+        qbackoff_wait (&backoff);
+}
+
+/* logger_close()
+ * Writes out the remaining records and stops the writer; later
+ * records are written directly
+ */
+void logger_close (void)
+{
+    int i = 0;
+
+    if (!__atomic_load_n (&lg.running, __ATOMIC_ACQUIRE))
+        return;
+    logger_flush ();
+    __atomic_store_n (&lg.running, 0, __ATOMIC_RELEASE);
+    __atomic_store_n (&lg.stop, 1, __ATOMIC_RELEASE);
+    pthread_join (lg.thread, NULL);
+    logger_drain ();
+    printf ("Logger: %lld records, %lld dropped, %lld rate limited\n", (long long) lg.produced,
+            (long long) lg.dropped, (long long) lg.limited);
+    for (i = 0; i < lg.nrings; i++) {
+        if (lg.rings[i]) {
+            spsc_free (lg.rings[i]);
+            free (lg.rings[i]);
+            lg.rings[i] = NULL;
+        }
+    }
+}
@@ -0,0 +1,53 @@
+#ifndef LOGGER_H
+#define LOGGER_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+/* Asynchronous logger.
+ * LOG() formats the message into a record of the calling thread's own
+ * SPSC ring and returns; a background thread drains the rings of all
+ * threads and writes the records out. A full ring drops the record
+ * and counts it, so logging never blocks on a slow terminal or pipe.
+ * LOG_RATE() additionally limits a call site to a number of records
+ * per second. Before logger_init() and after logger_close() records
+ * are written directly.
+ */
+
+typedef enum {
+    LOG_ERROR,                          /* Something failed */
+    LOG_WARN,                           /* Something is off but handled */
+    LOG_INFO,                           /* Results and progress */
+    LOG_DEBUG                           /* Per tick chatter */
+} llevel_t;
+
+#define LOGGER_RECORD 512               /* Bytes of a record, the text is truncated to fit */
+#define LOGGER_RING 1024                /* Records per thread */
+#define LOGGER_MAX_THREADS 64           /* Threads that may log */
+
+/* Rate limit state of a call site */
+typedef struct log_rate {
+    int64_t         second;             /* Second of the current window */
+    int             count;              /* Records in the window */
+} lrate_t;
+
+extern int logger_level;                /* Records above this level are skipped */
+
+int logger_init (FILE *out);
+int logger_parse_level (const char *name);
+void logger_write (int level, lrate_t *rate, int per_sec, const char *fmt, ...) __attribute__ ((format (printf, 4, 5)));
+void logger_flush (void);
+void logger_close (void);
+
+#define LOG(level, ...) do { \
+        if ((level) <= logger_level) \
+            logger_write ((level), NULL, 0, __VA_ARGS__); \
+    } while (0)
+
+#define LOG_RATE(level, per_sec, ...) do { \
+        static lrate_t log_rate_; \
+        if ((level) <= logger_level) \
+            logger_write ((level), &log_rate_, (per_sec), __VA_ARGS__); \
+    } while (0)
+
+#endif
@@ -1,3 +1,4 @@
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <stddef.h>
@@ -7,20 +8,71 @@
 
 #include "json.h"
 #include "machinepark.h"
+#include "poller.h"
+#include "jscan.h"
+#include "mcache.h"
+#include "rwin.h"
+#include "fleet.h"
+#include "kernels.h"
+#include "hring.h"
+#include "tstats.h"
+#include "registry.h"
+#include "tstore.h"
+#include "ghist.h"
+#include "query.h"
+#include "pipeline.h"
+#include "ticker.h"
+#include "psched.h"
+#include "alerts.h"
+#include "logger.h"
+#include "metrics.h"
+#include "analytics.h"
+#include "sitetime.h"
+#include "twheel.h"
 
 #include <curl/curl.h>
 #include <math.h>
 
 /* Global variables */
-char *machine_list_url = "http://machinepark.actyx.io/api/v1/machines";
-char *env_sensor_url = "http://machinepark.actyx.io/api/v1/env-sensor";
-char *machine_detail_base_url = "http://machinepark.actyx.io/api/v1/machine/";
+char *api_base_url = "http://machinepark.actyx.io/api/v1";
+char *machine_list_url; // derived from api_base_url
+char *env_sensor_url;
+char *machine_detail_base_url;
 double frequency = 5; // 5 seconds
+long ticks_to_run = 0; // stop after this many ticks, 0 = no limit
+tstats_t tick_stats; // cost of every tick
 double seconds_history = 300; // 5 minutes
 double window_size, pwindow_size;
-
-// must be as many - 1 as components_t
-int num_machines[] = {NUM_TOTAL, NUM_DMG_DMC, NUM_DMG_DMU, NUM_DMG_NTX, NUM_DMG_NZX, NUM_KASOTEC_A7, NUM_KASOTEC_A13, NUM_PERNDORFER_WSS, NUM_TRUMPF_3000, NUM_TRUMPF_7000, NUM_DMG_LASTERTEC};
+int max_inflight = 64; // concurrent requests per tick
+int http2_cleartext = 0; // speak HTTP/2 without TLS (prior knowledge)
+poller_t poller; // pooled handles and connections to the API
+parse_mode_t parse_mode = PARSE_STREAM; // how responses are parsed
+char *cache_path = "machinepark.cache"; // uuid -> name/type cache
+int cache_dirty = 0; // cache needs to be rewritten, set by the update workers
+char *kernels_name = NULL; // aggregation kernels, NULL = best supported
+
+char *types_path = NULL; // type registry file, NULL = built in types
+treg_t registry; // machine types and their name patterns
+int *num_machines; // machines per type, [CMP_ALL] = the whole fleet
+char *store_dir = NULL; // raw sample store, NULL = not kept
+tstore_t store; // segments of raw samples
+double retention_hours = 0; // compressed history kept, 0 = none
+char *hist_path = "machinepark.hist"; // compressed history across runs
+ghist_t history; // compressed current and sensor series
+char *query_path = NULL; // query server socket, NULL = no server
+qserver_t query; // serves snapshots of the state
+int parse_workers = 0; // pipeline parse threads, 0 = single threaded
+int update_workers = 1; // pipeline update shards
+pipe_t pipeline; // staged processing of the responses
+int64_t tick_ns; // epoch nanoseconds of the running tick, the stamp of its samples
+ticker_t ticker; // fires the ticks
+int poll_max = 1; // longest adaptive poll interval in ticks, 1 = poll every machine every tick
+psched_t psched; // due machines of every tick
+char *alert_sinks[ALERT_MAX_SINKS]; // where alerts go, stdout if none
+int nalert_sinks = 0;
+double alert_cooldown = 60; // seconds before a machine is reported again
+alerts_t alerts; // alert state and delivery
+char *metrics_path = NULL; // Prometheus text file, NULL = not written
 
 /*******************************************************
  *                                                     *
@@ -28,43 +80,12 @@ int num_machines[] = {NUM_TOTAL, NUM_DMG_DMC, NUM_DMG_DMU, NUM_DMG_NTX, NUM_DMG_
  *                                                     *
  *******************************************************/
 
-/* Write callback function for curl 
- */
-size_t curl_write (void *contents, size_t size, size_t nmemb, void *userp)
-{
-    size_t realsize = size * nmemb;
-    struct MemoryStruct *mem = (struct MemoryStruct *)userp;
-
-    mem->data = realloc(mem->data, mem->size + realsize + 1);
-    if(mem->data == NULL) {
-        /* out of memory! */
-        printf("not enough memory (realloc returned NULL)\n");
-        return 0;
-    }
-
-    memcpy(&(mem->data[mem->size]), contents, realsize);
-    mem->size += realsize;
-    mem->data[mem->size] = 0;
-
-    return realsize;
-}
-
 /* Function to make http request and get data
+ * over the pooled connections of the poller
  */
-int fetch_curl (char *url, chunk_t *chunk)
+int fetch_curl (char *url, chunk_t *chunk, int hist)
 {
-    CURLcode res;
-    CURL *curl = curl_easy_init();
-    curl_easy_setopt(curl, CURLOPT_URL, url);
-    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, curl_write);
-    curl_easy_setopt(curl, CURLOPT_WRITEDATA, chunk);
-    res = curl_easy_perform(curl);
-    curl_easy_cleanup(curl);
-    if(res != CURLE_OK) {
-        printf ("curl_easy_perform() failed: %s\n", curl_easy_strerror(res));
-        return -1;
-    } 
-    return 0;
+    return poller_fetch (&poller, url, chunk, hist);
 }
 
 /*******************************************************
@@ -73,536 +94,242 @@ int fetch_curl (char *url, chunk_t *chunk)
  *                                                     *
  *******************************************************/
 
-int send_alert (machine_t *machine, double avg)
-{
-    printf ("ALERT for machine %s, with avg = %f\n", machine->uuid, avg);
-
-    return 0;
-}
-
-int llist_entry_create (llist_t **entry) 
-{
-    *entry = (llist_t *) malloc (sizeof (llist_t));
-    (*entry)->next = NULL;
-    (*entry)->prev = NULL;
-    (*entry)->data = (phist_t *)malloc (sizeof (phist_t));
-    (*entry)->data->avg_current = (double *) malloc (sizeof (double) * CMP_END);
-    (*entry)->data->rho_cur_ratio = (double *) malloc (sizeof (double) * CMP_END);
-
-    return 0;
-}
-
-int llist_entry_destroy (llist_t **entry)
-{
-    if (*entry) {
-        if ((*entry)->data) {
-            if ((*entry)->data->avg_current)
-                free ((*entry)->data->avg_current);
-            if ((*entry)->data->rho_cur_ratio)
-                free ((*entry)->data->rho_cur_ratio);    
-        }        
-        free (*entry);
-        *entry = NULL;
-    }
-    return 0;
-}
-
-/* unused in this version 
+/* Formats one value per machine type as "<type id>:<value>, ..."
+ * into buf, truncating at size
  */
-int phist_entry_create (phist_t **entry)
+static char *format_per_type (char *buf, size_t size, const double *values)
 {
-    *entry = (phist_t *)malloc (sizeof (phist_t));
-    (*entry)->avg_current = (double *) malloc (sizeof (double) * CMP_END);
-    (*entry)->rho_cur_ratio = (double *) malloc (sizeof (double) * CMP_END);
-    return 0;
-}
-
-/* unused in this version
- */
-int phist_entry_destroy (phist_t **entry)
-{
-    if (*entry) {
-        if ((*entry)->avg_current)
-            free ((*entry)->avg_current);
-        if ((*entry)->rho_cur_ratio)
-            free ((*entry)->rho_cur_ratio);
-        free (*entry);
-        *entry = NULL;
+    int i = 0;
+    size_t len = 0;
+    buf[0] = '\0';
+    for (i = 0; i < registry.ntypes && len < size; i++) {
+        len += snprintf (buf + len, size - len, "%s%d:%f", i ? ", " : "", i, values[i]);
     }
-    return 0;
+    return buf;
 }
 
-void print_phist_data (llist_t *head)
+/* Prints the history, newest record first
+ */
+void print_phist_data (hring_t *hist)
 {
-    llist_t *ptr = head;
-    while (ptr) {
-        char buf1[21], buf2[21];
-        strftime (buf1, 21, "%Y-%m-%dT%H:%M:%S", &ptr->data->starttime);
-        strftime (buf2, 21, "%Y-%m-%dT%H:%M:%S", &ptr->data->endtime);
-        printf("Starttime: %s, Endtime: %s, Average Temperature: %f, Average Pressure: %f, Average Humidity: %f, RHO:%f Currents: 0:%f, 1:%f, 2:%f, 3:%f, 4:%f, 5:%f, 6:%f, 7:%f, 8:%f, 9:%f, 10:%f\n", buf1, buf2, 
-                ptr->data->avg_temperature, ptr->data->avg_pressure, ptr->data->avg_humidity, ptr->data->rho, ptr->data->avg_current[0], ptr->data->avg_current[1], ptr->data->avg_current[2], ptr->data->avg_current[3], 
-                ptr->data->avg_current[4], ptr->data->avg_current[5], ptr->data->avg_current[6], ptr->data->avg_current[7], ptr->data->avg_current[8], ptr->data->avg_current[9], ptr->data->avg_current[10]);
-        ptr = ptr->next;
+    int i = 0;
+    for (i = 0; i < hist->size; i++) {
+        phist_t *ptr = hring_get (hist, i);
+        char buf1[SITE_TIME_LEN + 1], buf2[SITE_TIME_LEN + 1];
+        site_time_format (ptr->starttime, buf1);
+        site_time_format (ptr->endtime, buf2);
+        char types[256];
+        LOG (LOG_INFO, "Starttime: %s, Endtime: %s, Average Temperature: %f, Average Pressure: %f, Average Humidity: %f, RHO:%f Currents: %s\n", buf1, buf2, 
+                ptr->avg_temperature, ptr->avg_pressure, ptr->avg_humidity, ptr->rho,
+                format_per_type (types, sizeof (types), ptr->avg_current));
     }
 }
 
 void print_operations_summary (opsum_t *summary, int size) 
 {
     int i = 0;
+    char types[256];
     for (i = 0; i < size; i++) {
-        printf("--- Printing Summary %d of %d ---\n", i+1, size);
-        printf("Average Temperature:%f, Average Pressure:%f, Average Humidity:%f, Average air density:%f, Airdensity variance:%f\nratios--: 0:%f, 1:%f, 2:%f, 3:%f, 4:%f, 5:%f, 6:%f, 7:%f, 8:%f, 9:%f, 10:%f\nCurrents: 0:%f, 1:%f, 2:%f, 3:%f, 4:%f, 5:%f, 6:%f, 7:%f, 8:%f, 9:%f, 10:%f\nVariance: 0:%f, 1:%f, 2:%f, 3:%f, 4:%f, 5:%f, 6:%f, 7:%f, 8:%f, 9:%f, 10:%f\n", 
-                summary->avg_temp, summary->avg_pres, summary->avg_humd, summary->avg_rho, summary->rho_variance,
-                summary->avg_ratio[0], summary->avg_ratio[1], summary->avg_ratio[2], summary->avg_ratio[3], summary->avg_ratio[4], summary->avg_ratio[5], 
-                summary->avg_ratio[6], summary->avg_ratio[7], summary->avg_ratio[8], summary->avg_ratio[9], summary->avg_ratio[10],
-                summary->avg_current[0], summary->avg_current[1], summary->avg_current[2], summary->avg_current[3], summary->avg_current[4], summary->avg_current[5],
-                summary->avg_current[6], summary->avg_current[7], summary->avg_current[8], summary->avg_current[9], summary->avg_current[10],
-                summary->variance[0], summary->variance[1], summary->variance[2], summary->variance[3], summary->variance[4], summary->variance[5],
-                summary->variance[6], summary->variance[7], summary->variance[8], summary->variance[9], summary->variance[10]);
-
+        LOG (LOG_INFO, "--- Printing Summary %d of %d ---\n", i+1, size);
+        LOG (LOG_INFO, "Average Temperature:%f, Average Pressure:%f, Average Humidity:%f, Average air density:%f, Airdensity variance:%f\n", 
+                summary[i].avg_temp, summary[i].avg_pres, summary[i].avg_humd, summary[i].avg_rho, summary[i].rho_variance);
+        LOG (LOG_INFO, "ratios--: %s\n", format_per_type (types, sizeof (types), summary[i].avg_ratio));
+        LOG (LOG_INFO, "Currents: %s\n", format_per_type (types, sizeof (types), summary[i].avg_current));
+        LOG (LOG_INFO, "Variance: %s\n", format_per_type (types, sizeof (types), summary[i].variance));
     }
 
 }
 
-int short_period_over (struct tm tm, struct tm prev_tm) 
-{
-    int64_t timenow = mktime (&tm);
-    int64_t timeprev = mktime (&prev_tm);
-    
-    if ((timenow - timeprev) >= (PERIOD_SHORT * 60 * 60))
-        return 1;
-    
-    return 0;
-}
-
-int compare (const void *a, const void *b)
-{
-    return ( *(int*)a - *(int*)b );
-}
-
-int find_next_long_timestop (int *timestops, int wsize, int current_hour, int *next_timestop, int *prev_timestop, int *index)
+/* Prints the machine types of the registry and their fleet counts
+ */
+void print_types ()
 {
     int i = 0;
-    int *new_timestops = (int*) malloc (sizeof (int) * (wsize + 1));
-    for (i = 0; i < wsize; i++)
-        if (current_hour == timestops[i]) {
-            i += 1;
-            if (i >= wsize) 
-                i = 0;
-            *next_timestop = timestops[i];
-            *prev_timestop = current_hour;
-            *index = i;
-            free (new_timestops);
-            return 0;
-        } else {
-            new_timestops[i] = timestops[i];
-        }
-
-    new_timestops[wsize] = current_hour;
-    qsort (new_timestops, wsize+1, sizeof (int), compare);
-
-    for (i = 0; i < wsize+1; i++) {
-        if (new_timestops[i] == current_hour) {
-            if (i-1 >= 0)
-                *prev_timestop = new_timestops[i-1];
-            else
-                *prev_timestop = new_timestops[wsize];
-            *index = i;
-            i += 1;
-            if (i >= wsize+1)
-                i = 0;
-            *next_timestop = new_timestops[i];
-            free (new_timestops);
-            return 0;
-        }
+    for (i = 0; i < registry.ntypes; i++) {
+        printf ("Type %d: %s, %d machines\n", i, registry.names[i], num_machines[i]);
     }
-    // not found
-    return -1;
 }
 
 /*******************************************************
  *                                                     *
- *                 Math Operations                     *
+ *              Compressed History                     *
  *                                                     *
  *******************************************************/
-double air_density (double temp, double humd, double pres)
+
+/* Series of the history: one per machine, then the sensor */
+enum { HS_TEMPERATURE, HS_PRESSURE, HS_HUMIDITY, HS_NUM };
+static const char *sensor_series[HS_NUM] = {"env:temperature", "env:pressure", "env:humidity"};
+
+/* Creates the series of the fleet and the sensor and loads
+ * what the previous run saved for them
+ */
+int history_init (fleet_t *fleet)
 {
-    /* calculate saturated vapor pressure */
-    double Psv = 611.2 * pow (2.718, (16.67 * temp) / (temp + 243.5));
-    double Pv = (humd / 100) * Psv;
-    double Pd = (pres*100) - Pv;
-    double Rv = 461.4964;
-    double Rd = 287.0531;
-    double Tk = temp + 273.15;
-    double rho = (Pd / (Rd * Tk)) + (Pv / (Rv * Tk));
-    
-    return rho;
+    int i = 0;
+    int rc = -1;
+
+    rc = ghist_init (&history, fleet->size + HS_NUM, (int64_t) (retention_hours * NS_PER_HOUR));
+    if (rc < 0)
+        return rc;
+    for (i = 0; i < fleet->size; i++)
+        strncpy (history.series[i].key, fleet->meta[i].uuid, GHIST_KEY - 1);
+    for (i = 0; i < HS_NUM; i++)
+        strncpy (history.series[fleet->size + i].key, sensor_series[i], GHIST_KEY - 1);
+
+    rc = ghist_load (&history, hist_path);
+    if (rc < 0)
+        return rc;
+    printf ("History: %d series restored from %s\n", rc, hist_path);
+
+    rc = 0;
+    return rc;
 }
 
-int air_density_current_ratio (double rho, double *currents, double *ratios)
-{   
+/* Adds the readings of the tick stamped timestamp epoch ns,
+ * stale machines are skipped */
+int history_push (fleet_t *fleet, double temp, double pres, double humd, int64_t timestamp)
+{
     int i = 0;
-    for (i = 0; i < CMP_END; i++) {
-        ratios[i] = rho / currents[i];
+    int rc = 0;
+
+    for (i = 0; i < fleet->size && rc == 0; i++) {
+        if (fleet->fresh[i])
+            rc = ghist_push (&history, i, timestamp, fleet->current[i]);
     }
-    return 0;
+    if (rc == 0)
+        rc = ghist_push (&history, fleet->size + HS_TEMPERATURE, timestamp, temp);
+    if (rc == 0)
+        rc = ghist_push (&history, fleet->size + HS_PRESSURE, timestamp, pres);
+    if (rc == 0)
+        rc = ghist_push (&history, fleet->size + HS_HUMIDITY, timestamp, humd);
+    return rc;
 }
 
-int compute_variance (double *values, int size, double *variance)
+/* Footprint of the history and the fleet mean current over the
+ * retention, aggregated straight from the compressed blocks
+ */
+void print_history (fleet_t *fleet, int64_t timestamp)
 {
     int i = 0;
-    double mean = 0;
-    double sum = 0;
-    double sum_squared_difference = 0; 
-    
-    for (i = 0; i < size; i++) {
-        sum += values[i];
-    }
-    mean = sum / size;
+    double sum = 0, total = 0;
+    int64_t count = 0, samples = 0;
 
-    for (i = 0; i < size; i++) {
-        sum_squared_difference += pow ((values[i] - mean), 2);
+    for (i = 0; i < fleet->size; i++) {
+        ghist_aggregate (&history, i, timestamp - history.retention, timestamp + 1, &sum, &count);
+        total += sum;
+        samples += count;
     }
-    *variance = sum_squared_difference / size; 
-    return 0;
+    double bytes = (double) history.nblocks * GBLOCK_BYTES;
+    LOG (LOG_INFO, "History: %lld samples in %.1f KiB, %.2f bits/sample (%.1fx vs raw), fleet mean current %.3f\n",
+            (long long) history.nsamples, bytes / 1024,
+            history.nsamples ? bytes * 8 / history.nsamples : 0,
+            bytes ? history.nsamples * 16.0 / bytes : 0,
+            samples ? total / samples : 0);
 }
 
 /*******************************************************
  *                                                     *
- *                 Period Operation                    *
+ *              Monitoring Operations                  *
  *                                                     *
  *******************************************************/
-
-int compute_short_period_averages (machine_t machines[], sensor_t *sensor, mmdat_t *pshort_hist, struct tm start_time, struct tm end_time)
+/* Fields pulled from the env-sensor and machine detail
+ * payloads by the streaming extractor
+ */
+enum { SF_TEMPERATURE, SF_PRESSURE, SF_HUMIDITY };
+static const jfield_t sensor_fields[] = {
+    {"temperature", JF_PAIR},
+    {"pressure", JF_PAIR},
+    {"humidity", JF_PAIR},
+};
+const jspec_t sensor_spec = {sensor_fields, 3};
+
+enum { MF_CURRENT, MF_CURRENT_ALERT, MF_NAME };
+static const jfield_t machine_fields[] = {
+    {"current", JF_NUMBER},
+    {"current_alert", JF_NUMBER},
+    {"name", JF_STRING},
+};
+const jspec_t machine_spec = {machine_fields, 3};
+const jspec_t discover_spec = {&machine_fields[MF_NAME], 1};
+
+/* Counts the machines of every component type.
+ * Unclassified machines only count towards CMP_ALL.
+ */
+void count_machines (fleet_t *fleet)
 {
-    printf ("================Computing short period averages======================\n");
     int i = 0;
-    int j = 0;
-    
-    double temp_sum, temp_avg;
-    double pres_sum, pres_avg;
-    double humd_sum, humd_avg;
-    double rho;
-
-    double *type_sum = (double*) malloc (sizeof (double) * CMP_END);
-    memset (type_sum, 0, sizeof (double) * CMP_END);
-    double *type_avg = (double*) malloc (sizeof (double) * CMP_END);
-    memset (type_avg, 0, sizeof (double) * CMP_END);
-
-    /* Compute average energy consumption of all the machines */
-    for (i = 0; i < NUM_TOTAL; i++) {
-        // Compute for this machine
-        int tmp_sum = 0;
-        int avg = 0;
-        for (j = 0; j < (machines[i].phead - 1); j++) {
-            tmp_sum += machines[i].current_periodwindow[j].current;
-        }
-        if (machines[i].phead - 1 > 0)
-            avg = tmp_sum / (machines[i].phead - 1);
-        else 
-            avg = 0;
-
-        // Sum up the avg for this machine type
-        type_sum[machines[i].type] += avg;
-        type_sum[CMP_ALL] += avg;
-
-        // Adjust
-        machines[i].current_periodwindow[0] = machines[i].current_periodwindow[machines[i].phead];
-        machines[i].phead = 1;
-    }    
-    /* Compute total average */
-    for (i = 0; i < CMP_END; i++) {
-        type_avg[i] = type_sum[i] / num_machines[i]; 
-    }
-
-    /* Compute average temp, humidty and pressure and air density*/
-    for (i = 0; i < sensor->size - 1; i++) {
-        temp_sum += sensor->temperature[i];
-        humd_sum += sensor->humidity[i];
-        pres_sum += sensor->pressure[i];
-    }
-    if (sensor->size - 1 > 0) {
-        temp_avg = temp_sum / (sensor->size - 1);
-        humd_avg = humd_sum / (sensor->size - 1);
-        pres_avg = pres_sum / (sensor->size - 1);
-        rho = air_density (temp_avg, humd_avg, pres_avg);
-    
-        // adjust
-        sensor->temperature[0] = sensor->temperature[sensor->size];
-        sensor->humidity[0] = sensor->humidity[sensor->size];
-        sensor->pressure[0] = sensor->pressure[sensor->size];
-        sensor->size = 1;
-    } else {
-        temp_avg = 0;
-        humd_avg = 0;
-        pres_avg = 0;
-        rho = 0;
-    }
 
-    if (pshort_hist->size == STORAGE_SHORT) {
-        llist_t *penultimate = pshort_hist->last->prev;
-        llist_entry_destroy (&(pshort_hist->last));
-        pshort_hist->last = penultimate;
-        pshort_hist->last->next = NULL;
-        pshort_hist->size -= 1;
+    memset (num_machines, 0, sizeof (int) * registry.ntypes);
+    for (i = 0; i < fleet->size; i++) {
+        if (fleet->type[i] != CMP_ALL)
+            num_machines[fleet->type[i]]++;
     }
-    
-    /* make an entry */
-    llist_t *entry;
-    llist_entry_create (&entry);
-    entry->data->starttime = start_time;
-    entry->data->endtime = end_time;
-    entry->data->avg_temperature = temp_avg;
-    entry->data->avg_humidity = humd_avg;
-    entry->data->avg_pressure = pres_avg;
-    entry->data->rho = rho;
-    for (i = 0; i < CMP_END; i++) {
-        entry->data->avg_current[i] = type_avg[i];
-    }
-    if (pshort_hist->head != NULL) {
-        entry->next = pshort_hist->head;
-        pshort_hist->head->prev = entry; 
-    }
-    pshort_hist->head = entry;
-    pshort_hist->size += 1;
-    
-    air_density_current_ratio (entry->data->rho, entry->data->avg_current, entry->data->rho_cur_ratio);
-
-    /* Free memory */
-    free (type_sum);
-    free (type_avg);
-
-    return 0;
+    num_machines[CMP_ALL] = fleet->size;
 }
 
-int compute_long_period_averages (mmdat_t *pshort_hist, mmdat_t *plong_hist, llist_t **prev_head, struct tm starttime, struct tm endtime) 
+/* Classify a single machine. 
+ * Stores the machine name and assigns the correct
+ * component type for it. A name no type matches is
+ * stored all the same and the machine keeps its type.
+ */
+int machine_classify (fleet_t *fleet, int idx, const char *name) 
 {
-    printf ("================Computing LONG period averages======================\n");
     int rc = -1;
-    int i = 0;
-    int count = 0;
-    double rho_sum = 0;
-    double temp_sum = 0;
-    double pres_sum = 0;
-    double humd_sum = 0;
-    double *type_sum = (double *) malloc (sizeof (double) * CMP_END);
-    memset (type_sum, 0, sizeof (double) * CMP_END);
-    double rho_avg = 0;
-    double temp_avg = 0;
-    double pres_avg = 0;
-    double humd_avg = 0;
-    double *type_avg = (double *) malloc (sizeof (double) * CMP_END);
-    memset (type_avg, 0, sizeof (double) * CMP_END);
-    
-    llist_t *head, *orig_head, *last_iter_head;
- 
-    if (!(*prev_head)) {
-        printf ("Prev head is NULL, no data in short history\n");
-        return 0;
-    }
-    
-    orig_head = *prev_head;
-    head = *prev_head;
-    while (head) {
-        temp_sum += head->data->avg_temperature;
-        pres_sum += head->data->avg_pressure;
-        humd_sum += head->data->avg_humidity;
-        rho_sum += head->data->rho;
-        for (i = 0; i < CMP_END; i++) {
-            type_sum[i] += head->data->avg_current[i];
-        }
-        count++;
-        last_iter_head = head;
-        head = head->prev;
-    }
-
-    if (count > 0) {
-        temp_avg = temp_sum / count;
-        pres_avg = pres_sum / count;
-        humd_avg = humd_sum / count;
-        rho_avg = rho_sum / count;
-        for (i = 0; i < CMP_END; i++) {
-            type_avg[i] = type_sum[i] / count;
-        }
-    }
-
-    if (plong_hist->size == STORAGE_LONG) {
-        llist_t *penultimate = plong_hist->last->prev;
-        llist_entry_destroy (&(plong_hist->last));
-        plong_hist->last = penultimate;
-        plong_hist->last->next = NULL;
-        plong_hist->size -= 1;
-    }
-
-    /* make an entry */
-    llist_t *entry;
-    llist_entry_create (&entry);
-    entry->data->starttime = starttime;
-    entry->data->endtime = endtime;
-    entry->data->avg_temperature = temp_avg;
-    entry->data->avg_humidity = humd_avg;
-    entry->data->avg_pressure = pres_avg;
-    entry->data->rho = rho_avg;
-    for (i = 0; i < CMP_END; i++) {
-        entry->data->avg_current[i] = type_avg[i];
-    }
-    if (plong_hist->head != NULL) {
-        entry->next = plong_hist->head;
-        plong_hist->head->prev = entry;
-    }
-    plong_hist->head = entry;
-    plong_hist->size += 1; 
+    int type = treg_classify (&registry, name);
 
-    air_density_current_ratio (entry->data->rho, entry->data->avg_current, entry->data->rho_cur_ratio);   
-     
-    /* free memory */
-    free (type_sum);
-    free (type_avg);
+    free (fleet->meta[idx].name);
+    fleet->meta[idx].name = strdup (name);
 
-    rc = 0;
-    return rc;
-}
-
-int update_operations_summary (mmdat_t *plong_hist, opsum_t *summary) 
-{
-    //printf ("------------Update summary\n");
-    int rc = -1;
-    int count = 0;
-    int i, j;
-    double temp_sum = 0, humd_sum = 0, pres_sum = 0, rho_sum = 0;
-    double temp_avg = 0, humd_avg = 0, pres_avg = 0, rho_avg = 0;
-    double cur_sum = 0, ratio_sum;
-    
-    double **ratios = (double **)malloc (sizeof(double*) * CMP_END);
-    for (i = 0; i < CMP_END; i++) {
-        ratios[i] = (double *)malloc (sizeof(double) * plong_hist->size);
-    }
-    double **currents = (double **)malloc (sizeof(double*) * CMP_END);
-    for (i = 0; i < CMP_END; i++) {
-        currents[i] = (double *)malloc (sizeof(double) * plong_hist->size);
-    }
-    double *rho_collect = (double *) malloc (sizeof (double) * plong_hist->size);
-    
- 
-    llist_t *head = plong_hist->head;   
-    while (head) {
-        for (i = 0; i < CMP_END; i++) {
-            ratios[i][count] = head->data->rho_cur_ratio[i];
-            currents[i][count] = head->data->avg_current[i];
-        }
-        temp_sum += head->data->avg_temperature;
-        humd_sum += head->data->avg_humidity;
-        pres_sum += head->data->avg_pressure;
-        rho_sum += head->data->rho;
-        rho_collect[count] = head->data->rho;
-        count++;
-        head = head->next;
-    }
-
-    summary->avg_temp = temp_sum / plong_hist->size;
-    summary->avg_humd = humd_sum / plong_hist->size;
-    summary->avg_pres = pres_sum / plong_hist->size;
-    summary->avg_rho = rho_sum / plong_hist->size;
-
-    for (i = 0; i < CMP_END; i++) {
-        compute_variance (ratios[i], plong_hist->size, &summary->variance[i]);
-        cur_sum = 0;
-        for (j = 0; j < plong_hist->size; j++) {
-            cur_sum += currents[i][j];
-        }
-        summary->avg_current[i] = cur_sum / plong_hist->size;
-        ratio_sum = 0;
-        for (j = 0; j < plong_hist->size; j++) {
-            ratio_sum += ratios[i][j];
-        }
-        summary->avg_ratio[i] = ratio_sum / plong_hist->size;
-    }
-    compute_variance (rho_collect, count, &summary->rho_variance);
-
-    for (i = 0; i < CMP_END; i++) {
-        free (ratios[i]);
-        free (currents[i]);
+    if (type < 0) {
+        LOG_RATE (LOG_ERROR, 10, "ERROR: Name %s could not be found in list\n", name);
+        return rc;
     }
-    free (ratios);
-    free (currents);
-    free (rho_collect);
+    fleet->type[idx] = type;
+    //printf ("Name of the machine: %s\n", name);
 
     rc = 0;
     return rc;
 }
 
-/*******************************************************
- *                                                     *
- *              Monitoring Operations                  *
- *                                                     *
- *******************************************************/
-/* Init a single machine. 
- * Extracts the machine name and assigns the correct
- * component type for it
+/* Poller callback for the discovery of a machine
+ * that is not in the cache
  */
-int machine_single_init (machine_t *machine) 
+int machine_discover_done (void *ctx, int idx, chunk_t *chunk, jscan_t *scan, int status)
 {
+    fleet_t *fleet = (fleet_t *) ctx;
+    const char *name = NULL;
+    json_object *jdetail = NULL;
     int rc = -1;
-    char *url;
-    asprintf (&url, "%s%s", machine_detail_base_url, machine->uuid);
-    chunk_t chunk;
-    chunk.data = malloc (1);
-    chunk.size = 0;
 
-    int res = fetch_curl (url, &chunk);
-    if (res < 0) {
+    if (status < 0) {
         printf ("ERROR: Could not fetch machine detail during machine init\n");
         return rc;
     }
-    
-    json_object *jdetail = json_tokener_parse (chunk.data);
-    json_object *tmp = NULL;
-    json_object_object_get_ex (jdetail, "name", &tmp);
-    const char *name = json_object_get_string (tmp);
-    if (name == NULL) {
-        printf ("ERROR: Name of machine could not be dervied\n");
-        return rc;
-    }
-
-    machine->name = strdup (name);
-    //printf ("Name of the machine: %s\n", name);
 
-    if (strstr (name, "DMC")) {
-        machine->type = CMP_DMG_DMC;
-    } else if (strstr (name, "DMU")) {
-        machine->type = CMP_DMG_DMU;
-    } else if (strstr (name, "NTX")) {
-        machine->type = CMP_DMG_NTX;
-    } else if (strstr (name, "NZX") != NULL) {
-        machine->type = CMP_DMG_NZX;
-    } else if (strstr (name, "A7")) {
-        machine->type = CMP_KASOTEC_A7;
-    } else if (strstr (name, "A13")) {
-        machine->type = CMP_KASOTEC_A13;
-    } else if (strstr (name, "WSS")) {
-        machine->type = CMP_PERNDORFER_WSS;
-    } else if (strstr (name, "3000")) {
-        machine->type = CMP_TRUMPF_3000;
-    } else if (strstr (name, "7000")) {
-        machine->type = CMP_TRUMPF_7000;
-    } else if (strstr (name, "Lasertec")) {
-        machine->type = CMP_DMG_LASTERTEC;
+    if (scan) {
+        if (scan->found & 1)
+            name = scan->values[0].string;
     } else {
-        printf ("ERROR: Name could not be found in list\n");
-        return rc;
+        json_object *tmp = NULL;
+        jdetail = json_tokener_parse (chunk->data);
+        json_object_object_get_ex (jdetail, "name", &tmp);
+        name = json_object_get_string (tmp);
     }
 
-    free (chunk.data);
-    free (jdetail);
+    if (name == NULL) {
+        printf ("ERROR: Name of machine could not be dervied\n");
+    } else {
+        rc = machine_classify (fleet, idx, name);
+    }
 
-    rc = 0;
+    json_object_put (jdetail);
     return rc;
 }
 
 /* machines_init()
  * Initializes the machine and senor data by fetching from the URL
  */
-int machines_init (machine_t machines[], sensor_t *sensor) 
+int machines_init (fleet_t *fleet, sensor_t *sensor) 
 {
     int i = 0;
     int rc = -1;
@@ -611,11 +338,10 @@ int machines_init (machine_t machines[], sensor_t *sensor)
 
     /* init the chunk */
     chunk_t chunk;
-    chunk.data = malloc (1);
-    chunk.size = 0;
+    chunk_init (&chunk);
     
     /* Fetch the data */
-    rc = fetch_curl (machine_list_url, &chunk);
+    rc = fetch_curl (machine_list_url, &chunk, MH_FETCH_LIST);
     if ((rc < 0) || (chunk.size == 0)) {
         printf ("fetching machine list failed\n");
         return rc;
@@ -633,34 +359,71 @@ int machines_init (machine_t machines[], sensor_t *sensor)
     window_size = (int)ceil((1/frequency)*seconds_history);
     pwindow_size = (int)ceil(PERIOD_SHORT*60*60 / frequency);
     printf ("Window size to be created = %d\n", (int)ceil((1/frequency)*seconds_history));
+
+    rc = fleet_init (fleet, len, pwindow_size + 1, seconds_history, frequency);
+    if (rc < 0) {
+        json_object_put (mlist);
+        free (chunk.data);
+        return rc;
+    }
+    rc = -1;
     
     /* iterate and store machine uuids */
-    for (i = 0; i < len; i++) {
+    for (i = 0; i < fleet->size; i++) {
+        mmeta_t *meta = &fleet->meta[i];
         const char *mstr = json_object_get_string (json_object_array_get_idx (mlist, i));
-        strncpy (machines[i].uuid, &mstr[18], 36);
-        machines[i].uuid[36] = '\0';
-        machines[i].current_cur = 0;
-        machines[i].current_threshold = 0;
-        machines[i].current_avgwindow = (cw_t *) malloc (sizeof (cw_t) * window_size);
-        memset (machines[i].current_avgwindow, 0, sizeof(cw_t) * window_size);
-        machines[i].current_periodwindow = (cw_t *) malloc (sizeof (cw_t) * (pwindow_size + 1));
-        memset (machines[i].current_periodwindow, 0, sizeof(cw_t) * pwindow_size);
-        machines[i].head = 0;
-        machines[i].phead = 0;
-    }
-
-    /* Fetch all the machine names/types */
-    for (i = 0; i < NUM_TOTAL; i++) {
-        rc = machine_single_init (&machines[i]);
-        if (rc < 0) {
-            printf ("ERROR: Could not init machine i: %d\n", i);
+        if (mstr == NULL || strlen (mstr) < 18 + 36) {
+            printf ("ERROR: Unexpected machine path in the machine list\n");
+            json_object_put (mlist);
+            free (chunk.data);
+            return rc;
+        }
+        strncpy (meta->uuid, &mstr[18], 36);
+        meta->uuid[36] = '\0';
+        asprintf (&meta->url, "%s%s", machine_detail_base_url, meta->uuid);
+    }
+
+    /* Names/types come from the cache, only unknown machines are fetched */
+    mcache_t cache;
+    preq_t *reqs = (preq_t *) malloc (sizeof (preq_t) * fleet->size);
+    int nreqs = 0;
+    mcache_load (&cache, cache_path);
+    for (i = 0; i < fleet->size; i++) {
+        mcent_t *entry = mcache_find (&cache, fleet->meta[i].uuid);
+        if (entry) {
+            int type = treg_classify (&registry, entry->name);
+            fleet->meta[i].name = strdup (entry->name);
+            fleet->type[i] = (type < 0) ? CMP_ALL : type;
+            continue;
         }
+        reqs[nreqs].url = fleet->meta[i].url;
+        reqs[nreqs].done = machine_discover_done;
+        reqs[nreqs].ctx = fleet;
+        reqs[nreqs].idx = i;
+        reqs[nreqs].spec = (parse_mode == PARSE_STREAM) ? &discover_spec : NULL;
+        reqs[nreqs].hist = MH_FETCH_MACHINE;
+        nreqs++;
     }
+    printf ("%d machines known from cache %s, discovering %d\n", fleet->size - nreqs, cache_path, nreqs);
+
+    if (nreqs > 0) {
+        rc = poller_run (&poller, reqs, nreqs);
+        if (rc > 0) {
+            printf ("ERROR: Could not init %d machines\n", rc);
+        }
+        mcache_save (fleet, cache_path);
+    }
+    mcache_free (&cache);
+    free (reqs);
+    count_machines (fleet);
+    printf ("Fleet of %d machines\n", fleet->size);
+    print_types ();
     
     /* Allocate memory for sensor data */
     sensor->pressure = (double *) malloc (sizeof (double) * (pwindow_size + 1));
     sensor->temperature = (double *) malloc (sizeof (double) * (pwindow_size + 1));
     sensor->humidity = (double *) malloc (sizeof (double) * (pwindow_size + 1));
+    sensor->rho = (double *) malloc (sizeof (double) * (pwindow_size + 1));
 
     /* free memory */
     json_object_put (mlist);    
@@ -672,262 +435,559 @@ int machines_init (machine_t machines[], sensor_t *sensor)
     return rc;
 }
 
-/* Get the sensor readings and 
- * the local time at the machine site
+/* Store a sensor reading and the local time at the machine site
  */
-int get_sensor_readings (sensor_t *sensor, struct tm *tm)
+int sensor_store (sensor_t *sensor, int64_t *site_ns, double temp, double pres, double humd, const char *time_str)
 {
     int rc = -1;
 
-    /* init chunk */
-    chunk_t chunk;
-    chunk.data = malloc (1);
-    chunk.size = 0;
-
-    rc = fetch_curl (env_sensor_url, &chunk);
-    if ((rc < 0) || (chunk.size == 0)) {
-        fprintf (stderr, "fetching sensor details failed\n");
+    /* update the period window */
+    if (sensor->size == pwindow_size) {
+        LOG_RATE (LOG_ERROR, 1, "ERROR: phead on window_size in sensor. buffer needs clear up\n");
         return rc;
     }
 
-    json_object *jdetail = json_tokener_parse (chunk.data);
+    sensor->temperature[sensor->size] = temp;
+    sensor->pressure[sensor->size] = pres;
+    sensor->humidity[sensor->size] = humd;
+    sensor->size += 1;
+
+    /* get time, the previous one stays if it is malformed */
+    site_time_parse (time_str, site_ns);
+
+    rc = 0;
+    return rc;
+}
+
+/* Update the sensor readings from an env-sensor response,
+ * parsed and validated by json-c
+ */
+int sensor_update (sensor_t *sensor, int64_t *site_ns, chunk_t *chunk)
+{
+    int rc = -1;
+
+    json_object *jdetail = json_tokener_parse (chunk->data);
     json_object *jtemp = NULL, *jpres = NULL, *jhumd = NULL;
     json_object_object_get_ex (jdetail, "temperature", &jtemp);
     json_object_object_get_ex (jdetail, "pressure", &jpres);
     json_object_object_get_ex (jdetail, "humidity", &jhumd);
-
-    /* update the period window */
-    if (sensor->size == pwindow_size) {
-        printf ("ERROR: phead on window_size in sensor. buffer needs clear up\n");
+    if (jtemp == NULL || jpres == NULL || jhumd == NULL) {
+        LOG_RATE (LOG_ERROR, 5, "ERROR: Could not get sensor readings\n");
+        json_object_put (jdetail);
         return rc;
     }
 
-    sensor->temperature[sensor->size] = json_object_get_double (json_object_array_get_idx (jtemp, 1));
-    sensor->pressure[sensor->size] = json_object_get_double (json_object_array_get_idx (jpres, 1));
-    sensor->humidity[sensor->size] = json_object_get_double (json_object_array_get_idx (jhumd, 1));
-    sensor->size += 1;
-
-    /* get time */
     const char *time_str = json_object_get_string (json_object_array_get_idx (jtemp, 0));
-    strptime (time_str, "%Y-%m-%dT%H:%M:%S", tm);
+    rc = sensor_store (sensor, site_ns,
+            json_object_get_double (json_object_array_get_idx (jtemp, 1)),
+            json_object_get_double (json_object_array_get_idx (jpres, 1)),
+            json_object_get_double (json_object_array_get_idx (jhumd, 1)),
+            time_str ? time_str : "");
 
-    //printf ("Sensor data = %s and time = %s and timeepoch = %ld\n", chunk.data, time_str, mktime(tm));
+    //printf ("Sensor data = %s and time = %s\n", chunk->data, time_str);
 
     /* free memory */
-    free (chunk.data);
-    free (jdetail);
+    json_object_put (jdetail);
 
-    rc = 0;
     return rc;
 }
 
-
-/* Monitor/operate on 1 machine. 
- * Updates the machine data, updates average and 
- * if there is a current > threshold, then sends an alert
+/* Get the sensor readings and 
+ * the local time at the machine site
  */
-
-int monitor_machine (machine_t *machine)
+int get_sensor_readings (sensor_t *sensor, int64_t *site_ns)
 {
     int rc = -1;
-    char *url;
 
-    /* create the machine url and init chunk */
-    asprintf (&url, "%s%s", machine_detail_base_url, machine->uuid);
+    /* init chunk */
     chunk_t chunk;
-    chunk.data = malloc (1);
-    chunk.size = 0;
+    chunk_init (&chunk);
 
-    /* fetch the new machine data */
-    rc = fetch_curl (url, &chunk);
+    rc = fetch_curl (env_sensor_url, &chunk, MH_FETCH_SENSOR);
     if ((rc < 0) || (chunk.size == 0)) {
-        printf ("fetching machine detail for machine %s failed\n", machine->uuid);
-        return rc;
-    }   
+        LOG_RATE (LOG_ERROR, 5, "ERROR: fetching sensor details failed\n");
+        free (chunk.data);
+        return -1;
+    }
+
+    rc = sensor_update (sensor, site_ns, &chunk);
+
+    /* free memory */
+    free (chunk.data);
+
+    return rc;
+}
+
+/* Poller callback for the env-sensor request
+ */
+int sensor_done (void *ctx, int idx, chunk_t *chunk, jscan_t *scan, int status)
+{
+    sfetch_t *fetch = (sfetch_t *) ctx;
+    int rc = -1;
+    fetch->status = -1;
+    if (status < 0) {
+        LOG_RATE (LOG_ERROR, 5, "ERROR: fetching sensor details failed\n");
+        return -1;
+    }
+    int64_t start = metrics_now ();
+    if (scan == NULL) {
+        rc = sensor_update (fetch->sensor, fetch->site_ns, chunk);
+    } else if (scan->found != 0x7) {
+        LOG_RATE (LOG_ERROR, 5, "ERROR: Could not get sensor readings\n");
+    } else {
+        rc = sensor_store (fetch->sensor, fetch->site_ns, scan->values[SF_TEMPERATURE].number,
+                scan->values[SF_PRESSURE].number, scan->values[SF_HUMIDITY].number,
+                scan->values[SF_TEMPERATURE].string);
+    }
+    metrics_since (MH_PARSE, start);
+    if (rc < 0)
+        metrics_add (MC_PARSE_FAILURES, 1);
+    fetch->status = rc;
+    return rc;
+}
+
+/* Alert check and window updates for a fresh reading of machine i,
+ * stamped timenow epoch nanoseconds
+ */
+int monitor_machine (fleet_t *fleet, int i, int64_t timenow)
+{
+    int64_t start = metrics_now ();
+
+    /* raise or clear the alert of the machine */
+    double avg = NAN;
+    if (fleet->current[i] > fleet->threshold[i]) {
+        rwin_evict (&fleet->avgwin[i], timenow);
+        avg = rwin_avg (&fleet->avgwin[i], fleet->current[i]);
+    }
+    alerts_check (&alerts, i, fleet->meta[i].uuid, fleet->current[i], fleet->threshold[i], avg, timenow);
+
+    /* update the average and period windows */
+    rwin_push (&fleet->avgwin[i], timenow, fleet->current[i]);
+    if (fleet->phead[i] == pwindow_size) {
+        LOG_RATE (LOG_ERROR, 1, "ERROR: phead on window_size. buffer needs clear up\n");
+        return -1;
+    }
+    fleet->period[(size_t) i * fleet->pstride + fleet->phead[i]] = fleet->current[i];
+    fleet->phead[i]++;
+    metrics_since (MH_UPDATE, start);
+    return 0;
+}
+
+/* Acts on the readings of this tick. With the pipeline the update
+ * stage already did as every reading arrived.
+ */
+int monitor_fleet (fleet_t *fleet)
+{
+    int rc = 0;
+    int i = 0;
+
+    for (i = 0; i < fleet->size; i++) {
+        if (!fleet->fresh[i])
+            continue;
+        fleet->fresh[i] = 0;
+        if (parse_workers == 0 && monitor_machine (fleet, i, tick_ns) < 0)
+            rc = -1;
+    }
+
+    return rc;
+}
+
+/* Reclassify a machine whose name differs from the cached one
+ */
+static void machine_revalidate (fleet_t *fleet, int idx, const char *name)
+{
+    if (fleet->meta[idx].name && strcmp (fleet->meta[idx].name, name) == 0)
+        return;
+    LOG (LOG_INFO, "Machine %s is now known as %s\n", fleet->meta[idx].uuid, name);
+    machine_classify (fleet, idx, name);
+    __atomic_store_n (&cache_dirty, 1, __ATOMIC_RELEASE);
+}
 
-    /* fetch current and current alert */
-    json_object *jdetail = json_tokener_parse (chunk.data);
+/* Extract current and current alert of a machine
+ * detail response, parsed and validated by json-c
+ */
+int machine_parse_json (fleet_t *fleet, int idx, chunk_t *chunk, mread_t *rd)
+{
+    int rc = -1;
+    const char *uuid = fleet->meta[idx].uuid;
+
+    json_object *jdetail = json_tokener_parse (chunk->data);
     json_object *tmp = NULL;
     json_object_object_get_ex (jdetail, "current", &tmp);
     if (tmp == NULL) {
-        printf ("ERROR: Could not get current for machine %s\n", machine->uuid);
+        LOG_RATE (LOG_ERROR, 10, "ERROR: Could not get current for machine %s\n", uuid);
+        json_object_put (jdetail);
         return rc;
     }
-    machine->current_cur = json_object_get_double (tmp);
+    rd->current = json_object_get_double (tmp);
+    tmp = NULL;
     json_object_object_get_ex (jdetail, "current_alert", &tmp);
     if (tmp == NULL) {
-        printf ("ERROR: Could not get current_alert for machine %s\n", machine->uuid);
-    }
-    machine->current_threshold = json_object_get_double (tmp);
-    //printf ("machine = %s, current = %f, current_alert = %f\n", machine->uuid, machine->current_cur, machine->current_threshold);
-
-    /* Implementation with timestamp for each window entry */
-    /* send alert if current is greater than threshold */
-    int64_t timenow = epochtime ();
-    if (machine->current_cur > machine->current_threshold) {
-        int i = 0;
-        double sum = 0, avg = 0;
-        int count = 0;
-        int head_dup = machine->head - 1;
-        if (head_dup < 0) 
-            head_dup = window_size - 1;
-        
-        while ((machine->current_avgwindow[head_dup].timestamp != 0) && (machine->current_avgwindow[head_dup].timestamp > timenow - seconds_history) && (head_dup != machine->head)) {
-            sum += machine->current_avgwindow[head_dup].current;
-            count++;
-            head_dup -= 1;
-            if (head_dup < 0) 
-                head_dup = window_size - 1;
-        }
-
-        if (count > 0)
-            avg = sum / count;
-        else 
-            avg = machine->current_avgwindow[head_dup].current;
-
-        send_alert (machine, avg);
+        LOG_RATE (LOG_ERROR, 10, "ERROR: Could not get current_alert for machine %s\n", uuid);
     }
-    
-    /* update the average window */
-    machine->current_avgwindow[machine->head].current = machine->current_cur;
-    machine->current_avgwindow[machine->head].timestamp = timenow;
-    machine->head = (machine->head == window_size - 1) ? 0 : machine->head + 1; 
+    rd->threshold = json_object_get_double (tmp);
 
-    /* update the period window */
-    if (machine->phead == pwindow_size) {
-        printf ("ERROR: phead on window_size. buffer needs clear up\n");
-        return rc;
-    }
-    machine->current_periodwindow[machine->phead].current = machine->current_cur;
-    machine->phead++;
+    /* name to revalidate the cached name/type */
+    tmp = NULL;
+    json_object_object_get_ex (jdetail, "name", &tmp);
+    const char *name = json_object_get_string (tmp);
+    if (name)
+        snprintf (rd->name, sizeof (rd->name), "%s", name);
 
     /* free memory */
     json_object_put (jdetail);
-    free (chunk.data);
-    
+
     rc = 0;
     return rc;
 }
 
+/* Extract the reading of a machine detail response, from the
+ * streamed fields if there are any, else from the body
+ */
+int machine_extract (fleet_t *fleet, int idx, chunk_t *chunk, jscan_t *scan, mread_t *rd)
+{
+    rd->idx = idx;
+    rd->name[0] = '\0';
+    if (scan == NULL)
+        return machine_parse_json (fleet, idx, chunk, rd);
+
+    if (!(scan->found & (1u << MF_CURRENT))) {
+        LOG_RATE (LOG_ERROR, 10, "ERROR: Could not get current for machine %s\n", fleet->meta[idx].uuid);
+        return -1;
+    }
+    if (!(scan->found & (1u << MF_CURRENT_ALERT))) {
+        LOG_RATE (LOG_ERROR, 10, "ERROR: Could not get current_alert for machine %s\n", fleet->meta[idx].uuid);
+    }
+    rd->current = scan->values[MF_CURRENT].number;
+    rd->threshold = scan->values[MF_CURRENT_ALERT].number;
+    if (scan->found & (1u << MF_NAME))
+        snprintf (rd->name, sizeof (rd->name), "%s", scan->values[MF_NAME].string);
+    return 0;
+}
+
+/* Stores a reading; monitor_fleet() or the update stage acts on it */
+void machine_apply (fleet_t *fleet, const mread_t *rd)
+{
+    /* revalidate the cached name/type */
+    if (rd->name[0])
+        machine_revalidate (fleet, rd->idx, rd->name);
+
+    fleet->current[rd->idx] = rd->current;
+    fleet->threshold[rd->idx] = rd->threshold;
+    fleet->fresh[rd->idx] = 1;
+}
+
+/* Poller callback for a machine detail request.
+ * Only stores the reading, monitor_fleet() acts on it.
+ */
+int machine_done (void *ctx, int idx, chunk_t *chunk, jscan_t *scan, int status)
+{
+    fleet_t *fleet = (fleet_t *) ctx;
+    mread_t rd;
+
+    if (status < 0) {
+        LOG_RATE (LOG_ERROR, 10, "ERROR: fetching machine detail for machine %s failed\n", fleet->meta[idx].uuid);
+        return -1;
+    }
+    int64_t start = metrics_now ();
+    int rc = machine_extract (fleet, idx, chunk, scan, &rd);
+    metrics_since (MH_PARSE, start);
+    if (rc < 0) {
+        metrics_add (MC_PARSE_FAILURES, 1);
+        return -1;
+    }
+    machine_apply (fleet, &rd);
+    return 0;
+}
+
+/* Poller callback for a machine detail request with the pipeline:
+ * the body goes to a parse worker
+ */
+int machine_submit (void *ctx, int idx, chunk_t *chunk, jscan_t *scan, int status)
+{
+    fleet_t *fleet = (fleet_t *) ctx;
+
+    if (status < 0) {
+        LOG_RATE (LOG_ERROR, 10, "ERROR: fetching machine detail for machine %s failed\n", fleet->meta[idx].uuid);
+        return -1;
+    }
+    pipe_submit (&pipeline, idx, chunk);
+    return 0;
+}
+
+/* Parse stage of the pipeline */
+int machine_parse_stage (void *ctx, int idx, chunk_t *chunk, void *result)
+{
+    fleet_t *fleet = (fleet_t *) ctx;
+    jscan_t scan;
+    int rc = -1;
+    int64_t start = metrics_now ();
+
+    if (parse_mode == PARSE_JSONC) {
+        rc = machine_extract (fleet, idx, chunk, NULL, (mread_t *) result);
+    } else {
+        jscan_init (&scan, &machine_spec);
+        if (jscan_feed (&scan, chunk->data, chunk->size) < 0 || jscan_finish (&scan) < 0)
+            LOG_RATE (LOG_ERROR, 10, "ERROR: malformed response for machine %s\n", fleet->meta[idx].uuid);
+        else
+            rc = machine_extract (fleet, idx, chunk, &scan, (mread_t *) result);
+    }
+    metrics_since (MH_PARSE, start);
+    if (rc < 0)
+        metrics_add (MC_PARSE_FAILURES, 1);
+    return rc;
+}
+
+/* Update stage of the pipeline, machines of a shard only */
+int machine_update_stage (void *ctx, pipe_t *pipe, int shard, void *result)
+{
+    fleet_t *fleet = (fleet_t *) ctx;
+    mread_t *rd = (mread_t *) result;
+
+    machine_apply (fleet, rd);
+    return monitor_machine (fleet, rd->idx, tick_ns);
+}
+
 
 /* monitor()
  * The principal function that monitors the machines 
  */
-int monitor (machine_t machines[], sensor_t *sensor, int run_mins, mmdat_t *pshort_hist, mmdat_t *plong_hist, int *timestops, int wsize, opsum_t *summary) 
+int monitor (fleet_t *fleet, sensor_t *sensor, int run_mins, hring_t *pshort_hist, hring_t *plong_hist, int *timestops, int wsize, opsum_t *summary) 
 {
     int rc = -1; 
     int i = 0;  
+    preq_t *reqs;
+    sfetch_t sfetch;
 
-    int64_t timenow = epochtime ();
-    int64_t starttime = timenow;
-    int64_t endtime = timenow + (run_mins * 60);
-    
-    int index, tmpindex;
-    struct tm prev_tm = {0}, tm = {0}, p_starttime = {0}, p_endtime = {0};
+    /* run_mins of epoch time, 0 = indefinite */
+    tick_ns = epochtime () * NS_PER_SEC;
+    int64_t endtime = (run_mins == 0) ? INT64_MAX : tick_ns + run_mins * 60 * NS_PER_SEC;
+
+    int index;
     int next_timestop, prev_timestop;
-    
-    llist_t **prev_short_head = &(pshort_hist->head);
-    
-    if (run_mins == 0) 
-        timenow = 0;
+
+    /* Periods run on the site time of the sensor readings; their
+     * boundaries are timers of a wheel advanced by every reading */
+    int64_t site_ns = 0; // site time of the latest reading
+    int64_t short_start = 0, long_start = 0; // site time the running periods started
+    int64_t short_ns = (int64_t) (PERIOD_SHORT * NS_PER_HOUR);
+    twheel_t periods;
+    twtimer_t short_timer = {0}, long_timer = {0};
+
+    int64_t short_mark = 0; // short records already folded into a long period
 
     /* Initial step to basically initialize time */
-    rc = get_sensor_readings (sensor, &prev_tm);
+    rc = get_sensor_readings (sensor, &site_ns);
     if (rc < 0) {
-        printf ("ERROR: Retrieving sensor readings failed\n");
+        LOG (LOG_ERROR, "ERROR: Retrieving sensor readings failed\n");
         return rc;
     }
     
-    rc = find_next_long_timestop (timestops, wsize, prev_tm.tm_hour, &next_timestop, &prev_timestop, &index);
+    rc = find_next_long_timestop (timestops, wsize, site_hour (site_ns), &next_timestop, &prev_timestop, &index);
     if (rc < 0) {
-        printf ("ERROR: Could not find the next timestop\n");
+        LOG (LOG_ERROR, "ERROR: Could not find the next timestop\n");
         return -1;
     }
-    printf ("Current time = %d, next_timestop = %d\n", prev_tm.tm_hour, next_timestop);
-
-    p_starttime = prev_tm;
-    p_starttime.tm_hour = prev_timestop;
-    p_starttime.tm_min = 0;
-    p_starttime.tm_sec = 0;
+    LOG (LOG_INFO, "Current time = %d, next_timestop = %d\n", site_hour (site_ns), next_timestop);
+
+    short_start = site_ns;
+    long_start = site_hour_before (site_ns, prev_timestop);
+    twheel_init (&periods, NS_PER_SEC, site_ns);
+    twheel_add (&periods, &short_timer, short_start + short_ns);
+    twheel_add (&periods, &long_timer, site_hour_after (site_ns, next_timestop));
+
+    /* One request for the sensor and one per machine, all in flight together */
+    sfetch.sensor = sensor;
+    sfetch.site_ns = &site_ns;
+    sfetch.status = 0;
+    reqs = (preq_t *) malloc (sizeof (preq_t) * (fleet->size + 1));
+    if (!reqs) {
+        printf ("ERROR: Could not allocate the requests\n");
+        return -1;
+    }
+    reqs[0].url = env_sensor_url;
+    reqs[0].done = sensor_done;
+    reqs[0].ctx = &sfetch;
+    reqs[0].idx = 0;
+    reqs[0].spec = (parse_mode == PARSE_STREAM) ? &sensor_spec : NULL;
+    reqs[0].hist = MH_FETCH_SENSOR;
+    for (i = 0; i < fleet->size; i++) {
+        reqs[i + 1].url = fleet->meta[i].url;
+        reqs[i + 1].done = (parse_workers > 0) ? machine_submit : machine_done;
+        reqs[i + 1].ctx = fleet;
+        reqs[i + 1].idx = i;
+        reqs[i + 1].spec = (parse_mode == PARSE_STREAM && parse_workers == 0) ? &machine_spec : NULL;
+        reqs[i + 1].hist = MH_FETCH_MACHINE;
+    }
    
  
-    while (timenow < endtime) {
-    
-        printf ("Starting new iteration\n");
-        /* Retrieve environmental data and time */
-        rc = get_sensor_readings (sensor, &tm);
+    /* With adaptive polling only the due machines are requested */
+    int ndue = fleet->size;
+    long failed_polls = 0; // machine requests that failed or did not parse
+    int32_t *due = NULL;
+    preq_t *dreqs = NULL;
+    if (poll_max > 1) {
+        due = (int32_t *) malloc (sizeof (int32_t) * (fleet->size + 1));
+        dreqs = (preq_t *) malloc (sizeof (preq_t) * (fleet->size + 1));
+        if (!due || !dreqs) {
+            printf ("ERROR: Could not allocate the due requests\n");
+            rc = -1;
+        } else {
+            rc = psched_init (&psched, fleet->size, poll_max);
+        }
         if (rc < 0) {
-            printf ("ERROR: Retrieving sensor readings failed\n");
+            psched_free (&psched);
+            free (due);
+            free (dreqs);
+            free (reqs);
             return rc;
         }
-        
-        /* monitor/operate on each machine */
-        for (i = 0; i < 243; i++) {         
-            rc = monitor_machine (&machines[i]);
-            if (rc < 0) {
-                printf ("ERROR: operations on machine %s failed\n", machines[i].uuid);
-                return rc;
-            }
+        dreqs[0] = reqs[0];
+    }
+
+    rc = ticker_init (&ticker, frequency);
+    if (rc < 0) {
+        if (poll_max > 1)
+            psched_free (&psched);
+        free (due);
+        free (dreqs);
+        free (reqs);
+        return rc;
+    }
+
+    while (tick_ns < endtime) {
+        tmark_t tick_start;
+        tick_ns = ticker_wait (&ticker);
+        if (tick_ns < 0) {
+            rc = -1;
+            break;
+        }
+        tstats_mark (&tick_start);
+
+        LOG (LOG_DEBUG, "Starting new iteration\n");
+        /* Retrieve environmental data, time and monitor/operate on each machine */
+        if (poll_max > 1) {
+            ndue = psched_due (&psched, due);
+            for (i = 0; i < ndue; i++)
+                dreqs[i + 1] = reqs[due[i] + 1];
+        }
+        rc = poller_run (&poller, (poll_max > 1) ? dreqs : reqs, ndue + 1);
+        if (parse_workers > 0)
+            rc += pipe_wait (&pipeline);
+        for (i = 0; poll_max > 1 && i < ndue; i++) {
+            int m = due[i];
+            psched_polled (&psched, m, fleet->fresh[m], fleet->current[m], fleet->threshold[m]);
+        }
+        /* Without the sensor there is no site time; a machine that did
+         * not answer keeps its last reading and is polled again */
+        if (sfetch.status < 0) {
+            LOG (LOG_ERROR, "ERROR: Retrieving sensor readings failed\n");
+            rc = -1;
+            break;
+        }
+        if (rc > 0) {
+            LOG_RATE (LOG_ERROR, 1, "ERROR: %d machine requests of this iteration failed\n", rc);
+            failed_polls += rc;
+            rc = 0;
+        }
+        if (sensor->size > 0) {
+            int last = sensor->size - 1;
+            if (store_dir)
+                tstore_append (&store, fleet, sensor->temperature[last], sensor->pressure[last],
+                               sensor->humidity[last], tick_ns);
+            if (retention_hours > 0)
+                history_push (fleet, sensor->temperature[last], sensor->pressure[last],
+                              sensor->humidity[last], tick_ns);
+        }
+        rc = monitor_fleet (fleet);
+        if (rc < 0) {
+            LOG (LOG_ERROR, "ERROR: operations on the fleet failed\n");
+            break;
+        }
+        if (__atomic_exchange_n (&cache_dirty, 0, __ATOMIC_ACQ_REL)) {
+            mcache_save (fleet, cache_path);
+            count_machines (fleet);
+        }
+
+        /* Period boundaries passed by the site time, O(1) per tick */
+        int short_over = 0, long_over = 0;
+        for (twtimer_t *t = twheel_advance (&periods, site_ns); t; t = t->next) {
+            short_over |= (t == &short_timer);
+            long_over |= (t == &long_timer);
         }
 
         /* Short update */
-        if (short_period_over (tm, prev_tm)) {
-            compute_short_period_averages (machines, sensor, pshort_hist, prev_tm, tm);    
-            prev_tm = tm;
-            print_phist_data (pshort_hist->head);
+        if (short_over) {
+            int64_t start = metrics_now ();
+            compute_short_period_averages (fleet, sensor, pshort_hist, short_start, site_ns);    
+            metrics_since (MH_SHORT, start);
+            short_start = site_ns;
+            twheel_add (&periods, &short_timer, short_start + short_ns);
+            print_phist_data (pshort_hist);
+            poller_print_stats (&poller);
+            if (parse_workers > 0)
+                pipe_print_stats (&pipeline);
+            if (poll_max > 1)
+                psched_print (&psched);
+            alerts_print (&alerts);
+            if (retention_hours > 0)
+                print_history (fleet, tick_ns);
+            if (metrics_path)
+                metrics_save (metrics_path);
         }
 
 
         /* Long update */
 #if 1
-        if (tm.tm_hour == next_timestop) {
-            p_endtime = tm;
-            p_endtime.tm_min = 0;
-            p_endtime.tm_sec = 0;
-            compute_long_period_averages (pshort_hist, &plong_hist[index], prev_short_head, p_starttime, p_endtime);
-            update_operations_summary (&plong_hist[index], &summary[index]);
-            prev_short_head = &(pshort_hist->head->prev);
+        if (long_over) {
+            int64_t long_end = long_timer.deadline;
+            hring_t *lhist = &plong_hist[index];
+            if (hring_since (pshort_hist, short_mark) > 0) {
+                /* The oldest record leaves the summary before it is overwritten */
+                if (lhist->size == lhist->cap)
+                    evict_operations_summary (&summary[index], hring_get (lhist, lhist->size - 1));
+                int64_t start = metrics_now ();
+                compute_long_period_averages (pshort_hist, lhist, &short_mark, long_start, long_end);
+                metrics_since (MH_LONG, start);
+                update_operations_summary (&summary[index], hring_get (lhist, 0));
+                print_operations_summary (&summary[index], 1);
+            }
+            if (retention_hours > 0)
+                ghist_save (&history, hist_path);
             index += 1;
             if (index >= wsize)
                 index = 0; 
             next_timestop = timestops[index];
-            p_starttime = p_endtime;
-            break;
+            long_start = long_end;
+            twheel_add (&periods, &long_timer, site_hour_after (long_end, next_timestop));
         }
 #endif
 
-#if 0 
-        /* Code for testing purpuses only */
-        timenow = epochtime();
-        if (timenow - starttime >= 300) {
-            p_endtime = tm;
-            p_endtime.tm_hour = next_timestop;
-            p_endtime.tm_min = 0;
-            p_endtime.tm_sec = 0;
-            compute_long_period_averages (pshort_hist, &plong_hist[0], prev_short_head, p_starttime, p_endtime);
-            print_phist_data (plong_hist[0].head);
-            update_operations_summary (&plong_hist[0], &summary[0]);
-            print_operations_summary (summary, 1);
-            index += 1;
-            if (index >= wsize)
-                index = 0;
-            next_timestop = timestops[index];
-            starttime = timenow;
-            p_starttime = p_endtime; 
-        }
-#endif
  
-        /* sleep for frequency seconds */
-        usleep (frequency * 1000000);
+        /* Let the query server see this tick */
+        if (query_path)
+            query_publish (&query, tick_stats.ticks + 1, fleet, pshort_hist, plong_hist, summary);
 
-        if (run_mins == 0)
-            timenow = 0;
-        else
-            timenow = epochtime ();
+        /* the ticker waits for the next deadline */
+        metrics_record (MH_TICK, tstats_record (&tick_stats, &tick_start, ndue + 1));
+        if (ticks_to_run > 0 && tick_stats.ticks >= ticks_to_run)
+            break;
    } 
 
-    rc = 0;
-    return 0;
+    poller_print_stats (&poller);
+    tstats_print (&tick_stats);
+    LOG (LOG_INFO, "Failed machine polls: %ld\n", failed_polls);
+    ticker_print (&ticker);
+    ticker_free (&ticker);
+    if (poll_max > 1) {
+        psched_print (&psched);
+        psched_free (&psched);
+    }
+    free (due);
+    free (dreqs);
+    free (reqs);
+
+    return rc;
 }
 
 /*******************************************************
@@ -942,32 +1002,160 @@ int main (int argc, char *argv[])
 {
     int i = 0;
     int run_mins = 0;
-    machine_t machines[243];
+    fleet_t fleet;
     sensor_t sensor;
 
-    /* Retrieve how long we want to monitor */
-    if (argc > 1) {
-        run_mins = strtol (argv[1], NULL, 10);
+    /* Retrieve the options and how long we want to monitor */
+    int opt;
+    while ((opt = getopt (argc, argv, "c:2jC:w:k:u:n:f:T:D:R:H:Q:P:U:A:a:y:L:M:")) != -1) {
+        switch (opt) {
+        case 'c':
+            max_inflight = strtol (optarg, NULL, 10);
+            break;
+        case '2':
+            http2_cleartext = 1;
+            break;
+        case 'j':
+            parse_mode = PARSE_JSONC;
+            break;
+        case 'C':
+            cache_path = optarg;
+            break;
+        case 'w':
+            seconds_history = strtod (optarg, NULL);
+            break;
+        case 'k':
+            kernels_name = optarg;
+            break;
+        case 'u':
+            api_base_url = optarg;
+            break;
+        case 'n':
+            ticks_to_run = strtol (optarg, NULL, 10);
+            break;
+        case 'f':
+            frequency = strtod (optarg, NULL);
+            break;
+        case 'T':
+            types_path = optarg;
+            break;
+        case 'D':
+            store_dir = optarg;
+            break;
+        case 'R':
+            retention_hours = strtod (optarg, NULL);
+            break;
+        case 'H':
+            hist_path = optarg;
+            break;
+        case 'Q':
+            query_path = optarg;
+            break;
+        case 'P':
+            parse_workers = strtol (optarg, NULL, 10);
+            break;
+        case 'U':
+            update_workers = strtol (optarg, NULL, 10);
+            break;
+        case 'A':
+            poll_max = strtol (optarg, NULL, 10);
+            break;
+        case 'a':
+            if (nalert_sinks == ALERT_MAX_SINKS) {
+                printf ("Error: at most %d alert sinks\n", ALERT_MAX_SINKS);
+                return -1;
+            }
+            alert_sinks[nalert_sinks++] = optarg;
+            break;
+        case 'y':
+            alert_cooldown = strtod (optarg, NULL);
+            break;
+        case 'M':
+            metrics_path = optarg;
+            break;
+        case 'L':
+            logger_level = logger_parse_level (optarg);
+            if (logger_level < 0) {
+                printf ("Error: log level must be error, warn, info or debug\n");
+                return -1;
+            }
+            break;
+        default:
+            printf ("Usage: %s [-c max-inflight] [-2] [-j] [-C cache-file] [-w window-seconds] [-k scalar|sse2|avx2]\n"
+                    "          [-u api-base-url] [-n ticks] [-f frequency-seconds] [-T types-file] [-D sample-dir]\n"
+                    "          [-R retention-hours] [-H history-file] [-Q query-socket]\n"
+                    "          [-P parse-workers] [-U update-workers] [-A max-poll-ticks]\n"
+                    "          [-a stdout|file:path|socket:path|webhook:url]... [-y alert-cooldown-seconds]\n"
+                    "          [-L error|warn|info|debug] [-M metrics-file] <minutes-to-run>\n", argv[0]);
+            return -1;
+        }
+    }
+    if (frequency <= 0) {
+        printf ("Error: frequency must be positive\n");
+        return -1;
+    }
+    if (parse_workers < 0 || update_workers < 1) {
+        printf ("Error: need at least one update worker\n");
+        return -1;
+    }
+    asprintf (&machine_list_url, "%s/machines", api_base_url);
+    asprintf (&env_sensor_url, "%s/env-sensor", api_base_url);
+    asprintf (&machine_detail_base_url, "%s/machine/", api_base_url);
+    if (optind < argc) {
+        run_mins = strtol (argv[optind], NULL, 10);
     }
     printf ("Monitoring set for %d minutes (0 = indefinite)\n", run_mins);
 
+    /* Pick the aggregation kernels */
+    int rc = kernels_init (kernels_name);
+    if (rc < 0) {
+        printf ("Error: Kernels '%s' unknown or not supported on this CPU (scalar, sse2, avx2)\n", kernels_name);
+        return rc;
+    }
+    printf ("Aggregation kernels: %s\n", kern.name);
+
+    /* Load the machine types */
+    rc = treg_load (&registry, types_path);
+    if (rc < 0) {
+        printf ("Error: Could not load the machine types\n");
+        return rc;
+    }
+    num_machines = (int *) calloc (registry.ntypes, sizeof (int));
+
+    rc = tstats_init (&tick_stats, 4096);
+    if (rc < 0)
+        return rc;
+
+    /* Create the connection pool */
+    rc = poller_init (&poller, max_inflight, http2_cleartext);
+    if (rc < 0) {
+        printf ("Error: Could not create the connection pool\n");
+        return rc;
+    }
+
     /* Intialize machine data */
-    int rc = machines_init (machines, &sensor);
+    struct timespec init_start, init_end;
+    clock_gettime (CLOCK_MONOTONIC, &init_start);
+    rc = machines_init (&fleet, &sensor);
     if (rc < 0) {
         printf ("Error: Machine initialization failed\n");
         return rc;
     }
+    clock_gettime (CLOCK_MONOTONIC, &init_end);
+    printf ("Time to first tick: %.3f s\n", (init_end.tv_sec - init_start.tv_sec) + (init_end.tv_nsec - init_start.tv_nsec) / 1e9);
 
-    /* Create structs */
-    mmdat_t *pshort_hist = (mmdat_t*) malloc (sizeof (mmdat_t));
-    pshort_hist->head = NULL;
-    pshort_hist->last = NULL;
-    pshort_hist->size = 0;
+    /* Create structs: all history is allocated here, once */
+    hring_t pshort_hist;
+    rc = hring_init (&pshort_hist, STORAGE_SHORT, registry.ntypes);
     int wsize = 24 / PERIOD_LONG;
-    mmdat_t *plong_hist = (mmdat_t *) malloc (sizeof (mmdat_t) * wsize);
-    plong_hist->head = NULL;
-    plong_hist->last = NULL;
-    plong_hist->size = 0;
+    hring_t *plong_hist = (hring_t *) malloc (sizeof (hring_t) * wsize);
+    for (i = 0; i < wsize && rc == 0; i++) {
+        rc = hring_init (&plong_hist[i], STORAGE_LONG, registry.ntypes);
+    }
+    if (rc < 0) {
+        printf ("Error: Could not allocate the period history\n");
+        return rc;
+    }
 
     int timeseed = 21;
     int *timestops = (int *)malloc (sizeof (int) * wsize);
@@ -977,32 +1165,96 @@ int main (int argc, char *argv[])
             timestops[i] = timestops[i] - 24;
     }
 
-    opsum_t *summary = (opsum_t *) malloc (sizeof (opsum_t) * wsize);
-    memset (summary, 0, sizeof (opsum_t) * wsize);
-    for (i = 0; i < wsize; i++) {
-        summary->avg_current = (double *)malloc (sizeof (double) * CMP_END);
-        summary->avg_ratio = (double *)malloc (sizeof (double) * CMP_END);
-        summary->variance = (double *)malloc (sizeof (double) * CMP_END);
+    opsum_t *summary = (opsum_t *) calloc (wsize, sizeof (opsum_t));
+    for (i = 0; i < wsize && rc == 0; i++) {
+        rc = init_operations_summary (&summary[i]);
     }
+    if (rc < 0)
+        return rc;
 
 
+    /* Open the sample store, one segment per hour of ticks */
+    if (store_dir) {
+        rc = tstore_open (&store, store_dir, (uint64_t) ceil (3600 / frequency), frequency);
+        if (rc < 0)
+            return rc;
+    }
+
+    /* Load the compressed history */
+    if (retention_hours > 0) {
+        rc = history_init (&fleet);
+        if (rc < 0)
+            return rc;
+    }
+
+    /* Log asynchronously from here on */
+    rc = logger_init (stdout);
+    if (rc < 0)
+        return rc;
+
+    /* Start the alert delivery */
+    rc = alerts_init (&alerts, fleet.size, alert_sinks, nalert_sinks, alert_cooldown);
+    if (rc < 0)
+        return rc;
+
+    /* Start the pipeline stages */
+    if (parse_workers > 0) {
+        rc = pipe_init (&pipeline, parse_workers, update_workers, sizeof (mread_t),
+                        machine_parse_stage, machine_update_stage, &fleet);
+        if (rc < 0)
+            return rc;
+    }
+
+    /* Serve the state while monitoring */
+    if (query_path) {
+        rc = query_start (&query, query_path, &fleet, &registry, timestops, wsize);
+        if (rc < 0)
+            return rc;
+    }
+
     /* Start monitor */
-    rc = monitor (machines, &sensor, run_mins, pshort_hist, plong_hist, timestops, wsize, summary);
+    rc = monitor (&fleet, &sensor, run_mins, &pshort_hist, plong_hist, timestops, wsize, summary);
+    logger_flush ();
     if (rc < 0) {
         printf ("Failure while monitoring machines\n");
         return -1;
     }
 
+    if (query_path)
+        query_stop (&query);
+    if (parse_workers > 0) {
+        pipe_print_stats (&pipeline);
+        pipe_destroy (&pipeline);
+    }
+    alerts_print (&alerts);
+    alerts_close (&alerts);
+    logger_close ();
+    if (metrics_path)
+        metrics_save (metrics_path);
+
     /* free memory */
-    for (i = 0; i < 243; i++)
-        free (machines[i].current_avgwindow);
+    fleet_free (&fleet);
     free (timestops);
-    free (pshort_hist);
-    free (plong_hist);   
-    free (summary->avg_current);
-    free (summary->avg_ratio);
-    free (summary->variance);
+    hring_free (&pshort_hist);
+    for (i = 0; i < wsize; i++) {
+        hring_free (&plong_hist[i]);
+        free_operations_summary (&summary[i]);
+    }
+    free (plong_hist);
     free (summary);
+    free (num_machines);
+    treg_free (&registry);
+    if (store_dir)
+        tstore_close (&store);
+    if (retention_hours > 0) {
+        ghist_save (&history, hist_path);
+        ghist_free (&history);
+    }
+    poller_destroy (&poller);
+    tstats_free (&tick_stats);
+    free (machine_list_url);
+    free (env_sensor_url);
+    free (machine_detail_base_url);
 
     /* Exit */
     printf ("Monitoring for stipulated time complete. Exiting...\n");
@@ -1,3 +1,6 @@
+#ifndef MACHINEPARK_H
+#define MACHINEPARK_H
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <stddef.h>
@@ -5,6 +8,7 @@
 #include <assert.h>
 
 #include "json.h"
+#include "moments.h"
 #include <uuid/uuid.h>
 #include <time.h>
 
@@ -16,101 +20,84 @@
 #define STORAGE_SHORT 100
 #define STORAGE_LONG 10
 
-/* Number of componentns */
-#define NUM_TOTAL 243
-#define NUM_DMG_DMC 15
-#define NUM_DMG_DMU 96
-#define NUM_DMG_NTX 36
-#define NUM_DMG_NZX 24
-#define NUM_KASOTEC_A7 24
-#define NUM_KASOTEC_A13 6
-#define NUM_PERNDORFER_WSS 9
-#define NUM_TRUMPF_3000 12
-#define NUM_TRUMPF_7000 18
-#define NUM_DMG_LASTERTEC 3
-
-/* Component types including ALL */
-typedef enum {
-    CMP_ALL,
-    CMP_DMG_DMC, 
-    CMP_DMG_DMU,
-    CMP_DMG_NTX,
-    CMP_DMG_NZX,
-    CMP_KASOTEC_A7,
-    CMP_KASOTEC_A13,
-    CMP_PERNDORFER_WSS,
-    CMP_TRUMPF_3000,
-    CMP_TRUMPF_7000,
-    CMP_DMG_LASTERTEC,
-    CMP_END
-} components_t;
+/* Type id covering the whole fleet; the machine types
+ * themselves come from the type registry
+ */
+#define CMP_ALL 0
 
 typedef struct current_window {
     double      current;
-    int64_t     timestamp;
-} __attribute__((packed)) cw_t;
-
-typedef struct machine {
-    char            uuid[37];               /* uuid with a null character */
-    char            *name;                  /* Name of the machine */
-    components_t    type;                   /* Machine type such as mill, lathe etc */
-    double          current_cur;            /* The current value */
-    double          current_threshold;      /* The current threshold */
-    cw_t            *current_avgwindow;     /* A static yet circular buffer using size and head variables */
-    cw_t            *current_periodwindow;  /* An array for storing energy consumption over a period */
-    int             head;                   /* The current head of current_avgwindow */
-    int             phead;                  /* The head pointer for period window */
-} __attribute__((packed)) machine_t;
+    int64_t     timestamp;              /* Epoch nanoseconds */
+} cw_t;
 
 typedef struct sensor {
     char        timestamp[20];          /* Sensor timestamp */
     double      *pressure;              /* Pressure */
     double      *temperature;           /* Temperature */
     double      *humidity;              /* Humidity */
+    double      *rho;                   /* Air density of every reading, at the period end */
     int         size;                   /* size */
-} __attribute__((packed)) sensor_t;
+} sensor_t;
 
 typedef struct period_history {
-    struct tm   starttime;              /* Timeframe start */
-    struct tm   endtime;                /* Timeframe end */ 
+    int64_t     starttime;              /* Timeframe start, site time ns */
+    int64_t     endtime;                /* Timeframe end, site time ns */
     double      avg_temperature;        /* Average temperature during timeframe */
     double      avg_humidity;           /* Average humidity during timeframe */
     double      avg_pressure;           /* Average pressure during timeframe */
     double      rho;                    /* Air density */
-    double      *avg_current;           /* Average current of different components until CMP_END*/
-    double      *rho_cur_ratio;         /* Ratio of the air density and current - Larger the value, better it is */         
+    double      *avg_current;           /* Average current of every machine type */
+    double      *rho_cur_ratio;         /* Ratio of the air density and current - Larger the value, better it is */
 } phist_t;
 
-typedef struct llist {
-    phist_t         *data;              /* Linked list data */
-    struct llist    *next;              /* Linked list next */
-    struct llist    *prev;              /* Linked list previous */
-} llist_t;
-
-typedef struct master_data {
-    llist_t     *head;                  /* The head element */
-    llist_t     *last;                  /* The last element */
-    int         size;                   /* The size */
-} mmdat_t;
-
 typedef struct operation_summary {
-    double      *avg_current;           /* The average current during the timeslot */
+    double      *avg_current;           /* The average current during the timeslot, per type */
     double      *avg_ratio;             /* Average ratios */
     double      *variance;              /* Variances of ratios*/
-    double      rho_variance;          /* Air density variance */
+    double      rho_variance;           /* Air density variance */
     double      avg_temp;               /* Average temperature */
     double      avg_humd;               /* Average humidity */
     double      avg_pres;               /* Average pressure */
     double      avg_rho;                /* Averasge air density */
+    moments_t   *current_m;             /* Running moments of the currents */
+    moments_t   *ratio_m;               /* Running moments of the ratios */
+    moments_t   rho_m;                  /* Running moments of the air density */
+    moments_t   temp_m;                 /* Running moments of the temperature */
+    moments_t   humd_m;                 /* Running moments of the humidity */
+    moments_t   pres_m;                 /* Running moments of the pressure */
 } opsum_t;
 
+/* Reading of a machine detail response */
+typedef struct machine_reading {
+    int         idx;                    /* Machine, first for the pipeline */
+    double      current;                /* The current value */
+    double      threshold;              /* The current threshold */
+    char        name[128];              /* Name of the machine, empty if absent */
+} mread_t;
+
 /* Helper for CURL */
 typedef struct MemoryStruct {
     char *data;
     size_t size;
+    size_t cap;                         /* Allocated bytes of data */
 } chunk_t;
 
+/* How responses are parsed */
+typedef enum {
+    PARSE_STREAM,                       /* Streaming extraction while receiving */
+    PARSE_JSONC                         /* Buffered, validated json-c DOM */
+} parse_mode_t;
+
+/* Destination of an env-sensor fetch */
+typedef struct sensor_fetch {
+    sensor_t    *sensor;                /* Sensor readings to update */
+    int64_t     *site_ns;               /* Local time at the machine site, see sitetime.h */
+    int         status;                 /* 0 if the last fetch was stored, -1 if not */
+} sfetch_t;
+
 static inline int64_t epochtime ()
 {
     return (int64_t) time (NULL);
 }
+
+#endif
@@ -0,0 +1,117 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mcache.h"
+
+/*******************************************************
+ *                                                     *
+ *                Machine Cache                        *
+ *                                                     *
+ *******************************************************/
+
+/* The cache is a text file with one machine per line:
+ * <uuid> TAB <type> TAB <name>
+ * The type is informational: machines are reclassified from their
+ * name on load, so a changed type registry takes effect at once.
+ */
+
+static int mcache_compare (const void *a, const void *b)
+{
+    return strcmp (((const mcent_t *) a)->uuid, ((const mcent_t *) b)->uuid);
+}
+
+/* mcache_load()
+ * Reads the cache file. A missing file is an empty cache.
+ */
+int mcache_load (mcache_t *cache, const char *path)
+{
+    int cap = 256;
+    char line[512];
+    FILE *fp;
+
+    cache->entries = NULL;
+    cache->size = 0;
+
+    fp = fopen (path, "r");
+    if (fp == NULL)
+        return 0;
+
+    cache->entries = (mcent_t *) malloc (sizeof (mcent_t) * cap);
+    while (fgets (line, sizeof (line), fp)) {
+        char *type = strchr (line, '\t');
+        char *name = type ? strchr (type + 1, '\t') : NULL;
+        if (name == NULL || type - line != 36)
+            continue;
+        name[strcspn (name, "\n")] = '\0';
+
+        if (cache->size == cap) {
+            cap *= 2;
+            cache->entries = (mcent_t *) realloc (cache->entries, sizeof (mcent_t) * cap);
+        }
+        mcent_t *entry = &cache->entries[cache->size++];
+        memcpy (entry->uuid, line, 36);
+        entry->uuid[36] = '\0';
+        entry->name = strdup (name + 1);
+    }
+    fclose (fp);
+
+    qsort (cache->entries, cache->size, sizeof (mcent_t), mcache_compare);
+    return cache->size;
+}
+
+mcent_t *mcache_find (mcache_t *cache, const char *uuid)
+{
+    mcent_t key;
+
+    if (cache->size == 0)
+        return NULL;
+    strncpy (key.uuid, uuid, 36);
+    key.uuid[36] = '\0';
+    return (mcent_t *) bsearch (&key, cache->entries, cache->size, sizeof (mcent_t), mcache_compare);
+}
+
+/* mcache_save()
+ * Writes the classified machines to the cache. The file is
+ * replaced atomically so a crash never leaves half a cache.
+ */
+int mcache_save (fleet_t *fleet, const char *path)
+{
+    int i = 0;
+    char *tmp_path;
+    FILE *fp;
+
+    asprintf (&tmp_path, "%s.tmp", path);
+    fp = fopen (tmp_path, "w");
+    if (fp == NULL) {
+        printf ("ERROR: Could not write machine cache %s\n", tmp_path);
+        free (tmp_path);
+        return -1;
+    }
+    for (i = 0; i < fleet->size; i++) {
+        if (fleet->meta[i].name == NULL)
+            continue;
+        fprintf (fp, "%s\t%d\t%s\n", fleet->meta[i].uuid, fleet->type[i], fleet->meta[i].name);
+    }
+    fclose (fp);
+
+    if (rename (tmp_path, path) < 0) {
+        printf ("ERROR: Could not replace machine cache %s\n", path);
+        free (tmp_path);
+        return -1;
+    }
+    free (tmp_path);
+    return 0;
+}
+
+void mcache_free (mcache_t *cache)
+{
+    int i = 0;
+
+    for (i = 0; i < cache->size; i++)
+        free (cache->entries[i].name);
+    free (cache->entries);
+    cache->entries = NULL;
+    cache->size = 0;
+}
@@ -0,0 +1,25 @@
+#ifndef MCACHE_H
+#define MCACHE_H
+
+#include "fleet.h"
+
+/* Local cache of the uuid -> name mapping, so that a restart
+ * does not have to fetch every machine detail before polling
+ */
+
+typedef struct mcache_entry {
+    char            uuid[37];               /* uuid with a null character */
+    char            *name;                  /* Name of the machine */
+} mcent_t;
+
+typedef struct mcache {
+    mcent_t         *entries;               /* Entries sorted by uuid */
+    int             size;                   /* Number of entries */
+} mcache_t;
+
+int mcache_load (mcache_t *cache, const char *path);
+mcent_t *mcache_find (mcache_t *cache, const char *uuid);
+int mcache_save (fleet_t *fleet, const char *path);
+void mcache_free (mcache_t *cache);
+
+#endif
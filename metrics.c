@@ -0,0 +1,127 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "metrics.h"
+
+metrics_t metrics;
+
+/* Metric and label of every histogram; the first of a metric carries its help */
+static const struct {
+    const char  *metric;
+    const char  *label;
+    const char  *value;
+    const char  *help;
+} hist_names[MH_COUNT] = {
+    [MH_FETCH_LIST]     = {"machinepark_fetch_seconds", "endpoint", "machines", "Time to fetch a response, by endpoint"},
+    [MH_FETCH_MACHINE]  = {"machinepark_fetch_seconds", "endpoint", "machine", NULL},
+    [MH_FETCH_SENSOR]   = {"machinepark_fetch_seconds", "endpoint", "env-sensor", NULL},
+    [MH_PARSE]          = {"machinepark_stage_seconds", "stage", "parse", "Time spent in a processing stage"},
+    [MH_UPDATE]         = {"machinepark_stage_seconds", "stage", "update", NULL},
+    [MH_SHORT]          = {"machinepark_stage_seconds", "stage", "short_period", NULL},
+    [MH_LONG]           = {"machinepark_stage_seconds", "stage", "long_period", NULL},
+    [MH_TICK]           = {"machinepark_stage_seconds", "stage", "tick", NULL},
+};
+
+static const struct {
+    const char  *metric;
+    const char  *help;
+} counter_names[MC_COUNT] = {
+    [MC_FETCHED_BYTES]  = {"machinepark_fetched_bytes_total", "Response bytes received"},
+    [MC_FETCH_FAILURES] = {"machinepark_fetch_failures_total", "Transfers that failed"},
+    [MC_PARSE_FAILURES] = {"machinepark_parse_failures_total", "Responses without the expected fields"},
+    [MC_ALERTS_RAISED]  = {"machinepark_alerts_raised_total", "Alerts raised"},
+    [MC_ALERTS_CLEARED] = {"machinepark_alerts_cleared_total", "Alerts cleared"},
+    [MC_ALLOCATIONS]    = {"machinepark_buffer_allocations_total", "Response buffer allocations"},
+};
+
+static const double quantiles[] = {0.5, 0.9, 0.99, 0.999};
+
+/* Middle of a bucket, ns */
+static double mhist_value (int bucket)
+{
+    if (bucket < MHIST_SUB)
+        return bucket;
+    int exp = bucket / MHIST_SUB + MHIST_SUB_BITS - 1;
+    uint64_t width = (uint64_t) 1 << (exp - MHIST_SUB_BITS);
+    uint64_t low = ((uint64_t) (MHIST_SUB + bucket % MHIST_SUB)) << (exp - MHIST_SUB_BITS);
+    return low + width / 2.0;
+}
+
+/* mhist_quantile()
+ * Value below which a share q of the recorded values fall, ns.
+ * Recording may go on meanwhile, the result is then approximate.
+ */
+double mhist_quantile (const mhist_t *h, double q)
+{
+    int i = 0;
+    uint64_t count = __atomic_load_n (&h->count, __ATOMIC_RELAXED);
+    uint64_t rank = (uint64_t) (q * count + 0.5);
+    uint64_t seen = 0;
+
+    if (count == 0)
+        return 0;
+    if (rank < 1)
+        rank = 1;
+    for (i = 0; i < MHIST_BUCKETS; i++) {
+        seen += __atomic_load_n (&h->buckets[i], __ATOMIC_RELAXED);
+        if (seen >= rank)
+            return mhist_value (i);
+    }
+    return mhist_value (MHIST_BUCKETS - 1);
+}
+
+/* metrics_write()
+ * All metrics in the Prometheus text format
+ */
+void metrics_write (FILE *fp)
+{
+    int i = 0, j = 0;
+
+    for (i = 0; i < MH_COUNT; i++) {
+        const mhist_t *h = &metrics.hists[i];
+        if (hist_names[i].help) {
+            fprintf (fp, "# HELP %s %s\n", hist_names[i].metric, hist_names[i].help);
+            fprintf (fp, "# TYPE %s summary\n", hist_names[i].metric);
+        }
+        for (j = 0; j < (int) (sizeof (quantiles) / sizeof (quantiles[0])); j++) {
+            fprintf (fp, "%s{%s=\"%s\",quantile=\"%g\"} %.9f\n", hist_names[i].metric, hist_names[i].label,
+                     hist_names[i].value, quantiles[j], mhist_quantile (h, quantiles[j]) / 1e9);
+        }
+        fprintf (fp, "%s_sum{%s=\"%s\"} %.9f\n", hist_names[i].metric, hist_names[i].label, hist_names[i].value,
+                 __atomic_load_n (&h->sum, __ATOMIC_RELAXED) / 1e9);
+        fprintf (fp, "%s_count{%s=\"%s\"} %llu\n", hist_names[i].metric, hist_names[i].label, hist_names[i].value,
+                 (unsigned long long) __atomic_load_n (&h->count, __ATOMIC_RELAXED));
+    }
+    for (i = 0; i < MC_COUNT; i++) {
+        fprintf (fp, "# HELP %s %s\n", counter_names[i].metric, counter_names[i].help);
+        fprintf (fp, "# TYPE %s counter\n", counter_names[i].metric);
+        fprintf (fp, "%s %llu\n", counter_names[i].metric,
+                 (unsigned long long) __atomic_load_n (&metrics.counters[i], __ATOMIC_RELAXED));
+    }
+}
+
+/* metrics_save()
+ * Replaces the file at path with the current metrics, e.g. for the
+ * textfile collector of the Prometheus node exporter
+ */
+int metrics_save (const char *path)
+{
+    int rc = -1;
+    char tmp[4096];
+
+    snprintf (tmp, sizeof (tmp), "%s.tmp", path);
+    FILE *fp = fopen (tmp, "w");
+    if (fp == NULL) {
+        printf ("ERROR: Could not write the metrics to %s\n", tmp);
+        return rc;
+    }
+    metrics_write (fp);
+    if (fclose (fp) != 0 || rename (tmp, path) != 0) {
+        printf ("ERROR: Could not write the metrics to %s\n", path);
+        return rc;
+    }
+
+    rc = 0;
+    return rc;
+}
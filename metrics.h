@@ -0,0 +1,100 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+
+/* Built in instrumentation.
+ * Every stage and endpoint has a log-linear latency histogram in the
+ * manner of HDR histograms: 16 sub-buckets per power of two of
+ * nanoseconds, so a recorded value is off by at most 1/16. Recording
+ * is a bucket index computed from the leading zeros and three relaxed
+ * atomic adds, no locks, so any thread may record at any time and the
+ * metrics stay enabled. metrics_write() renders the histograms as
+ * Prometheus summaries and the counters as Prometheus counters.
+ */
+
+#define MHIST_SUB_BITS 4
+#define MHIST_SUB (1 << MHIST_SUB_BITS)
+#define MHIST_BUCKETS ((64 - MHIST_SUB_BITS + 1) * MHIST_SUB)
+
+typedef enum {
+    MH_FETCH_LIST,                      /* GET /machines */
+    MH_FETCH_MACHINE,                   /* GET /machine/<uuid> */
+    MH_FETCH_SENSOR,                    /* GET /env-sensor */
+    MH_PARSE,                           /* Reading extracted from a response */
+    MH_UPDATE,                          /* Alert check and window updates of a reading */
+    MH_SHORT,                           /* compute_short_period_averages() */
+    MH_LONG,                            /* compute_long_period_averages() */
+    MH_TICK,                            /* A whole tick */
+    MH_COUNT
+} mhist_id_t;
+
+typedef enum {
+    MC_FETCHED_BYTES,                   /* Response bytes received */
+    MC_FETCH_FAILURES,                  /* Transfers that failed or returned an error status */
+    MC_PARSE_FAILURES,                  /* Responses without the expected fields */
+    MC_ALERTS_RAISED,                   /* Alerts queued for delivery */
+    MC_ALERTS_CLEARED,                  /* Cleared events queued for delivery */
+    MC_ALLOCATIONS,                     /* Response buffer (re)allocations */
+    MC_COUNT
+} mcounter_id_t;
+
+typedef struct metrics_hist {
+    uint64_t        count;              /* Values recorded */
+    uint64_t        sum;                /* Sum of the values, ns */
+    uint64_t        buckets[MHIST_BUCKETS];
+} mhist_t;
+
+typedef struct metrics {
+    mhist_t         hists[MH_COUNT];
+    uint64_t        counters[MC_COUNT];
+} metrics_t;
+
+extern metrics_t metrics;
+
+/* Monotonic clock to measure a stage with, ns */
+static inline int64_t metrics_now (void)
+{
+    struct timespec t;
+    clock_gettime (CLOCK_MONOTONIC, &t);
+    return (int64_t) t.tv_sec * 1000000000 + t.tv_nsec;
+}
+
+/* Bucket of a value: exact below MHIST_SUB, then MHIST_SUB buckets
+ * for every power of two
+ */
+static inline int mhist_bucket (uint64_t v)
+{
+    if (v < MHIST_SUB)
+        return (int) v;
+    int exp = 63 - __builtin_clzll (v);
+    return (exp - MHIST_SUB_BITS + 1) * MHIST_SUB + (int) ((v >> (exp - MHIST_SUB_BITS)) & (MHIST_SUB - 1));
+}
+
+static inline void metrics_record (int hist, int64_t ns)
+{
+    mhist_t *h = &metrics.hists[hist];
+    uint64_t v = (ns > 0) ? (uint64_t) ns : 0;
+    __atomic_fetch_add (&h->buckets[mhist_bucket (v)], 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add (&h->sum, v, __ATOMIC_RELAXED);
+    __atomic_fetch_add (&h->count, 1, __ATOMIC_RELAXED);
+}
+
+/* Records the time since start, a metrics_now() */
+static inline void metrics_since (int hist, int64_t start)
+{
+    metrics_record (hist, metrics_now () - start);
+}
+
+static inline void metrics_add (int counter, uint64_t n)
+{
+    __atomic_fetch_add (&metrics.counters[counter], n, __ATOMIC_RELAXED);
+}
+
+double mhist_quantile (const mhist_t *h, double q);
+void metrics_write (FILE *fp);
+int metrics_save (const char *path);
+
+#endif
@@ -0,0 +1,60 @@
+#ifndef MOMENTS_H
+#define MOMENTS_H
+
+/* Streaming mean and variance of a sequence (Welford).
+ * Moments can be updated one value at a time, in both directions,
+ * and partial results merge exactly (Chan et al.).
+ */
+typedef struct moments {
+    double      n;                      /* Number of values */
+    double      mean;                   /* Mean of the values */
+    double      m2;                     /* Sum of squared differences from the mean */
+} moments_t;
+
+static inline void moments_add (moments_t *m, double x)
+{
+    double delta = x - m->mean;
+    m->n += 1;
+    m->mean += delta / m->n;
+    m->m2 += delta * (x - m->mean);
+}
+
+/* Take back a value that was added before
+ */
+static inline void moments_remove (moments_t *m, double x)
+{
+    if (m->n <= 1) {
+        m->n = 0;
+        m->mean = 0;
+        m->m2 = 0;
+        return;
+    }
+    double delta = x - m->mean;
+    m->n -= 1;
+    m->mean -= delta / m->n;
+    m->m2 -= delta * (x - m->mean);
+    if (m->m2 < 0)
+        m->m2 = 0;
+}
+
+/* Fold the moments of b into a
+ */
+static inline void moments_merge (moments_t *a, const moments_t *b)
+{
+    double n = a->n + b->n;
+    double delta = b->mean - a->mean;
+
+    if (b->n == 0)
+        return;
+    a->m2 += b->m2 + delta * delta * (a->n * b->n / n);
+    a->mean += delta * (b->n / n);
+    a->n = n;
+}
+
+/* Population variance */
+static inline double moments_var (const moments_t *m)
+{
+    return (m->n > 0) ? m->m2 / m->n : 0;
+}
+
+#endif
@@ -0,0 +1,259 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "pipeline.h"
+#include "logger.h"
+
+/*******************************************************
+ *                                                     *
+ *                     Stages                          *
+ *                                                     *
+ *******************************************************/
+
+static int64_t pipe_now ()
+{
+    struct timespec ts;
+    clock_gettime (CLOCK_MONOTONIC, &ts);
+    return (int64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/* Claims a slot of an MPSC queue, waiting while it is full */
+static void *pipe_claim (pipe_t *pipe, mpsc_t *q)
+{
+    qbackoff_t backoff = {0};
+    void *slot;
+
+    while ((slot = mpsc_claim (q)) == NULL) {
+        if (backoff.round == 0)
+            __atomic_fetch_add (&pipe->stalls, 1, __ATOMIC_RELAXED);
+        qbackoff_wait (&backoff);
+    }
+    return slot;
+}
+
+/* Hands a result to the shard owning its machine */
+static void pipe_forward (pipe_t *pipe, const void *result)
+{
+    int idx = *(const int *) result;
+    mpsc_t *q = &pipe->update_q[idx % pipe->nupdate];
+    void *slot = pipe_claim (pipe, q);
+    memcpy (slot, result, pipe->result_size);
+    mpsc_publish (q, slot);
+}
+
+static void *pipe_parse_thread (void *arg)
+{
+    pworker_t *w = (pworker_t *) arg;
+    pipe_t *pipe = w->pipe;
+    spsc_t *q = &pipe->parse_q[w->id];
+    qbackoff_t backoff = {0};
+    char result[pipe->result_size];
+
+    for (;;) {
+        pbody_t *msg = (pbody_t *) spsc_peek (q);
+        if (msg == NULL) {
+            if (__atomic_load_n (&pipe->stop, __ATOMIC_ACQUIRE))
+                break;
+            qbackoff_wait (&backoff);
+            continue;
+        }
+        qbackoff_reset (&backoff);
+
+        int64_t start = pipe_now ();
+        chunk_t chunk = {msg->body, msg->len, msg->len + 1};
+        memset (result, 0, pipe->result_size);
+        *(int *) result = msg->idx;
+        if (pipe->parse (pipe->ctx, msg->idx, &chunk, result) == 0) {
+            pipe_forward (pipe, result);
+        } else {
+            __atomic_fetch_add (&pipe->errors, 1, __ATOMIC_RELAXED);
+            __atomic_fetch_add (&pipe->completed, 1, __ATOMIC_RELEASE);
+        }
+        spsc_release (q);
+        w->busy_ns += pipe_now () - start;
+    }
+    return NULL;
+}
+
+static void *pipe_update_thread (void *arg)
+{
+    pworker_t *w = (pworker_t *) arg;
+    pipe_t *pipe = w->pipe;
+    mpsc_t *q = &pipe->update_q[w->id];
+    qbackoff_t backoff = {0};
+
+    for (;;) {
+        void *result = mpsc_peek (q);
+        if (result == NULL) {
+            if (__atomic_load_n (&pipe->stop, __ATOMIC_ACQUIRE))
+                break;
+            qbackoff_wait (&backoff);
+            continue;
+        }
+        qbackoff_reset (&backoff);
+
+        int64_t start = pipe_now ();
+        if (pipe->update (pipe->ctx, pipe, w->id, result) < 0)
+            __atomic_fetch_add (&pipe->errors, 1, __ATOMIC_RELAXED);
+        mpsc_release (q);
+        /* Everything the update wrote is visible to pipe_wait() */
+        __atomic_fetch_add (&pipe->completed, 1, __ATOMIC_RELEASE);
+        w->busy_ns += pipe_now () - start;
+    }
+    return NULL;
+}
+
+/*******************************************************
+ *                                                     *
+ *                     Pipeline                        *
+ *                                                     *
+ *******************************************************/
+
+/* pipe_init()
+ * Starts nparse parse workers and nupdate update shards. Results are
+ * result_size bytes starting with the int index of their machine.
+ */
+int pipe_init (pipe_t *pipe, int nparse, int nupdate, size_t result_size,
+               pipe_parse_t parse, pipe_update_t update, void *ctx)
+{
+    int i = 0;
+    int rc = 0;
+
+    memset (pipe, 0, sizeof (pipe_t));
+    pipe->nparse = nparse;
+    pipe->nupdate = nupdate;
+    pipe->result_size = result_size;
+    pipe->parse = parse;
+    pipe->update = update;
+    pipe->ctx = ctx;
+    pipe->parse_q = (spsc_t *) calloc (nparse, sizeof (spsc_t));
+    pipe->update_q = (mpsc_t *) calloc (nupdate, sizeof (mpsc_t));
+    pipe->parsers = (pworker_t *) calloc (nparse, sizeof (pworker_t));
+    pipe->updaters = (pworker_t *) calloc (nupdate, sizeof (pworker_t));
+    if (!pipe->parse_q || !pipe->update_q || !pipe->parsers || !pipe->updaters) {
+        printf ("ERROR: Could not allocate the pipeline\n");
+        return -1;
+    }
+
+    for (i = 0; i < nparse && rc == 0; i++)
+        rc = spsc_init (&pipe->parse_q[i], PIPE_DEPTH, sizeof (pbody_t));
+    for (i = 0; i < nupdate && rc == 0; i++)
+        rc = mpsc_init (&pipe->update_q[i], PIPE_DEPTH, result_size);
+    if (rc < 0)
+        return rc;
+
+    for (i = 0; i < nparse && rc == 0; i++) {
+        pipe->parsers[i].pipe = pipe;
+        pipe->parsers[i].id = i;
+        rc = pthread_create (&pipe->parsers[i].thread, NULL, pipe_parse_thread, &pipe->parsers[i]) ? -1 : 0;
+    }
+    for (i = 0; i < nupdate && rc == 0; i++) {
+        pipe->updaters[i].pipe = pipe;
+        pipe->updaters[i].id = i;
+        rc = pthread_create (&pipe->updaters[i].thread, NULL, pipe_update_thread, &pipe->updaters[i]) ? -1 : 0;
+    }
+    if (rc < 0)
+        printf ("ERROR: Could not start the pipeline threads\n");
+    return rc;
+}
+
+/* pipe_submit()
+ * Called by the polling thread for every response body. Bodies that
+ * do not fit a queue slot are parsed right here.
+ */
+void pipe_submit (pipe_t *pipe, int idx, chunk_t *chunk)
+{
+    pipe->submitted++;
+
+    if (chunk->size >= PIPE_BODY) {
+        char result[pipe->result_size];
+        memset (result, 0, pipe->result_size);
+        *(int *) result = idx;
+        pipe->inline_parses++;
+        if (pipe->parse (pipe->ctx, idx, chunk, result) == 0) {
+            pipe_forward (pipe, result);
+        } else {
+            __atomic_fetch_add (&pipe->errors, 1, __ATOMIC_RELAXED);
+            __atomic_fetch_add (&pipe->completed, 1, __ATOMIC_RELEASE);
+        }
+        return;
+    }
+
+    spsc_t *q = &pipe->parse_q[pipe->next];
+    pipe->next = (pipe->next + 1 == pipe->nparse) ? 0 : pipe->next + 1;
+
+    qbackoff_t backoff = {0};
+    pbody_t *msg;
+    while ((msg = (pbody_t *) spsc_claim (q)) == NULL) {
+        if (backoff.round == 0)
+            __atomic_fetch_add (&pipe->stalls, 1, __ATOMIC_RELAXED);
+        qbackoff_wait (&backoff);
+    }
+    msg->idx = idx;
+    msg->len = chunk->size;
+    memcpy (msg->body, chunk->data, chunk->size);
+    msg->body[chunk->size] = '\0';
+    spsc_publish (q);
+}
+
+/* pipe_wait()
+ * Waits until every submitted body went through the update stage and
+ * returns the number of bodies that failed since the last wait
+ */
+int pipe_wait (pipe_t *pipe)
+{
+    qbackoff_t backoff = {0};
+
+    while (__atomic_load_n (&pipe->completed, __ATOMIC_ACQUIRE) < pipe->submitted)
+        qbackoff_wait (&backoff);
+    return (int) __atomic_exchange_n (&pipe->errors, 0, __ATOMIC_RELAXED);
+}
+
+static void pipe_print_queue (const char *name, int id, qstats_t *stats, uint64_t mask)
+{
+    LOG (LOG_INFO, "  %s %d: %lld items, depth avg %.1f max %lld of %llu, %lld full\n", name, id,
+            (long long) stats->pushes, stats->samples ? (double) stats->depth_sum / stats->samples : 0,
+            (long long) stats->depth_max, (unsigned long long) mask + 1, (long long) stats->full);
+}
+
+void pipe_print_stats (pipe_t *pipe)
+{
+    int i = 0;
+
+    LOG (LOG_INFO, "Pipeline: %lld bodies, %lld parsed inline, %lld producer stalls\n",
+            (long long) pipe->submitted, (long long) pipe->inline_parses, (long long) pipe->stalls);
+    for (i = 0; i < pipe->nparse; i++) {
+        pipe_print_queue ("parse", i, &pipe->parse_q[i].stats, pipe->parse_q[i].mask);
+        LOG (LOG_INFO, "    busy %.1f ms\n", pipe->parsers[i].busy_ns / 1e6);
+    }
+    for (i = 0; i < pipe->nupdate; i++) {
+        pipe_print_queue ("update", i, &pipe->update_q[i].stats, pipe->update_q[i].mask);
+        LOG (LOG_INFO, "    busy %.1f ms\n", pipe->updaters[i].busy_ns / 1e6);
+    }
+}
+
+/* pipe_destroy()
+ * Drains the queues and stops the threads
+ */
+void pipe_destroy (pipe_t *pipe)
+{
+    int i = 0;
+
+    pipe_wait (pipe);
+    __atomic_store_n (&pipe->stop, 1, __ATOMIC_RELEASE);
+    for (i = 0; i < pipe->nparse; i++)
+        pthread_join (pipe->parsers[i].thread, NULL);
+    for (i = 0; i < pipe->nupdate; i++)
+        pthread_join (pipe->updaters[i].thread, NULL);
+
+    for (i = 0; i < pipe->nparse; i++)
+        spsc_free (&pipe->parse_q[i]);
+    for (i = 0; i < pipe->nupdate; i++)
+        mpsc_free (&pipe->update_q[i]);
+    free (pipe->parse_q);
+    free (pipe->update_q);
+    free (pipe->parsers);
+    free (pipe->updaters);
+}
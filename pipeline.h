@@ -0,0 +1,69 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <stdint.h>
+#include <pthread.h>
+#include "machinepark.h"
+#include "queue.h"
+
+/* Staged processing of the responses of a tick.
+ * The polling thread does the network I/O and submits every response
+ * body to a parse worker over its own SPSC queue. Parse workers turn
+ * bodies into fixed-size results and pass them to the update shard
+ * owning the machine (idx % nupdate) over an MPSC queue, and update
+ * shards apply results to the state. A full queue stalls its producer,
+ * so a slow stage throttles the ones before it.
+ */
+
+#define PIPE_BODY 1024                      /* Largest body carried through a queue */
+#define PIPE_DEPTH 1024                     /* Elements per queue */
+
+typedef struct pipeline pipe_t;
+
+/* Parses the body of request idx into result, 0 or -1 */
+typedef int (*pipe_parse_t) (void *ctx, int idx, chunk_t *chunk, void *result);
+/* Applies a result on update shard shard, 0 or -1 */
+typedef int (*pipe_update_t) (void *ctx, pipe_t *pipe, int shard, void *result);
+
+/* Element of a parse queue */
+typedef struct pipe_body {
+    int             idx;                    /* Request index */
+    int             len;                    /* Bytes of body */
+    char            body[PIPE_BODY];        /* Response body, null terminated */
+} pbody_t;
+
+typedef struct pipe_worker {
+    pipe_t          *pipe;                  /* Owning pipeline */
+    int             id;                     /* Worker or shard number */
+    pthread_t       thread;                 /* Its thread */
+    int64_t         busy_ns;                /* Time spent working */
+} pworker_t;
+
+struct pipeline {
+    int             nparse;                 /* Parse workers */
+    int             nupdate;                /* Update shards */
+    spsc_t          *parse_q;               /* Bodies, one queue per parse worker */
+    mpsc_t          *update_q;              /* Results, one queue per update shard */
+    pworker_t       *parsers;               /* Parse workers */
+    pworker_t       *updaters;              /* Update shards */
+    size_t          result_size;            /* Bytes of a result, idx first */
+    pipe_parse_t    parse;                  /* Parse stage */
+    pipe_update_t   update;                 /* Update stage */
+    void            *ctx;                   /* Handed to the stages */
+    int             next;                   /* Round robin parse worker */
+    int64_t         submitted;              /* Bodies submitted, polling thread only */
+    int64_t         inline_parses;          /* Bodies too large for a queue, parsed on submit */
+    int64_t         stalls;                 /* Waits of any producer on a full queue */
+    int64_t         completed;              /* Results applied, atomic */
+    int64_t         errors;                 /* Failed parses and updates, atomic */
+    int             stop;                   /* Threads exit when set */
+};
+
+int pipe_init (pipe_t *pipe, int nparse, int nupdate, size_t result_size,
+               pipe_parse_t parse, pipe_update_t update, void *ctx);
+void pipe_submit (pipe_t *pipe, int idx, chunk_t *chunk);
+int pipe_wait (pipe_t *pipe);
+void pipe_print_stats (pipe_t *pipe);
+void pipe_destroy (pipe_t *pipe);
+
+#endif
@@ -0,0 +1,334 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "poller.h"
+#include "logger.h"
+#include "metrics.h"
+
+/*******************************************************
+ *                                                     *
+ *                Response Buffers                     *
+ *                                                     *
+ *******************************************************/
+
+static long chunk_grows = 0; /* Number of buffer (re)allocations */
+
+/* Response buffers live as long as their slot. They grow
+ * geometrically and are reset rather than freed, so once they
+ * have seen the largest payload no more allocations happen.
+ */
+void chunk_init (chunk_t *chunk)
+{
+    chunk->data = NULL;
+    chunk->size = 0;
+    chunk->cap = 0;
+}
+
+/* Make room for size bytes plus the terminating null character
+ */
+int chunk_reserve (chunk_t *chunk, size_t size)
+{
+    size_t cap = chunk->cap ? chunk->cap : 512;
+
+    if (size + 1 <= chunk->cap)
+        return 0;
+    while (cap < size + 1)
+        cap *= 2;
+
+    char *data = realloc (chunk->data, cap);
+    if (data == NULL) {
+        /* out of memory! */
+        printf ("not enough memory (realloc returned NULL)\n");
+        return -1;
+    }
+    chunk->data = data;
+    chunk->cap = cap;
+    chunk_grows++;
+    metrics_add (MC_ALLOCATIONS, 1);
+    return 1;
+}
+
+void chunk_free (chunk_t *chunk)
+{
+    free (chunk->data);
+    chunk_init (chunk);
+}
+
+/* Write callback function for curl 
+ */
+static size_t curl_write (void *contents, size_t size, size_t nmemb, void *userp)
+{
+    size_t realsize = size * nmemb;
+    chunk_t *mem = (chunk_t *)userp;
+
+    if (chunk_reserve (mem, mem->size + realsize) < 0)
+        return 0;
+
+    memcpy(&(mem->data[mem->size]), contents, realsize);
+    mem->size += realsize;
+    mem->data[mem->size] = 0;
+
+    return realsize;
+}
+
+/*******************************************************
+ *                                                     *
+ *                Concurrent Polling                   *
+ *                                                     *
+ *******************************************************/
+
+/* Write callback of the pooled handles. Streamed requests feed
+ * their extractor directly and never touch the response buffer.
+ */
+static size_t slot_write (void *contents, size_t size, size_t nmemb, void *userp)
+{
+    size_t realsize = size * nmemb;
+    pslot_t *slot = (pslot_t *)userp;
+
+    if (slot->req->spec == NULL)
+        return curl_write (contents, size, nmemb, &slot->chunk);
+
+    jscan_feed (&slot->scan, contents, realsize);
+    slot->chunk.size += realsize;
+    return realsize;
+}
+
+/* Options shared by every handle of the pool. Handles keep their
+ * connections alive and ask for HTTP/2 so that the whole fleet is
+ * multiplexed over a few connections where the server supports it.
+ */
+static void poller_setup_handle (poller_t *poller, CURL *curl, long http_version)
+{
+    curl_easy_setopt (curl, CURLOPT_SHARE, poller->share);
+    curl_easy_setopt (curl, CURLOPT_WRITEFUNCTION, curl_write);
+    curl_easy_setopt (curl, CURLOPT_HTTP_VERSION, http_version);
+    curl_easy_setopt (curl, CURLOPT_PIPEWAIT, 1L);
+    curl_easy_setopt (curl, CURLOPT_TCP_KEEPALIVE, 1L);
+    curl_easy_setopt (curl, CURLOPT_DNS_CACHE_TIMEOUT, 300L);
+}
+
+/* poller_init()
+ * Creates the multi handle, the share object and a pool of
+ * max_inflight long-lived transfer slots. With http2_cleartext
+ * plain http urls are spoken as HTTP/2 with prior knowledge,
+ * otherwise HTTP/2 is only negotiated over TLS.
+ */
+int poller_init (poller_t *poller, int max_inflight, int http2_cleartext)
+{
+    int rc = -1;
+    int i = 0;
+    long http_version = http2_cleartext ? CURL_HTTP_VERSION_2_PRIOR_KNOWLEDGE : CURL_HTTP_VERSION_2TLS;
+
+    if (max_inflight < 1)
+        max_inflight = 1;
+
+    memset (poller, 0, sizeof (poller_t));
+    poller->multi = curl_multi_init ();
+    poller->share = curl_share_init ();
+    if (poller->multi == NULL || poller->share == NULL) {
+        printf ("ERROR: Could not create curl multi/share handles\n");
+        poller_destroy (poller);
+        return rc;
+    }
+    curl_share_setopt (poller->share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+    curl_share_setopt (poller->share, CURLSHOPT_SHARE, CURL_LOCK_DATA_CONNECT);
+    curl_share_setopt (poller->share, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+    curl_multi_setopt (poller->multi, CURLMOPT_PIPELINING, CURLPIPE_MULTIPLEX);
+    curl_multi_setopt (poller->multi, CURLMOPT_MAX_TOTAL_CONNECTIONS, (long) max_inflight);
+
+    poller->slots = (pslot_t *) calloc (max_inflight, sizeof (pslot_t));
+    poller->free_slots = (int *) malloc (sizeof (int) * max_inflight);
+    for (i = 0; i < max_inflight; i++) {
+        pslot_t *slot = &poller->slots[i];
+        slot->curl = curl_easy_init ();
+        poller_setup_handle (poller, slot->curl, http_version);
+        curl_easy_setopt (slot->curl, CURLOPT_WRITEFUNCTION, slot_write);
+        curl_easy_setopt (slot->curl, CURLOPT_WRITEDATA, slot);
+        curl_easy_setopt (slot->curl, CURLOPT_PRIVATE, slot);
+        poller->free_slots[i] = max_inflight - 1 - i;
+    }
+    poller->nfree = max_inflight;
+    poller->max_inflight = max_inflight;
+
+    poller->easy = curl_easy_init ();
+    poller_setup_handle (poller, poller->easy, http_version);
+
+    rc = 0;
+    return rc;
+}
+
+/* Account a finished transfer as a new or a reused connection,
+ * and its time in the histogram of its endpoint
+ */
+static void poller_count (poller_t *poller, CURL *curl, int hist)
+{
+    long connects = 0;
+    long version = 0;
+    curl_off_t total_us = 0;
+    curl_off_t bytes = 0;
+
+    curl_easy_getinfo (curl, CURLINFO_TOTAL_TIME_T, &total_us);
+    curl_easy_getinfo (curl, CURLINFO_SIZE_DOWNLOAD_T, &bytes);
+    metrics_record (hist, (int64_t) total_us * 1000);
+    metrics_add (MC_FETCHED_BYTES, bytes);
+    curl_easy_getinfo (curl, CURLINFO_NUM_CONNECTS, &connects);
+    curl_easy_getinfo (curl, CURLINFO_HTTP_VERSION, &version);
+    poller->stats.transfers++;
+    if (connects > 0)
+        poller->stats.conn_new++;
+    else
+        poller->stats.conn_reused++;
+    if (version == CURL_HTTP_VERSION_2_0)
+        poller->stats.http2++;
+}
+
+/* Start the transfer of req in a free slot
+ */
+static int poller_start (poller_t *poller, preq_t *req)
+{
+    int idx = poller->free_slots[--poller->nfree];
+    pslot_t *slot = &poller->slots[idx];
+
+    slot->req = req;
+    slot->chunk.size = 0;
+    if (req->spec)
+        jscan_init (&slot->scan, req->spec);
+    else
+        chunk_reserve (&slot->chunk, poller->body_hint);
+    curl_easy_setopt (slot->curl, CURLOPT_URL, req->url);
+    curl_multi_add_handle (poller->multi, slot->curl);
+
+    return 0;
+}
+
+/* Hand a finished transfer to its callback and release the slot
+ */
+static int poller_finish (poller_t *poller, pslot_t *slot, CURLcode res)
+{
+    int rc = -1;
+    int status = -1;
+    long http_code = 0;
+
+    if (res != CURLE_OK) {
+        LOG_RATE (LOG_ERROR, 10, "ERROR: fetching %s failed: %s\n", slot->req->url, curl_easy_strerror (res));
+        metrics_add (MC_FETCH_FAILURES, 1);
+    } else {
+        poller_count (poller, slot->curl, slot->req->hist);
+        if (slot->req->spec == NULL && slot->chunk.size > poller->body_hint)
+            poller->body_hint = slot->chunk.size;
+        curl_easy_getinfo (slot->curl, CURLINFO_RESPONSE_CODE, &http_code);
+        if (http_code >= 400 || slot->chunk.size == 0) {
+            LOG_RATE (LOG_ERROR, 10, "ERROR: fetching %s failed with http status %ld\n", slot->req->url, http_code);
+            metrics_add (MC_FETCH_FAILURES, 1);
+        } else if (slot->req->spec && jscan_finish (&slot->scan) < 0) {
+            LOG_RATE (LOG_ERROR, 10, "ERROR: malformed response from %s\n", slot->req->url);
+            poller->stats.parse_errors++;
+            metrics_add (MC_PARSE_FAILURES, 1);
+        } else {
+            status = 0;
+        }
+    }
+
+    rc = slot->req->done (slot->req->ctx, slot->req->idx, &slot->chunk, slot->req->spec ? &slot->scan : NULL, status);
+
+    /* the handle and its connection stay in the pool */
+    curl_multi_remove_handle (poller->multi, slot->curl);
+    slot->req = NULL;
+    poller->free_slots[poller->nfree++] = slot - poller->slots;
+
+    if (status < 0)
+        rc = -1;
+    return rc;
+}
+
+/* poller_run()
+ * Fetches all nreqs requests keeping up to max_inflight of them
+ * in flight at once. Every response is handed to its callback as
+ * soon as it is complete. Returns the number of requests that failed
+ * either in transfer or in their callback.
+ */
+int poller_run (poller_t *poller, preq_t *reqs, int nreqs)
+{
+    int next = 0;
+    int running = 0;
+    int failed = 0;
+    int inflight = 0;
+    int queued = 0;
+    CURLMsg *msg;
+
+    while (next < nreqs || inflight > 0) {
+        /* top up the transfers in flight */
+        while (next < nreqs && poller->nfree > 0) {
+            poller_start (poller, &reqs[next++]);
+        }
+
+        curl_multi_perform (poller->multi, &running);
+
+        while ((msg = curl_multi_info_read (poller->multi, &queued))) {
+            if (msg->msg != CURLMSG_DONE)
+                continue;
+            pslot_t *slot = NULL;
+            curl_easy_getinfo (msg->easy_handle, CURLINFO_PRIVATE, (char **) &slot);
+            if (poller_finish (poller, slot, msg->data.result) < 0)
+                failed++;
+        }
+        inflight = poller->max_inflight - poller->nfree;
+
+        /* wait for network activity unless a slot can be refilled */
+        if (running > 0 && !(next < nreqs && poller->nfree > 0))
+            curl_multi_poll (poller->multi, NULL, 0, 1000, NULL);
+    }
+
+    return failed;
+}
+
+/* poller_fetch()
+ * Blocking fetch of a single url into chunk, over the same
+ * connection and DNS caches as the pooled transfers; its time goes
+ * into histogram hist
+ */
+int poller_fetch (poller_t *poller, const char *url, chunk_t *chunk, int hist)
+{
+    CURLcode res;
+
+    curl_easy_setopt (poller->easy, CURLOPT_URL, url);
+    curl_easy_setopt (poller->easy, CURLOPT_WRITEDATA, chunk);
+    res = curl_easy_perform (poller->easy);
+    if (res != CURLE_OK) {
+        printf ("curl_easy_perform() failed: %s\n", curl_easy_strerror (res));
+        metrics_add (MC_FETCH_FAILURES, 1);
+        return -1;
+    }
+    poller_count (poller, poller->easy, hist);
+    return 0;
+}
+
+void poller_print_stats (poller_t *poller)
+{
+    pstats_t *stats = &poller->stats;
+    stats->buf_grows = chunk_grows;
+    LOG (LOG_INFO, "Connections: %ld transfers, %ld new connects, %ld reused, %ld over HTTP/2, %ld buffer allocations\n",
+            stats->transfers, stats->conn_new, stats->conn_reused, stats->http2, stats->buf_grows);
+}
+
+void poller_destroy (poller_t *poller)
+{
+    int i = 0;
+
+    for (i = 0; poller->slots && i < poller->max_inflight; i++) {
+        if (poller->slots[i].req)
+            curl_multi_remove_handle (poller->multi, poller->slots[i].curl);
+        curl_easy_cleanup (poller->slots[i].curl);
+        chunk_free (&poller->slots[i].chunk);
+    }
+    if (poller->easy)
+        curl_easy_cleanup (poller->easy);
+    if (poller->multi)
+        curl_multi_cleanup (poller->multi);
+    if (poller->share)
+        curl_share_cleanup (poller->share);
+    free (poller->slots);
+    free (poller->free_slots);
+    memset (poller, 0, sizeof (poller_t));
+}
@@ -0,0 +1,62 @@
+#ifndef POLLER_H
+#define POLLER_H
+
+#include <curl/curl.h>
+#include "machinepark.h"
+#include "jscan.h"
+
+/* Completion callback of a request.
+ * status is 0 or -1 if the transfer failed. Requests with a spec
+ * get the extracted fields in scan and chunk only counts the bytes,
+ * others get the buffered response body in chunk and a NULL scan.
+ */
+typedef int (*poll_done_t) (void *ctx, int idx, chunk_t *chunk, jscan_t *scan, int status);
+
+typedef struct poll_request {
+    const char      *url;                   /* Url to fetch */
+    poll_done_t     done;                   /* Called once the response is complete */
+    void            *ctx;                   /* Opaque pointer handed to done */
+    int             idx;                    /* Index handed to done, e.g. a machine */
+    const jspec_t   *spec;                  /* Fields to extract while receiving, or NULL */
+    int             hist;                   /* Latency histogram of the endpoint, mhist_id_t */
+} preq_t;
+
+typedef struct poll_slot {
+    CURL            *curl;                  /* Long-lived easy handle of this slot */
+    chunk_t         chunk;                  /* Response body */
+    jscan_t         scan;                   /* Streaming extractor of the transfer */
+    preq_t          *req;                   /* The request being served, NULL if idle */
+} pslot_t;
+
+typedef struct poll_stats {
+    long            transfers;              /* Completed transfers */
+    long            conn_new;               /* Transfers that had to open a connection */
+    long            conn_reused;            /* Transfers served over a pooled connection */
+    long            http2;                  /* Transfers that ran over HTTP/2 */
+    long            buf_grows;              /* Response buffer (re)allocations */
+    long            parse_errors;           /* Malformed streamed responses */
+} pstats_t;
+
+typedef struct poller {
+    CURLM           *multi;                 /* The curl multi handle */
+    CURLSH          *share;                 /* DNS, connection and TLS session caches */
+    CURL            *easy;                  /* Handle for blocking single fetches */
+    pslot_t         *slots;                 /* max_inflight transfer slots */
+    int             *free_slots;            /* Stack of unused slot indices */
+    int             nfree;                  /* Size of free_slots */
+    int             max_inflight;           /* Max concurrent transfers */
+    size_t          body_hint;              /* Largest response body seen so far */
+    pstats_t        stats;                  /* Connection reuse counters */
+} poller_t;
+
+void chunk_init (chunk_t *chunk);
+int chunk_reserve (chunk_t *chunk, size_t size);
+void chunk_free (chunk_t *chunk);
+
+int poller_init (poller_t *poller, int max_inflight, int http2_cleartext);
+int poller_run (poller_t *poller, preq_t *reqs, int nreqs);
+int poller_fetch (poller_t *poller, const char *url, chunk_t *chunk, int hist);
+void poller_print_stats (poller_t *poller);
+void poller_destroy (poller_t *poller);
+
+#endif
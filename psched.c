@@ -0,0 +1,120 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "psched.h"
+#include "logger.h"
+
+/*******************************************************
+ *                                                     *
+ *                  Poll Scheduler                     *
+ *                                                     *
+ *******************************************************/
+
+/* Puts machine i into the slot of tick s->tick + ticks */
+static void psched_insert (psched_t *s, int i, int ticks)
+{
+    int slot = (int) ((s->tick + ticks) & (s->nslots - 1));
+    s->next[i] = s->slots[slot];
+    s->slots[slot] = i;
+}
+
+/* psched_init()
+ * All machines start due at the first tick with an interval of 1
+ */
+int psched_init (psched_t *s, int size, int max_interval)
+{
+    int i = 0;
+
+    memset (s, 0, sizeof (psched_t));
+    s->size = size;
+    s->max_interval = (max_interval < 1) ? 1 : max_interval;
+    s->nslots = 2;
+    while (s->nslots <= s->max_interval)
+        s->nslots <<= 1;
+    s->slots = (int32_t *) malloc (sizeof (int32_t) * s->nslots);
+    s->next = (int32_t *) malloc (sizeof (int32_t) * (size > 0 ? size : 1));
+    s->interval = (int32_t *) malloc (sizeof (int32_t) * (size > 0 ? size : 1));
+    s->last = (double *) calloc (size > 0 ? size : 1, sizeof (double));
+    if (!s->slots || !s->next || !s->interval || !s->last) {
+        printf ("ERROR: Could not allocate the poll scheduler\n");
+        return -1;
+    }
+    for (i = 0; i < s->nslots; i++)
+        s->slots[i] = -1;
+    for (i = size - 1; i >= 0; i--) {
+        s->interval[i] = 1;
+        s->last[i] = NAN;
+        psched_insert (s, i, 0);
+    }
+    return 0;
+}
+
+/* psched_due()
+ * Moves the machines due at the current tick into due and advances
+ * to the next tick. Every one of them must be
+ * handed back through psched_polled() before the next call.
+ */
+int psched_due (psched_t *s, int32_t *due)
+{
+    int n = 0;
+    int slot = (int) (s->tick & (s->nslots - 1));
+    int32_t i = s->slots[slot];
+
+    while (i >= 0) {
+        due[n++] = i;
+        i = s->next[i];
+    }
+    s->slots[slot] = -1;
+    s->tick++;
+    s->polls += n;
+    s->fixed_polls += s->size;
+    return n;
+}
+
+/* psched_polled()
+ * Schedules the next poll of machine i from its reading; a machine
+ * that did not report is retried at the next tick
+ */
+void psched_polled (psched_t *s, int i, int fresh, double current, double threshold)
+{
+    int interval = s->interval[i];
+
+    if (!fresh) {
+        interval = 1;
+    } else if (threshold > 0 && current >= PSCHED_NEAR * threshold) {
+        interval = 1;
+    } else if (isnan (s->last[i]) || fabs (current - s->last[i]) > PSCHED_VOLATILE * fabs (threshold)) {
+        interval = (interval > 1) ? interval / 2 : 1;
+    } else {
+        interval = (interval * 2 < s->max_interval) ? interval * 2 : s->max_interval;
+    }
+    if (fresh)
+        s->last[i] = current;
+    s->interval[i] = interval;
+
+    /* the wheel already advanced past the tick of this poll */
+    psched_insert (s, i, interval - 1);
+}
+
+void psched_print (psched_t *s)
+{
+    int i = 0;
+    int every_tick = 0;
+
+    for (i = 0; i < s->size; i++)
+        every_tick += (s->interval[i] == 1);
+    LOG (LOG_INFO, "Adaptive polling: %lld of %lld polls (%.1f%% saved), %d of %d machines polled every tick\n",
+            (long long) s->polls, (long long) s->fixed_polls,
+            s->fixed_polls ? 100.0 * (s->fixed_polls - s->polls) / s->fixed_polls : 0, every_tick, s->size);
+}
+
+void psched_free (psched_t *s)
+{
+    free (s->slots);
+    free (s->next);
+    free (s->interval);
+    free (s->last);
+    memset (s, 0, sizeof (psched_t));
+}
@@ -0,0 +1,37 @@
+#ifndef PSCHED_H
+#define PSCHED_H
+
+#include <stdint.h>
+
+/* Adaptive per-machine poll scheduling.
+ * Every machine is polled every interval ticks, 1 <= interval <=
+ * max_interval. Machines near or above their threshold are polled
+ * every tick, machines whose current moves are polled more often and
+ * steady ones back off exponentially. Due machines come from a timer
+ * wheel of intrusive lists, one slot per tick, so scheduling and
+ * collecting the due machines cost O(1) per machine.
+ */
+
+#define PSCHED_NEAR 0.8                 /* current / threshold from which a machine is polled every tick */
+#define PSCHED_VOLATILE 0.05            /* Change per poll, relative to the threshold, that counts as volatile */
+
+typedef struct poll_sched {
+    int             size;               /* Number of machines */
+    int             max_interval;       /* Longest interval in ticks */
+    int             nslots;             /* Slots of the wheel, a power of two > max_interval */
+    int32_t         *slots;             /* First machine due in every slot, -1 if none */
+    int32_t         *next;              /* Next machine in the same slot */
+    int32_t         *interval;          /* Current interval of every machine */
+    double          *last;              /* Reading at the last poll of every machine */
+    int64_t         tick;               /* Current tick */
+    int64_t         polls;              /* Polls scheduled */
+    int64_t         fixed_polls;        /* Polls a fixed rate would have made */
+} psched_t;
+
+int psched_init (psched_t *s, int size, int max_interval);
+int psched_due (psched_t *s, int32_t *due);
+void psched_polled (psched_t *s, int i, int fresh, double current, double threshold);
+void psched_print (psched_t *s);
+void psched_free (psched_t *s);
+
+#endif
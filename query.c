@@ -0,0 +1,496 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <errno.h>
+#include <poll.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "query.h"
+#include "metrics.h"
+#include "sitetime.h"
+
+/*******************************************************
+ *                                                     *
+ *                    Snapshots                        *
+ *                                                     *
+ *******************************************************/
+
+static int snapshot_init (snapshot_t *snap, int nmachines, int ntypes, int wsize)
+{
+    int i = 0;
+    int rc = 0;
+
+    memset (snap, 0, sizeof (snapshot_t));
+    snap->nmachines = nmachines;
+    snap->current = (double *) calloc (nmachines, sizeof (double));
+    snap->threshold = (double *) calloc (nmachines, sizeof (double));
+    snap->average = (double *) calloc (nmachines, sizeof (double));
+    snap->type = (int32_t *) calloc (nmachines, sizeof (int32_t));
+    snap->plong = (hring_t *) calloc (wsize, sizeof (hring_t));
+    snap->summary = (opsum_t *) calloc (wsize, sizeof (opsum_t));
+    if (!snap->current || !snap->threshold || !snap->average || !snap->type || !snap->plong || !snap->summary)
+        rc = -1;
+    if (rc == 0)
+        rc = hring_init (&snap->pshort, STORAGE_SHORT, ntypes);
+    for (i = 0; i < wsize && rc == 0; i++) {
+        rc = hring_init (&snap->plong[i], STORAGE_LONG, ntypes);
+        snap->summary[i].avg_current = (double *) calloc (3 * ntypes, sizeof (double));
+        if (snap->summary[i].avg_current == NULL)
+            rc = -1;
+        else {
+            snap->summary[i].avg_ratio = snap->summary[i].avg_current + ntypes;
+            snap->summary[i].variance = snap->summary[i].avg_current + 2 * ntypes;
+        }
+    }
+    if (rc < 0)
+        printf ("ERROR: Could not allocate query snapshot\n");
+    return rc;
+}
+
+static void snapshot_free (snapshot_t *snap, int wsize)
+{
+    int i = 0;
+
+    free (snap->current);
+    free (snap->threshold);
+    free (snap->average);
+    free (snap->type);
+    hring_free (&snap->pshort);
+    for (i = 0; snap->plong && i < wsize; i++) {
+        hring_free (&snap->plong[i]);
+        free (snap->summary[i].avg_current);
+    }
+    free (snap->plong);
+    free (snap->summary);
+}
+
+/* Summary without its moments */
+static void opsum_copy (opsum_t *dst, const opsum_t *src, int ntypes)
+{
+    memcpy (dst->avg_current, src->avg_current, sizeof (double) * ntypes);
+    memcpy (dst->avg_ratio, src->avg_ratio, sizeof (double) * ntypes);
+    memcpy (dst->variance, src->variance, sizeof (double) * ntypes);
+    dst->rho_variance = src->rho_variance;
+    dst->avg_temp = src->avg_temp;
+    dst->avg_humd = src->avg_humd;
+    dst->avg_pres = src->avg_pres;
+    dst->avg_rho = src->avg_rho;
+}
+
+static void snapshot_copy (snapshot_t *dst, const snapshot_t *src, int wsize)
+{
+    int i = 0;
+    int n = src->nmachines;
+
+    dst->tick = src->tick;
+    dst->timestamp = src->timestamp;
+    memcpy (dst->current, src->current, sizeof (double) * n);
+    memcpy (dst->threshold, src->threshold, sizeof (double) * n);
+    memcpy (dst->average, src->average, sizeof (double) * n);
+    memcpy (dst->type, src->type, sizeof (int32_t) * n);
+    hring_copy (&dst->pshort, &src->pshort);
+    for (i = 0; i < wsize; i++) {
+        hring_copy (&dst->plong[i], &src->plong[i]);
+        opsum_copy (&dst->summary[i], &src->summary[i], src->pshort.ntypes);
+    }
+}
+
+/* query_publish()
+ * Makes the state after a tick visible to the server thread.
+ * Never waits: a reader copying at the same time retries.
+ */
+void query_publish (qserver_t *q, int64_t tick, fleet_t *fleet, hring_t *pshort, hring_t *plong, opsum_t *summary)
+{
+    int i = 0;
+    snapshot_t *pub = &q->pub;
+    uint64_t seq = q->seq;
+
+    __atomic_store_n (&q->seq, seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence (__ATOMIC_RELEASE);
+
+    pub->tick = tick;
+    pub->timestamp = epochtime ();
+    memcpy (pub->current, fleet->current, sizeof (double) * pub->nmachines);
+    memcpy (pub->threshold, fleet->threshold, sizeof (double) * pub->nmachines);
+    memcpy (pub->type, fleet->type, sizeof (int32_t) * pub->nmachines);
+    for (i = 0; i < pub->nmachines; i++)
+        pub->average[i] = rwin_avg (&fleet->avgwin[i], NAN);
+    hring_copy (&pub->pshort, pshort);
+    for (i = 0; i < q->wsize; i++) {
+        hring_copy (&pub->plong[i], &plong[i]);
+        opsum_copy (&pub->summary[i], &summary[i], pshort->ntypes);
+    }
+
+    __atomic_store_n (&q->seq, seq + 2, __ATOMIC_RELEASE);
+}
+
+/* Copies the published snapshot into the view of the server thread */
+static void query_read (qserver_t *q)
+{
+    uint64_t before, after;
+
+    for (;;) {
+        before = __atomic_load_n (&q->seq, __ATOMIC_ACQUIRE);
+        if (before & 1) {
+            sched_yield ();
+            continue;
+        }
+        snapshot_copy (&q->view, &q->pub, q->wsize);
+        __atomic_thread_fence (__ATOMIC_ACQUIRE);
+        after = __atomic_load_n (&q->seq, __ATOMIC_RELAXED);
+        if (before == after)
+            break;
+    }
+}
+
+/*******************************************************
+ *                                                     *
+ *                      JSON                           *
+ *                                                     *
+ *******************************************************/
+
+static void json_num (FILE *fp, double v)
+{
+    if (isfinite (v))
+        fprintf (fp, "%.6f", v);
+    else
+        fputs ("null", fp);
+}
+
+/* Quoted string with ", \ and control characters escaped: type
+ * names come from the user's types file
+ */
+static void json_str (FILE *fp, const char *str)
+{
+    const unsigned char *c = (const unsigned char *) str;
+
+    fputc ('"', fp);
+    for (; *c; c++) {
+        if (*c == '"' || *c == '\\')
+            fprintf (fp, "\\%c", *c);
+        else if (*c < 0x20)
+            fprintf (fp, "\\u%04x", *c);
+        else
+            fputc (*c, fp);
+    }
+    fputc ('"', fp);
+}
+
+static void json_time (FILE *fp, int64_t ns)
+{
+    char buf[SITE_TIME_LEN + 1];
+    fprintf (fp, "\"%s\"", site_time_format (ns, buf));
+}
+
+static void json_record (qserver_t *q, FILE *fp, const phist_t *rec)
+{
+    int i = 0;
+
+    fputs ("{\"start\":", fp);
+    json_time (fp, rec->starttime);
+    fputs (",\"end\":", fp);
+    json_time (fp, rec->endtime);
+    fputs (",\"temperature\":", fp);
+    json_num (fp, rec->avg_temperature);
+    fputs (",\"pressure\":", fp);
+    json_num (fp, rec->avg_pressure);
+    fputs (",\"humidity\":", fp);
+    json_num (fp, rec->avg_humidity);
+    fputs (",\"rho\":", fp);
+    json_num (fp, rec->rho);
+    fputs (",\"types\":[", fp);
+    for (i = 0; i < q->registry->ntypes; i++) {
+        fputs (i ? ",{\"type\":" : "{\"type\":", fp);
+        json_str (fp, q->registry->names[i]);
+        fputs (",\"current\":", fp);
+        json_num (fp, rec->avg_current[i]);
+        fputs (",\"ratio\":", fp);
+        json_num (fp, rec->rho_cur_ratio[i]);
+        fputs ("}", fp);
+    }
+    fputs ("]}", fp);
+}
+
+/* Records of a ring, newest first */
+static void json_ring (qserver_t *q, FILE *fp, hring_t *ring)
+{
+    int i = 0;
+
+    fputs ("[", fp);
+    for (i = 0; i < ring->size; i++) {
+        if (i)
+            fputs (",", fp);
+        json_record (q, fp, hring_get (ring, i));
+    }
+    fputs ("]", fp);
+}
+
+static void json_status (qserver_t *q, FILE *fp)
+{
+    int i = 0;
+
+    fprintf (fp, "{\"tick\":%lld,\"timestamp\":%lld,\"machines\":%d,\"served\":%lld,\"types\":[",
+             (long long) q->view.tick, (long long) q->view.timestamp, q->view.nmachines, (long long) q->served);
+    for (i = 0; i < q->registry->ntypes; i++) {
+        if (i)
+            fputs (",", fp);
+        json_str (fp, q->registry->names[i]);
+    }
+    fputs ("],\"endpoints\":[\"/machines\",\"/short\",\"/long\",\"/summary\",\"/metrics\"]}", fp);
+}
+
+static void json_machines (qserver_t *q, FILE *fp)
+{
+    int i = 0;
+    snapshot_t *v = &q->view;
+
+    fprintf (fp, "{\"tick\":%lld,\"machines\":[", (long long) v->tick);
+    for (i = 0; i < v->nmachines; i++) {
+        fputs (i ? ",{\"uuid\":" : "{\"uuid\":", fp);
+        json_str (fp, q->fleet->meta[i].uuid);
+        fputs (",\"type\":", fp);
+        json_str (fp, q->registry->names[v->type[i]]);
+        fputs (",\"current\":", fp);
+        json_num (fp, v->current[i]);
+        fputs (",\"threshold\":", fp);
+        json_num (fp, v->threshold[i]);
+        fputs (",\"average\":", fp);
+        json_num (fp, v->average[i]);
+        fputs ("}", fp);
+    }
+    fputs ("]}", fp);
+}
+
+static void json_long (qserver_t *q, FILE *fp)
+{
+    int i = 0;
+
+    fprintf (fp, "{\"tick\":%lld,\"periods\":[", (long long) q->view.tick);
+    for (i = 0; i < q->wsize; i++) {
+        fprintf (fp, "%s{\"hour\":%d,\"records\":", i ? "," : "", q->timestops[i]);
+        json_ring (q, fp, &q->view.plong[i]);
+        fputs ("}", fp);
+    }
+    fputs ("]}", fp);
+}
+
+static void json_summary (qserver_t *q, FILE *fp)
+{
+    int i = 0, j = 0;
+
+    fprintf (fp, "{\"tick\":%lld,\"summaries\":[", (long long) q->view.tick);
+    for (i = 0; i < q->wsize; i++) {
+        opsum_t *s = &q->view.summary[i];
+        fprintf (fp, "%s{\"hour\":%d,\"periods\":%d,\"temperature\":", i ? "," : "", q->timestops[i], q->view.plong[i].size);
+        json_num (fp, s->avg_temp);
+        fputs (",\"pressure\":", fp);
+        json_num (fp, s->avg_pres);
+        fputs (",\"humidity\":", fp);
+        json_num (fp, s->avg_humd);
+        fputs (",\"rho\":", fp);
+        json_num (fp, s->avg_rho);
+        fputs (",\"rho_variance\":", fp);
+        json_num (fp, s->rho_variance);
+        fputs (",\"types\":[", fp);
+        for (j = 0; j < q->registry->ntypes; j++) {
+            fputs (j ? ",{\"type\":" : "{\"type\":", fp);
+            json_str (fp, q->registry->names[j]);
+            fputs (",\"current\":", fp);
+            json_num (fp, s->avg_current[j]);
+            fputs (",\"ratio\":", fp);
+            json_num (fp, s->avg_ratio[j]);
+            fputs (",\"variance\":", fp);
+            json_num (fp, s->variance[j]);
+            fputs ("}", fp);
+        }
+        fputs ("]}", fp);
+    }
+    fputs ("]}", fp);
+}
+
+/*******************************************************
+ *                                                     *
+ *                     Server                          *
+ *                                                     *
+ *******************************************************/
+
+static void send_all (int fd, const char *data, size_t len)
+{
+    while (len > 0) {
+        ssize_t n = send (fd, data, len, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return;
+        data += n;
+        len -= n;
+    }
+}
+
+/* Answers one request on fd: GET <path> */
+static void query_serve (qserver_t *q, int fd)
+{
+    char req[2048];
+    size_t len = 0;
+    char *body = NULL;
+    size_t body_len = 0;
+    char head[160];
+    const char *status = "200 OK";
+    const char *type = "application/json";
+
+    struct timeval tv = {1, 0};
+    setsockopt (fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof (tv));
+    while (len < sizeof (req) - 1) {
+        ssize_t n = recv (fd, req + len, sizeof (req) - 1 - len, 0);
+        if (n <= 0)
+            break;
+        len += n;
+        req[len] = '\0';
+        if (strstr (req, "\r\n\r\n") || strstr (req, "\n\n"))
+            break;
+    }
+    req[len] = '\0';
+
+    /* Path without the query string */
+    char *path = NULL;
+    if (strncmp (req, "GET ", 4) == 0) {
+        path = req + 4;
+        path[strcspn (path, " ?\r\n")] = '\0';
+    }
+
+    FILE *fp = open_memstream (&body, &body_len);
+    if (fp == NULL)
+        return;
+    query_read (q);
+    if (path == NULL) {
+        status = "405 Method Not Allowed";
+        fputs ("{\"error\":\"only GET is supported\"}", fp);
+    } else if (strcmp (path, "/") == 0) {
+        json_status (q, fp);
+    } else if (strcmp (path, "/machines") == 0) {
+        json_machines (q, fp);
+    } else if (strcmp (path, "/short") == 0) {
+        fprintf (fp, "{\"tick\":%lld,\"records\":", (long long) q->view.tick);
+        json_ring (q, fp, &q->view.pshort);
+        fputs ("}", fp);
+    } else if (strcmp (path, "/long") == 0) {
+        json_long (q, fp);
+    } else if (strcmp (path, "/summary") == 0) {
+        json_summary (q, fp);
+    } else if (strcmp (path, "/metrics") == 0) {
+        type = "text/plain; version=0.0.4";
+        metrics_write (fp);
+    } else {
+        status = "404 Not Found";
+        fputs ("{\"error\":\"unknown path\"}", fp);
+    }
+    fputs ("\n", fp);
+    fclose (fp);
+
+    int n = snprintf (head, sizeof (head), "HTTP/1.0 %s\r\nContent-Type: %s\r\nContent-Length: %zu\r\n\r\n",
+                      status, type, body_len);
+    send_all (fd, head, n);
+    send_all (fd, body, body_len);
+    free (body);
+    q->served++;
+}
+
+static void *query_thread (void *arg)
+{
+    qserver_t *q = (qserver_t *) arg;
+
+    for (;;) {
+        struct pollfd fds[2] = {{q->listen_fd, POLLIN, 0}, {q->wake[0], POLLIN, 0}};
+        if (poll (fds, 2, -1) < 0) {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+        if (fds[1].revents)
+            break;
+        if (fds[0].revents & POLLIN) {
+            int fd = accept (q->listen_fd, NULL, NULL);
+            if (fd < 0)
+                continue;
+            query_serve (q, fd);
+            close (fd);
+        }
+    }
+    return NULL;
+}
+
+/* query_start()
+ * Listens on the Unix socket path and starts the server thread.
+ * fleet and registry are only read for names that do not change.
+ */
+int query_start (qserver_t *q, const char *path, fleet_t *fleet, treg_t *registry, int *timestops, int wsize)
+{
+    int rc = -1;
+    struct sockaddr_un addr;
+
+    memset (q, 0, sizeof (qserver_t));
+    q->listen_fd = -1;
+    q->wake[0] = q->wake[1] = -1;
+    q->fleet = fleet;
+    q->registry = registry;
+    q->timestops = timestops;
+    q->wsize = wsize;
+
+    if (strlen (path) >= sizeof (addr.sun_path)) {
+        printf ("ERROR: Query socket path %s is too long\n", path);
+        return rc;
+    }
+    if (snapshot_init (&q->pub, fleet->size, registry->ntypes, wsize) < 0
+        || snapshot_init (&q->view, fleet->size, registry->ntypes, wsize) < 0)
+        return rc;
+
+    memset (&addr, 0, sizeof (addr));
+    addr.sun_family = AF_UNIX;
+    strcpy (addr.sun_path, path);
+    unlink (path);
+    q->listen_fd = socket (AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (q->listen_fd < 0 || bind (q->listen_fd, (struct sockaddr *) &addr, sizeof (addr)) < 0
+        || listen (q->listen_fd, 16) < 0) {
+        printf ("ERROR: Could not listen on %s: %s\n", path, strerror (errno));
+        return rc;
+    }
+    q->path = strdup (path);
+
+    if (pipe (q->wake) < 0) {
+        printf ("ERROR: Could not start the query server\n");
+        return rc;
+    }
+    if (pthread_create (&q->thread, NULL, query_thread, q) != 0) {
+        printf ("ERROR: Could not start the query server\n");
+        close (q->wake[0]);
+        close (q->wake[1]);
+        q->wake[0] = q->wake[1] = -1;
+        return rc;
+    }
+    printf ("Query server listening on %s\n", path);
+
+    rc = 0;
+    return rc;
+}
+
+void query_stop (qserver_t *q)
+{
+    if (q->wake[1] >= 0) {
+        if (write (q->wake[1], "x", 1) == 1)
+            pthread_join (q->thread, NULL);
+        close (q->wake[0]);
+        close (q->wake[1]);
+    }
+    if (q->listen_fd >= 0)
+        close (q->listen_fd);
+    if (q->path) {
+        unlink (q->path);
+        free (q->path);
+    }
+    snapshot_free (&q->pub, q->wsize);
+    snapshot_free (&q->view, q->wsize);
+}
@@ -0,0 +1,52 @@
+#ifndef QUERY_H
+#define QUERY_H
+
+#include <stdint.h>
+#include <pthread.h>
+#include "machinepark.h"
+#include "fleet.h"
+#include "hring.h"
+#include "registry.h"
+
+/* Query server for the live state of the monitor.
+ * The monitor publishes a snapshot of the machines, the period
+ * histories and the summaries after every tick; a server thread
+ * answers HTTP/1.0 GET requests on a Unix socket with JSON built from
+ * its own copy of the latest snapshot. Publishing is a seqlock write:
+ * the monitor never waits for readers, readers retry when a publish
+ * overlapped their copy.
+ */
+
+typedef struct snapshot {
+    int64_t         tick;                   /* Ticks done when published */
+    int64_t         timestamp;              /* Epoch seconds of the publish */
+    int             nmachines;              /* Machines in the columns */
+    double          *current;               /* Last current of every machine */
+    double          *threshold;             /* Alert threshold of every machine */
+    double          *average;               /* Rolling window average, NaN if empty */
+    int32_t         *type;                  /* Type of every machine */
+    hring_t         pshort;                 /* Short period history */
+    hring_t         *plong;                 /* Long period history of every timestop */
+    opsum_t         *summary;               /* Summary of every timestop, no moments */
+} snapshot_t;
+
+typedef struct query_server {
+    uint64_t        seq;                    /* Seqlock sequence, odd while publishing */
+    snapshot_t      pub;                    /* Published snapshot */
+    snapshot_t      view;                   /* Server thread copy */
+    int             wsize;                  /* Number of timestops */
+    int             *timestops;             /* Hour every long period ends */
+    fleet_t         *fleet;                 /* Machine uuids, immutable while serving */
+    treg_t          *registry;              /* Type names */
+    char            *path;                  /* Socket path */
+    int             listen_fd;              /* Listening socket */
+    int             wake[2];                /* Pipe to stop the thread */
+    pthread_t       thread;                 /* Server thread */
+    int64_t         served;                 /* Requests answered */
+} qserver_t;
+
+int query_start (qserver_t *q, const char *path, fleet_t *fleet, treg_t *registry, int *timestops, int wsize);
+void query_publish (qserver_t *q, int64_t tick, fleet_t *fleet, hring_t *pshort, hring_t *plong, opsum_t *summary);
+void query_stop (qserver_t *q);
+
+#endif
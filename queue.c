@@ -0,0 +1,222 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sched.h>
+#include <time.h>
+
+#include "queue.h"
+
+/*******************************************************
+ *                                                     *
+ *                  SPSC Queue                         *
+ *                                                     *
+ *******************************************************/
+
+static uint64_t queue_capacity (int cap)
+{
+    uint64_t n = 2;
+    while (n < (uint64_t) cap)
+        n <<= 1;
+    return n;
+}
+
+/* spsc_init()
+ * Creates a queue of at least cap elements of size bytes
+ */
+int spsc_init (spsc_t *q, int cap, size_t size)
+{
+    uint64_t n = queue_capacity (cap);
+
+    memset (q, 0, sizeof (spsc_t));
+    q->stride = (size + 7) & ~(size_t) 7;
+    q->mask = n - 1;
+    if (posix_memalign ((void **) &q->slots, QUEUE_LINE, n * q->stride) != 0) {
+        printf ("ERROR: Could not allocate queue\n");
+        q->slots = NULL;
+        return -1;
+    }
+    return 0;
+}
+
+/* Slot to fill as the newest element, NULL if the queue is full */
+void *spsc_claim (spsc_t *q)
+{
+    uint64_t tail = q->tail;
+
+    if (tail - q->head_cache > q->mask) {
+        q->head_cache = __atomic_load_n (&q->head, __ATOMIC_ACQUIRE);
+        if (tail - q->head_cache > q->mask) {
+            q->stats.full++;
+            return NULL;
+        }
+    }
+    return q->slots + (tail & q->mask) * q->stride;
+}
+
+/* The depth is sampled every 64 pushes, reading the consumer's
+ * position more often would bounce its cache line
+ */
+void spsc_publish (spsc_t *q)
+{
+    if ((q->stats.pushes++ & 63) == 0) {
+        q->head_cache = __atomic_load_n (&q->head, __ATOMIC_ACQUIRE);
+        int64_t depth = q->tail + 1 - q->head_cache;
+        q->stats.samples++;
+        q->stats.depth_sum += depth;
+        if (depth > q->stats.depth_max)
+            q->stats.depth_max = depth;
+    }
+    __atomic_store_n (&q->tail, q->tail + 1, __ATOMIC_RELEASE);
+}
+
+/* Oldest element, NULL if the queue is empty */
+void *spsc_peek (spsc_t *q)
+{
+    uint64_t head = q->head;
+
+    if (head == __atomic_load_n (&q->tail, __ATOMIC_ACQUIRE))
+        return NULL;
+    return q->slots + (head & q->mask) * q->stride;
+}
+
+void spsc_release (spsc_t *q)
+{
+    __atomic_store_n (&q->head, q->head + 1, __ATOMIC_RELEASE);
+}
+
+void spsc_free (spsc_t *q)
+{
+    free (q->slots);
+    q->slots = NULL;
+}
+
+/*******************************************************
+ *                                                     *
+ *                  MPSC Queue                         *
+ *                                                     *
+ *******************************************************/
+
+/* Slot layout: sequence, then the element */
+#define MPSC_SEQ(slot) ((uint64_t *) (slot))
+#define MPSC_ELEM(slot) ((char *) (slot) + sizeof (uint64_t))
+#define MPSC_SLOT(elem) ((char *) (elem) - sizeof (uint64_t))
+
+/* mpsc_init()
+ * Creates a queue of at least cap elements of size bytes.
+ * Slot i starts with sequence i: free for the producer of ticket i.
+ */
+int mpsc_init (mpsc_t *q, int cap, size_t size)
+{
+    uint64_t i = 0;
+    uint64_t n = queue_capacity (cap);
+
+    memset (q, 0, sizeof (mpsc_t));
+    q->stride = (sizeof (uint64_t) + size + 7) & ~(size_t) 7;
+    q->mask = n - 1;
+    if (posix_memalign ((void **) &q->slots, QUEUE_LINE, n * q->stride) != 0) {
+        printf ("ERROR: Could not allocate queue\n");
+        q->slots = NULL;
+        return -1;
+    }
+    for (i = 0; i < n; i++)
+        *MPSC_SEQ (q->slots + i * q->stride) = i;
+    return 0;
+}
+
+/* Slot to fill, NULL if the queue is full. Claimed slots must be
+ * published, the consumer waits for them in order.
+ */
+void *mpsc_claim (mpsc_t *q)
+{
+    uint64_t tail = __atomic_load_n (&q->tail, __ATOMIC_RELAXED);
+
+    for (;;) {
+        char *slot = q->slots + (tail & q->mask) * q->stride;
+        uint64_t seq = __atomic_load_n (MPSC_SEQ (slot), __ATOMIC_ACQUIRE);
+        int64_t dif = (int64_t) (seq - tail);
+        if (dif == 0) {
+            if (__atomic_compare_exchange_n (&q->tail, &tail, tail + 1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                int64_t depth = tail + 1 - __atomic_load_n (&q->head, __ATOMIC_RELAXED);
+                __atomic_fetch_add (&q->stats.pushes, 1, __ATOMIC_RELAXED);
+                __atomic_fetch_add (&q->stats.samples, 1, __ATOMIC_RELAXED);
+                __atomic_fetch_add (&q->stats.depth_sum, depth, __ATOMIC_RELAXED);
+                if (depth > __atomic_load_n (&q->stats.depth_max, __ATOMIC_RELAXED))
+                    __atomic_store_n (&q->stats.depth_max, depth, __ATOMIC_RELAXED);
+                return MPSC_ELEM (slot);
+            }
+        } else if (dif < 0) {
+            __atomic_fetch_add (&q->stats.full, 1, __ATOMIC_RELAXED);
+            return NULL;
+        } else {
+            tail = __atomic_load_n (&q->tail, __ATOMIC_RELAXED);
+        }
+    }
+}
+
+void mpsc_publish (mpsc_t *q, void *elem)
+{
+    char *slot = MPSC_SLOT (elem);
+    uint64_t seq = *MPSC_SEQ (slot);
+    __atomic_store_n (MPSC_SEQ (slot), seq + 1, __ATOMIC_RELEASE);
+}
+
+/* Oldest element, NULL if the queue is empty or it is not published yet */
+void *mpsc_peek (mpsc_t *q)
+{
+    char *slot = q->slots + (q->head & q->mask) * q->stride;
+
+    if (__atomic_load_n (MPSC_SEQ (slot), __ATOMIC_ACQUIRE) != q->head + 1)
+        return NULL;
+    return MPSC_ELEM (slot);
+}
+
+/* Hands the slot back to the producer of ticket head + capacity */
+void mpsc_release (mpsc_t *q)
+{
+    char *slot = q->slots + (q->head & q->mask) * q->stride;
+
+    __atomic_store_n (MPSC_SEQ (slot), q->head + q->mask + 1, __ATOMIC_RELEASE);
+    __atomic_store_n (&q->head, q->head + 1, __ATOMIC_RELAXED);
+}
+
+void mpsc_free (mpsc_t *q)
+{
+    free (q->slots);
+    q->slots = NULL;
+}
+
+/*******************************************************
+ *                                                     *
+ *                     Backoff                         *
+ *                                                     *
+ *******************************************************/
+
+/* Spin-wait hint to the CPU; a compiler barrier where there is none */
+static inline void qbackoff_pause ()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause ();
+#elif defined(__aarch64__)
+    __asm__ __volatile__ ("yield" ::: "memory");
+#else
+    __asm__ __volatile__ ("" ::: "memory");
+#endif
+}
+
+/* qbackoff_wait()
+ * Spins briefly, then yields, then sleeps up to a millisecond,
+ * so idle stages between ticks do not burn a core
+ */
+void qbackoff_wait (qbackoff_t *b)
+{
+    if (b->round < 64) {
+        qbackoff_pause ();
+    } else if (b->round < 128) {
+        sched_yield ();
+    } else {
+        int shift = (b->round - 128) < 7 ? b->round - 128 : 7;
+        struct timespec ts = {0, 8000L << shift};
+        nanosleep (&ts, NULL);
+    }
+    b->round++;
+}
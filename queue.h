@@ -0,0 +1,74 @@
+#ifndef QUEUE_H
+#define QUEUE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* Bounded lock-free queues of fixed-size elements.
+ * Producers claim a slot, fill it in place and publish it; consumers
+ * peek at the oldest published slot and release it when done, so
+ * elements are never copied through the queue. A full queue makes
+ * claim return NULL and the producer decides how to back off.
+ */
+
+#define QUEUE_LINE 64
+
+/* Occupancy of a queue, counted by its producers */
+typedef struct queue_stats {
+    int64_t         pushes;                 /* Elements published */
+    int64_t         full;                   /* Claims refused because the queue was full */
+    int64_t         samples;                /* Pushes that sampled the depth */
+    int64_t         depth_sum;              /* Sum of the sampled depths */
+    int64_t         depth_max;              /* Largest sampled depth */
+} qstats_t;
+
+/* Single producer, single consumer */
+typedef struct spsc {
+    uint64_t        head __attribute__ ((aligned (QUEUE_LINE))); /* Next slot to consume */
+    uint64_t        tail __attribute__ ((aligned (QUEUE_LINE))); /* Next slot to produce */
+    uint64_t        head_cache;             /* Producer's last view of head */
+    qstats_t        stats;                  /* Producer side counters */
+    char            *slots __attribute__ ((aligned (QUEUE_LINE)));
+    size_t          stride;                 /* Bytes per slot */
+    uint64_t        mask;                   /* Capacity - 1 */
+} spsc_t;
+
+/* Multiple producers, single consumer; every slot carries a
+ * sequence number telling whose turn it is
+ */
+typedef struct mpsc {
+    uint64_t        head __attribute__ ((aligned (QUEUE_LINE))); /* Next slot to consume */
+    uint64_t        tail __attribute__ ((aligned (QUEUE_LINE))); /* Next slot to claim */
+    qstats_t        stats;                  /* Producer side counters, atomic */
+    char            *slots __attribute__ ((aligned (QUEUE_LINE)));
+    size_t          stride;                 /* Bytes per slot, sequence included */
+    uint64_t        mask;                   /* Capacity - 1 */
+} mpsc_t;
+
+/* Progressive wait of an idle thread: spin, yield, then sleep */
+typedef struct queue_backoff {
+    int             round;                  /* Idle rounds so far */
+} qbackoff_t;
+
+int spsc_init (spsc_t *q, int cap, size_t size);
+void *spsc_claim (spsc_t *q);
+void spsc_publish (spsc_t *q);
+void *spsc_peek (spsc_t *q);
+void spsc_release (spsc_t *q);
+void spsc_free (spsc_t *q);
+
+int mpsc_init (mpsc_t *q, int cap, size_t size);
+void *mpsc_claim (mpsc_t *q);
+void mpsc_publish (mpsc_t *q, void *elem);
+void *mpsc_peek (mpsc_t *q);
+void mpsc_release (mpsc_t *q);
+void mpsc_free (mpsc_t *q);
+
+void qbackoff_wait (qbackoff_t *b);
+
+static inline void qbackoff_reset (qbackoff_t *b)
+{
+    b->round = 0;
+}
+
+#endif
@@ -0,0 +1,231 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "registry.h"
+
+/* Built in registry, used without a types file */
+static const char *default_types[][2] = {
+    {"DMC", "DMG DMC"},
+    {"DMU", "DMG DMU"},
+    {"NTX", "DMG NTX"},
+    {"NZX", "DMG NZX"},
+    {"A7", "Kasotec A7"},
+    {"A13", "Kasotec A13"},
+    {"WSS", "Perndorfer WSS"},
+    {"3000", "Trumpf TruLaser 3000"},
+    {"7000", "Trumpf TruLaser 7000"},
+    {"Lasertec", "DMG Lasertec"},
+};
+
+/*******************************************************
+ *                                                     *
+ *                    Automaton                        *
+ *                                                     *
+ *******************************************************/
+
+static int treg_new_state (treg_t *reg, int *cap)
+{
+    int i = 0;
+
+    if (reg->nstates == *cap) {
+        *cap = (*cap) * 2;
+        reg->next = (int32_t *) realloc (reg->next, sizeof (int32_t) * (*cap) * reg->nclasses);
+        reg->match = (int32_t *) realloc (reg->match, sizeof (int32_t) * (*cap));
+    }
+    for (i = 0; i < reg->nclasses; i++)
+        reg->next[(size_t) reg->nstates * reg->nclasses + i] = -1;
+    reg->match[reg->nstates] = reg->npatterns;
+    return reg->nstates++;
+}
+
+/* treg_build()
+ * Builds the automaton over the patterns: a trie whose missing
+ * transitions are resolved through the failure links, so matching
+ * takes exactly one transition per byte
+ */
+static int treg_build (treg_t *reg, char **patterns)
+{
+    int i = 0, c = 0;
+    int cap = 16;
+    int nc;
+
+    /* Byte classes: one per byte used in a pattern, 0 for the rest */
+    memset (reg->byteclass, 0, sizeof (reg->byteclass));
+    reg->nclasses = 1;
+    for (i = 0; i < reg->npatterns; i++) {
+        const unsigned char *p = (const unsigned char *) patterns[i];
+        for (; *p; p++) {
+            if (reg->byteclass[*p] == 0) {
+                if (reg->nclasses == 256) {
+                    printf ("ERROR: Too many distinct bytes in type patterns\n");
+                    return -1;
+                }
+                reg->byteclass[*p] = reg->nclasses++;
+            }
+        }
+    }
+    nc = reg->nclasses;
+
+    /* Trie */
+    reg->nstates = 0;
+    reg->next = (int32_t *) malloc (sizeof (int32_t) * cap * nc);
+    reg->match = (int32_t *) malloc (sizeof (int32_t) * cap);
+    treg_new_state (reg, &cap);
+    for (i = 0; i < reg->npatterns; i++) {
+        const unsigned char *p = (const unsigned char *) patterns[i];
+        int s = 0;
+        for (; *p; p++) {
+            int32_t *t = &reg->next[(size_t) s * nc + reg->byteclass[*p]];
+            if (*t < 0) {
+                int ns = treg_new_state (reg, &cap);
+                t = &reg->next[(size_t) s * nc + reg->byteclass[*p]];
+                *t = ns;
+            }
+            s = *t;
+        }
+        if (i < reg->match[s])
+            reg->match[s] = i;
+    }
+
+    /* Failure links, breadth first */
+    int *fail = (int *) calloc (reg->nstates, sizeof (int));
+    int *queue = (int *) malloc (sizeof (int) * reg->nstates);
+    int qhead = 0, qtail = 0;
+    for (c = 0; c < nc; c++) {
+        int32_t t = reg->next[c];
+        if (t < 0) {
+            reg->next[c] = 0;
+        } else {
+            fail[t] = 0;
+            queue[qtail++] = t;
+        }
+    }
+    while (qhead < qtail) {
+        int s = queue[qhead++];
+        for (c = 0; c < nc; c++) {
+            int32_t *t = &reg->next[(size_t) s * nc + c];
+            int32_t f = reg->next[(size_t) fail[s] * nc + c];
+            if (*t < 0) {
+                *t = f;
+            } else {
+                fail[*t] = f;
+                if (reg->match[f] < reg->match[*t])
+                    reg->match[*t] = reg->match[f];
+                queue[qtail++] = *t;
+            }
+        }
+    }
+    free (fail);
+    free (queue);
+    return 0;
+}
+
+/*******************************************************
+ *                                                     *
+ *                     Registry                        *
+ *                                                     *
+ *******************************************************/
+
+/* Type id of name, adding the type if it is new */
+static int treg_type_id (treg_t *reg, const char *name)
+{
+    int i = 0;
+    for (i = 1; i < reg->ntypes; i++) {
+        if (strcmp (reg->names[i], name) == 0)
+            return i;
+    }
+    reg->names = (char **) realloc (reg->names, sizeof (char *) * (reg->ntypes + 1));
+    reg->names[reg->ntypes] = strdup (name);
+    return reg->ntypes++;
+}
+
+static void treg_add (treg_t *reg, char ***patterns, const char *pattern, const char *type)
+{
+    *patterns = (char **) realloc (*patterns, sizeof (char *) * (reg->npatterns + 1));
+    reg->pattern_type = (int *) realloc (reg->pattern_type, sizeof (int) * (reg->npatterns + 1));
+    (*patterns)[reg->npatterns] = strdup (pattern);
+    reg->pattern_type[reg->npatterns] = treg_type_id (reg, type);
+    reg->npatterns++;
+}
+
+/* treg_load()
+ * Loads the registry from path, one "<pattern> TAB <type name>" per
+ * line, most specific patterns first ('#' starts a comment). Without
+ * a path the built in registry is used.
+ */
+int treg_load (treg_t *reg, const char *path)
+{
+    int rc = -1;
+    int i = 0;
+    char **patterns = NULL;
+    char line[512];
+
+    memset (reg, 0, sizeof (treg_t));
+    reg->names = (char **) malloc (sizeof (char *));
+    reg->names[0] = strdup ("All");
+    reg->ntypes = 1;
+
+    if (path == NULL) {
+        for (i = 0; i < (int) (sizeof (default_types) / sizeof (default_types[0])); i++)
+            treg_add (reg, &patterns, default_types[i][0], default_types[i][1]);
+    } else {
+        FILE *fp = fopen (path, "r");
+        if (fp == NULL) {
+            printf ("ERROR: Could not open types file %s\n", path);
+            return rc;
+        }
+        while (fgets (line, sizeof (line), fp)) {
+            line[strcspn (line, "\r\n")] = '\0';
+            if (line[0] == '#' || line[0] == '\0')
+                continue;
+            char *type = strchr (line, '\t');
+            if (type == NULL || type == line || type[1] == '\0') {
+                printf ("ERROR: Malformed line in types file: %s\n", line);
+                continue;
+            }
+            *type++ = '\0';
+            treg_add (reg, &patterns, line, type);
+        }
+        fclose (fp);
+    }
+    if (reg->npatterns == 0) {
+        printf ("ERROR: No machine types in the registry\n");
+        return rc;
+    }
+
+    rc = treg_build (reg, patterns);
+    for (i = 0; i < reg->npatterns; i++)
+        free (patterns[i]);
+    free (patterns);
+    return rc;
+}
+
+/* treg_classify()
+ * Type of the machine called name, -1 if no pattern matches
+ */
+int treg_classify (const treg_t *reg, const char *name)
+{
+    const unsigned char *p = (const unsigned char *) name;
+    int s = 0;
+    int best = reg->npatterns;
+
+    for (; *p; p++) {
+        s = reg->next[(size_t) s * reg->nclasses + reg->byteclass[*p]];
+        if (reg->match[s] < best)
+            best = reg->match[s];
+    }
+    return (best < reg->npatterns) ? reg->pattern_type[best] : -1;
+}
+
+void treg_free (treg_t *reg)
+{
+    int i = 0;
+    for (i = 0; i < reg->ntypes; i++)
+        free (reg->names[i]);
+    free (reg->names);
+    free (reg->pattern_type);
+    free (reg->next);
+    free (reg->match);
+    memset (reg, 0, sizeof (treg_t));
+}
@@ -0,0 +1,29 @@
+#ifndef REGISTRY_H
+#define REGISTRY_H
+
+#include <stdint.h>
+
+/* Registry of machine types, loaded at runtime.
+ * Each name pattern maps to a type; a machine gets the type of the
+ * first pattern (in registry order) found in its name. All patterns
+ * are matched in a single pass over the name by an Aho-Corasick
+ * automaton, so classification cost does not grow with the registry.
+ * Type id 0 (CMP_ALL) stands for the whole fleet.
+ */
+typedef struct type_registry {
+    int         ntypes;                 /* Types including CMP_ALL */
+    char        **names;                /* Name of every type */
+    int         npatterns;              /* Number of name patterns */
+    int         *pattern_type;          /* Type of every pattern */
+    int         nstates;                /* States of the automaton */
+    int         nclasses;               /* Byte classes, 0 = bytes in no pattern */
+    uint8_t     byteclass[256];         /* Byte -> class */
+    int32_t     *next;                  /* Transitions, nstates x nclasses */
+    int32_t     *match;                 /* First pattern ending at each state, npatterns if none */
+} treg_t;
+
+int treg_load (treg_t *reg, const char *path);
+int treg_classify (const treg_t *reg, const char *name);
+void treg_free (treg_t *reg);
+
+#endif
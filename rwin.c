@@ -0,0 +1,132 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "rwin.h"
+
+/*******************************************************
+ *                                                     *
+ *                 Rolling Window                      *
+ *                                                     *
+ *******************************************************/
+
+/* Ring capacity for span nanoseconds of samples taken every
+ * frequency seconds, with some slack for early responses
+ */
+int rwin_capacity (int64_t span, double frequency)
+{
+    return (int) ceil (span / 1e9 / frequency) + 2;
+}
+
+/* rwin_init()
+ * Creates a window with its own ring
+ */
+int rwin_init (rwin_t *win, int64_t span, double frequency)
+{
+    int cap = rwin_capacity (span, frequency);
+    cw_t *samples = (cw_t *) calloc (cap, sizeof (cw_t));
+    if (samples == NULL) {
+        printf ("ERROR: Could not allocate rolling window\n");
+        return -1;
+    }
+    rwin_init_with (win, span, samples, cap);
+    win->owned = 1;
+    return 0;
+}
+
+/* rwin_init_with()
+ * Creates a window on caller provided storage of cap samples
+ */
+void rwin_init_with (rwin_t *win, int64_t span, cw_t *storage, int cap)
+{
+    win->samples = storage;
+    win->cap = cap;
+    win->head = 0;
+    win->count = 0;
+    win->sum = 0;
+    win->span = span;
+    win->owned = 0;
+}
+
+static inline int rwin_oldest (rwin_t *win)
+{
+    int idx = win->head - win->count;
+    return (idx < 0) ? idx + win->cap : idx;
+}
+
+/* Drop the oldest sample */
+static inline void rwin_pop (rwin_t *win)
+{
+    win->sum -= win->samples[rwin_oldest (win)].current;
+    win->count--;
+}
+
+/* Samples arrive faster than the ring was sized for: double it,
+ * unrolling the ring so that the oldest sample is at index 0
+ */
+static int rwin_grow (rwin_t *win)
+{
+    int i = 0;
+    int cap = win->cap * 2;
+    cw_t *samples = (cw_t *) calloc (cap, sizeof (cw_t));
+
+    if (samples == NULL)
+        return -1;
+    for (i = 0; i < win->count; i++) {
+        samples[i] = win->samples[(rwin_oldest (win) + i) % win->cap];
+    }
+    if (win->owned)
+        free (win->samples);
+    win->samples = samples;
+    win->cap = cap;
+    win->owned = 1;
+    win->head = win->count;
+    return 0;
+}
+
+/* rwin_evict()
+ * Drops the samples that fell out of the window at timenow
+ */
+void rwin_evict (rwin_t *win, int64_t timenow)
+{
+    while (win->count > 0 && win->samples[rwin_oldest (win)].timestamp <= timenow - win->span) {
+        rwin_pop (win);
+    }
+    if (win->count == 0)
+        win->sum = 0;
+}
+
+/* rwin_push()
+ * Inserts a sample, evicting what is older than the window
+ */
+void rwin_push (rwin_t *win, int64_t timestamp, double current)
+{
+    int i = 0;
+
+    rwin_evict (win, timestamp);
+    if (win->count == win->cap && rwin_grow (win) < 0)
+        rwin_pop (win);
+
+    win->samples[win->head].current = current;
+    win->samples[win->head].timestamp = timestamp;
+    win->head = (win->head == win->cap - 1) ? 0 : win->head + 1;
+    win->count++;
+    win->sum += current;
+
+    /* once per lap, recompute the sum to shed accumulated rounding error */
+    if (win->head == 0) {
+        win->sum = 0;
+        for (i = 0; i < win->count; i++) {
+            int idx = win->cap - 1 - i;
+            win->sum += win->samples[idx].current;
+        }
+    }
+}
+
+void rwin_free (rwin_t *win)
+{
+    if (win->owned)
+        free (win->samples);
+    win->samples = NULL;
+    win->count = 0;
+}
@@ -0,0 +1,35 @@
+#ifndef RWIN_H
+#define RWIN_H
+
+#include "machinepark.h"
+
+/* Rolling time window over (timestamp, current) samples, stamped in
+ * epoch nanoseconds.
+ * Keeps a running sum and count and evicts by timestamp on insert,
+ * so the average of the window is available in constant time.
+ */
+typedef struct rolling_window {
+    cw_t        *samples;               /* Ring of samples, oldest at head - count */
+    int         cap;                    /* Capacity of the ring */
+    int         head;                   /* Next insert position */
+    int         count;                  /* Samples inside the window */
+    double      sum;                    /* Sum of the currents inside the window */
+    int64_t     span;                   /* Window length in nanoseconds */
+    int         owned;                  /* samples was allocated by the window */
+} rwin_t;
+
+int rwin_capacity (int64_t span, double frequency);
+int rwin_init (rwin_t *win, int64_t span, double frequency);
+void rwin_init_with (rwin_t *win, int64_t span, cw_t *storage, int cap);
+void rwin_evict (rwin_t *win, int64_t timenow);
+void rwin_push (rwin_t *win, int64_t timestamp, double current);
+void rwin_free (rwin_t *win);
+
+/* Average of the samples inside the window, fallback if it is empty
+ */
+static inline double rwin_avg (rwin_t *win, double fallback)
+{
+    return (win->count > 0) ? win->sum / win->count : fallback;
+}
+
+#endif
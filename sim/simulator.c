@@ -0,0 +1,584 @@
+/* Local machine park simulator
+ *
+ * Serves the three endpoints the monitor uses, for a fleet of any size:
+ *     /api/v1/machines          list of machine detail paths
+ *     /api/v1/machine/<uuid>    machine detail with current and alert level
+ *     /api/v1/env-sensor        pressure, temperature and humidity
+ *
+ * Single threaded, epoll driven HTTP/1.1 with keep-alive. Every response
+ * is held back by a latency drawn from the configured distribution.
+ *
+ * Build with `make sim` and run ./sim/simulator -h for the options.
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include <time.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+
+#define MAX_EVENTS 256
+#define READ_BUF 8192
+
+typedef enum {
+    LAT_CONST,                          /* Always the mean */
+    LAT_UNIFORM,                        /* Uniform in [0, 2 * mean] */
+    LAT_EXP                             /* Exponential with the mean */
+} latency_t;
+
+typedef enum {
+    PAT_STEADY,                         /* Base current with noise */
+    PAT_SINE,                           /* Slow oscillation around the base */
+    PAT_SPIKE                           /* Base current with short bursts over the alert level */
+} pattern_t;
+
+typedef struct sim_machine {
+    char        uuid[37];               /* uuid with a null character */
+    char        name[64];               /* Name, carrying the machine type */
+    double      base;                   /* Base current */
+    double      alert;                  /* Alert level */
+    double      phase;                  /* Phase of the pattern */
+} smachine_t;
+
+/* A response waiting for its latency to pass */
+typedef struct pending {
+    int64_t         due;                /* Send time, monotonic ns */
+    char            *data;              /* Full response */
+    size_t          len;                /* Length of data */
+    struct pending  *next;              /* Next response on the connection */
+} pending_t;
+
+typedef struct connection {
+    int         fd;                     /* Socket, -1 when closed */
+    char        in[READ_BUF];           /* Unparsed request bytes */
+    size_t      inlen;                  /* Bytes in in */
+    char        *out;                   /* Response bytes not yet written */
+    size_t      outlen;                 /* Bytes in out */
+    size_t      outoff;                 /* Bytes of out already written */
+    size_t      outcap;                 /* Allocated bytes of out */
+    pending_t   *head, *tail;           /* Responses held back, in request order */
+    int         heaped;                 /* Connection is in the timer heap */
+} conn_t;
+
+/* Configuration */
+int port = 8099;
+int fleet_size = 243;
+double speed = 1; // simulated seconds per second
+double latency_ms = 0;
+latency_t latency_dist = LAT_CONST;
+double alert_fraction = 0.05; // machines running over their alert level
+pattern_t pattern = PAT_STEADY;
+uint64_t seed = 1;
+
+smachine_t *fleet;
+conn_t **conns; // by fd
+int nconns;
+int64_t start_ns;
+uint64_t rng;
+long served;
+
+/* Timer heap of connections, keyed by the due time of their first response */
+conn_t **heap;
+int heap_size;
+
+/*******************************************************
+ *                                                     *
+ *                     Helpers                         *
+ *                                                     *
+ *******************************************************/
+
+static int64_t now_ns ()
+{
+    struct timespec ts;
+    clock_gettime (CLOCK_MONOTONIC, &ts);
+    return (int64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/* xorshift64* */
+static uint64_t rand64 ()
+{
+    rng ^= rng >> 12;
+    rng ^= rng << 25;
+    rng ^= rng >> 27;
+    return rng * 2685821657736338717ULL;
+}
+
+/* Uniform in [0, 1) */
+static double randu ()
+{
+    return (rand64 () >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static int64_t draw_latency ()
+{
+    double ms = latency_ms;
+    switch (latency_dist) {
+    case LAT_UNIFORM:
+        ms = 2 * latency_ms * randu ();
+        break;
+    case LAT_EXP:
+        ms = -latency_ms * log (1 - randu ());
+        break;
+    default:
+        break;
+    }
+    return (int64_t) (ms * 1e6);
+}
+
+/* Simulated wall clock, starting at 2017-01-01T09:01:00 */
+static void sim_time (char *buf, size_t len, double *elapsed)
+{
+    struct tm tm = {0};
+    *elapsed = (now_ns () - start_ns) / 1e9 * speed;
+    time_t t = 1483261260 + (time_t) *elapsed;
+    gmtime_r (&t, &tm);
+    strftime (buf, len, "%Y-%m-%dT%H:%M:%S", &tm);
+}
+
+/*******************************************************
+ *                                                     *
+ *                      Fleet                          *
+ *                                                     *
+ *******************************************************/
+
+/* Machine types in the proportions of the real park (243 machines) */
+static const struct {
+    const char  *name;
+    int         count;
+} types[] = {
+    {"DMG DMC 1035V", 15}, {"DMG DMU 40eVo", 96}, {"DMG NTX 1000", 36},
+    {"DMG NZX 2000", 24}, {"Kasotec A7", 24}, {"Kasotec A13", 6},
+    {"Perndorfer WSS", 9}, {"Trumpf TruLaser 3000", 12}, {"Trumpf TruLaser 7000", 18},
+    {"DMG Lasertec 65", 3},
+};
+
+static void fleet_create ()
+{
+    int i = 0, t = 0;
+    int ntypes = sizeof (types) / sizeof (types[0]);
+
+    fleet = (smachine_t *) calloc (fleet_size, sizeof (smachine_t));
+    for (i = 0; i < fleet_size; i++) {
+        uint64_t a = rand64 (), b = rand64 ();
+        snprintf (fleet[i].uuid, sizeof (fleet[i].uuid), "%08x-%04x-%04x-%04x-%012llx",
+                  (unsigned) (a >> 32), (unsigned) (a >> 16) & 0xffff, (unsigned) a & 0xffff,
+                  (unsigned) (b >> 48), (unsigned long long) b & 0xffffffffffffULL);
+
+        /* Walk the type table so every 243 machines match the real park */
+        int slot = i % 243;
+        for (t = 0; t < ntypes - 1 && slot >= types[t].count; t++)
+            slot -= types[t].count;
+        snprintf (fleet[i].name, sizeof (fleet[i].name), "%s [#%d]", types[t].name, i);
+
+        fleet[i].alert = 14.0;
+        fleet[i].base = 5 + 8 * randu ();
+        if (randu () < alert_fraction)
+            fleet[i].base = fleet[i].alert + 1 + 3 * randu ();
+        fleet[i].phase = 2 * M_PI * randu ();
+    }
+}
+
+static int uuid_cmp (const void *a, const void *b)
+{
+    return strcmp (((const smachine_t *) a)->uuid, ((const smachine_t *) b)->uuid);
+}
+
+static double machine_current (smachine_t *m, double elapsed)
+{
+    double current = m->base + (randu () - 0.5);
+    switch (pattern) {
+    case PAT_SINE:
+        current += 3 * sin (2 * M_PI * elapsed / 3600 + m->phase);
+        break;
+    case PAT_SPIKE:
+        if (randu () < 0.02)
+            current = m->alert + 2 + 4 * randu ();
+        break;
+    default:
+        break;
+    }
+    return (current < 0) ? 0 : current;
+}
+
+/*******************************************************
+ *                                                     *
+ *                    Responses                        *
+ *                                                     *
+ *******************************************************/
+
+/* Builds the full response for path */
+static int respond (const char *path, char **data, size_t *len)
+{
+    char body_small[512];
+    char *body = body_small;
+    int status = 200;
+    size_t blen = 0;
+    char ts[32];
+    double elapsed;
+    const char *api = "/api/v1/";
+
+    sim_time (ts, sizeof (ts), &elapsed);
+    if (strncmp (path, api, strlen (api)) != 0) {
+        status = 404;
+    } else if (strcmp (path + strlen (api), "machines") == 0) {
+        int i = 0;
+        body = (char *) malloc ((size_t) fleet_size * 64 + 16);
+        blen += sprintf (body + blen, "[");
+        for (i = 0; i < fleet_size; i++)
+            blen += sprintf (body + blen, "%s\"$API_ROOT/machine/%s\"", i ? "," : "", fleet[i].uuid);
+        blen += sprintf (body + blen, "]");
+    } else if (strncmp (path + strlen (api), "machine/", 8) == 0) {
+        smachine_t key, *m = NULL;
+        const char *uuid = path + strlen (api) + 8;
+        if (strlen (uuid) == 36) {
+            memcpy (key.uuid, uuid, 37);
+            m = (smachine_t *) bsearch (&key, fleet, fleet_size, sizeof (smachine_t), uuid_cmp);
+        }
+        if (m == NULL) {
+            status = 404;
+        } else {
+            blen = snprintf (body, sizeof (body_small),
+                             "{\"name\":\"%s\",\"timestamp\":\"%s.000000\",\"current\":%.2f,"
+                             "\"state\":\"working\",\"location\":\"0.0,0.0\",\"current_alert\":%.1f,\"type\":\"mill\"}",
+                             m->name, ts, machine_current (m, elapsed), m->alert);
+        }
+    } else if (strcmp (path + strlen (api), "env-sensor") == 0) {
+        blen = snprintf (body, sizeof (body_small),
+                         "{\"pressure\":[\"%s\",%.2f],\"temperature\":[\"%s\",%.2f],\"humidity\":[\"%s\",%.2f]}",
+                         ts, 1011 + randu (), ts, 20 + 2 * sin (2 * M_PI * elapsed / 86400) + randu (), ts, 40 + randu ());
+    } else {
+        status = 404;
+    }
+
+    *data = (char *) malloc (blen + 128);
+    *len = sprintf (*data, "HTTP/1.1 %d %s\r\nContent-Type: application/json\r\nContent-Length: %zu\r\n\r\n",
+                    status, (status == 200) ? "OK" : "Not Found", (status == 200) ? blen : 0);
+    if (status == 200) {
+        memcpy (*data + *len, body, blen);
+        *len += blen;
+    }
+    if (body != body_small)
+        free (body);
+    return status;
+}
+
+/*******************************************************
+ *                                                     *
+ *                  Timer Heap                         *
+ *                                                     *
+ *******************************************************/
+
+static void heap_swap (int a, int b)
+{
+    conn_t *tmp = heap[a];
+    heap[a] = heap[b];
+    heap[b] = tmp;
+}
+
+static void heap_push (conn_t *c)
+{
+    int i = heap_size++;
+    heap[i] = c;
+    while (i > 0 && heap[(i - 1) / 2]->head->due > heap[i]->head->due) {
+        heap_swap (i, (i - 1) / 2);
+        i = (i - 1) / 2;
+    }
+    c->heaped = 1;
+}
+
+static conn_t *heap_pop ()
+{
+    int i = 0;
+    conn_t *top = heap[0];
+
+    heap[0] = heap[--heap_size];
+    for (;;) {
+        int l = 2 * i + 1, r = l + 1, m = i;
+        if (l < heap_size && heap[l]->head->due < heap[m]->head->due)
+            m = l;
+        if (r < heap_size && heap[r]->head->due < heap[m]->head->due)
+            m = r;
+        if (m == i)
+            break;
+        heap_swap (i, m);
+        i = m;
+    }
+    top->heaped = 0;
+    return top;
+}
+
+/*******************************************************
+ *                                                     *
+ *                   Connections                       *
+ *                                                     *
+ *******************************************************/
+
+static void conn_close (int epfd, conn_t *c)
+{
+    epoll_ctl (epfd, EPOLL_CTL_DEL, c->fd, NULL);
+    close (c->fd);
+    c->fd = -1;
+    c->inlen = 0;
+    c->outlen = 0;
+    c->outoff = 0;
+    while (c->head) {
+        pending_t *p = c->head;
+        c->head = p->next;
+        free (p->data);
+        free (p);
+    }
+    c->tail = NULL;
+}
+
+/* Writes what the socket takes, waiting for EPOLLOUT for the rest */
+static int conn_flush (int epfd, conn_t *c)
+{
+    struct epoll_event ev = {0};
+
+    while (c->outoff < c->outlen) {
+        ssize_t n = write (c->fd, c->out + c->outoff, c->outlen - c->outoff);
+        if (n < 0 && errno == EAGAIN)
+            break;
+        if (n <= 0)
+            return -1;
+        c->outoff += n;
+    }
+    if (c->outoff == c->outlen)
+        c->outoff = c->outlen = 0;
+    ev.events = EPOLLIN | ((c->outlen > 0) ? EPOLLOUT : 0);
+    ev.data.fd = c->fd;
+    epoll_ctl (epfd, EPOLL_CTL_MOD, c->fd, &ev);
+    return 0;
+}
+
+static void conn_append (conn_t *c, const char *data, size_t len)
+{
+    if (c->outlen + len > c->outcap) {
+        c->outcap = (c->outlen + len) * 2;
+        c->out = (char *) realloc (c->out, c->outcap);
+    }
+    memcpy (c->out + c->outlen, data, len);
+    c->outlen += len;
+}
+
+/* Moves the responses whose time has come to the output */
+static int conn_release (int epfd, conn_t *c, int64_t now)
+{
+    while (c->head && c->head->due <= now) {
+        pending_t *p = c->head;
+        c->head = p->next;
+        if (c->head == NULL)
+            c->tail = NULL;
+        conn_append (c, p->data, p->len);
+        free (p->data);
+        free (p);
+    }
+    if (c->head && !c->heaped)
+        heap_push (c);
+    return conn_flush (epfd, c);
+}
+
+/* Parses complete requests from the input and queues their responses */
+static int conn_read (int epfd, conn_t *c)
+{
+    for (;;) {
+        ssize_t n = read (c->fd, c->in + c->inlen, sizeof (c->in) - c->inlen - 1);
+        if (n < 0 && errno == EAGAIN)
+            break;
+        if (n <= 0)
+            return -1;
+        c->inlen += n;
+        c->in[c->inlen] = '\0';
+
+        char *end;
+        while ((end = strstr (c->in, "\r\n\r\n")) != NULL) {
+            char path[256] = {0};
+            if (sscanf (c->in, "GET %255s", path) != 1)
+                return -1;
+
+            pending_t *p = (pending_t *) calloc (1, sizeof (pending_t));
+            respond (path, &p->data, &p->len);
+            p->due = now_ns () + draw_latency ();
+            if (c->tail && p->due < c->tail->due)
+                p->due = c->tail->due; // keep responses in request order
+            if (c->tail)
+                c->tail->next = p;
+            else
+                c->head = p;
+            c->tail = p;
+            served++;
+
+            size_t used = end + 4 - c->in;
+            memmove (c->in, end + 4, c->inlen - used + 1);
+            c->inlen -= used;
+        }
+        if (c->inlen >= sizeof (c->in) - 1)
+            return -1;
+    }
+    /* A connection in the heap is released from there, keeping its key */
+    if (c->heaped)
+        return 0;
+    return conn_release (epfd, c, now_ns ());
+}
+
+static void accept_all (int epfd, int lfd)
+{
+    int one = 1;
+    struct epoll_event ev = {0};
+
+    for (;;) {
+        int fd = accept4 (lfd, NULL, NULL, SOCK_NONBLOCK);
+        if (fd < 0)
+            return;
+        setsockopt (fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof (one));
+        if (fd >= nconns) {
+            int old = nconns;
+            nconns = (fd + 1) * 2;
+            conns = (conn_t **) realloc (conns, sizeof (conn_t *) * nconns);
+            memset (conns + old, 0, sizeof (conn_t *) * (nconns - old));
+            heap = (conn_t **) realloc (heap, sizeof (conn_t *) * nconns);
+        }
+        if (conns[fd] == NULL)
+            conns[fd] = (conn_t *) calloc (1, sizeof (conn_t));
+        conns[fd]->fd = fd;
+        ev.events = EPOLLIN;
+        ev.data.fd = fd;
+        epoll_ctl (epfd, EPOLL_CTL_ADD, fd, &ev);
+    }
+}
+
+/*******************************************************
+ *                                                     *
+ *                     MAIN                            *
+ *                                                     *
+ *******************************************************/
+
+static void usage (const char *prog)
+{
+    printf ("Usage: %s [-p port] [-n machines] [-s speed] [-l latency-ms] [-d const|uniform|exp]\n"
+            "          [-a alert-fraction] [-P steady|sine|spike] [-S seed]\n", prog);
+}
+
+int main (int argc, char *argv[])
+{
+    int i = 0;
+    int opt;
+    int one = 1;
+
+    while ((opt = getopt (argc, argv, "p:n:s:l:d:a:P:S:h")) != -1) {
+        switch (opt) {
+        case 'p':
+            port = strtol (optarg, NULL, 10);
+            break;
+        case 'n':
+            fleet_size = strtol (optarg, NULL, 10);
+            break;
+        case 's':
+            speed = strtod (optarg, NULL);
+            break;
+        case 'l':
+            latency_ms = strtod (optarg, NULL);
+            break;
+        case 'd':
+            latency_dist = (strcmp (optarg, "exp") == 0) ? LAT_EXP : (strcmp (optarg, "uniform") == 0) ? LAT_UNIFORM : LAT_CONST;
+            break;
+        case 'a':
+            alert_fraction = strtod (optarg, NULL);
+            break;
+        case 'P':
+            pattern = (strcmp (optarg, "sine") == 0) ? PAT_SINE : (strcmp (optarg, "spike") == 0) ? PAT_SPIKE : PAT_STEADY;
+            break;
+        case 'S':
+            seed = strtoull (optarg, NULL, 10);
+            break;
+        default:
+            usage (argv[0]);
+            return -1;
+        }
+    }
+    if (fleet_size <= 0) {
+        usage (argv[0]);
+        return -1;
+    }
+
+    signal (SIGPIPE, SIG_IGN);
+    rng = seed * 0x9e3779b97f4a7c15ULL + 1;
+    fleet_create ();
+    qsort (fleet, fleet_size, sizeof (smachine_t), uuid_cmp);
+    start_ns = now_ns ();
+
+    int lfd = socket (AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+    struct sockaddr_in addr = {0};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons (port);
+    addr.sin_addr.s_addr = htonl (INADDR_LOOPBACK);
+    setsockopt (lfd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof (one));
+    if (bind (lfd, (struct sockaddr *) &addr, sizeof (addr)) < 0 || listen (lfd, 4096) < 0) {
+        printf ("ERROR: Could not listen on port %d\n", port);
+        return -1;
+    }
+
+    int epfd = epoll_create1 (0);
+    struct epoll_event ev = {0}, events[MAX_EVENTS];
+    ev.events = EPOLLIN;
+    ev.data.fd = lfd;
+    epoll_ctl (epfd, EPOLL_CTL_ADD, lfd, &ev);
+
+    printf ("Simulating %d machines on http://127.0.0.1:%d/api/v1 (latency %.1f ms)\n", fleet_size, port, latency_ms);
+    fflush (stdout);
+
+    for (;;) {
+        int timeout = -1;
+        if (heap_size > 0) {
+            int64_t wait = heap[0]->head->due - now_ns ();
+            timeout = (wait <= 0) ? 0 : (int) ((wait + 999999) / 1000000);
+        }
+        int n = epoll_wait (epfd, events, MAX_EVENTS, timeout);
+        for (i = 0; i < n; i++) {
+            int fd = events[i].data.fd;
+            if (fd == lfd) {
+                accept_all (epfd, lfd);
+                continue;
+            }
+            conn_t *c = conns[fd];
+            if (c == NULL || c->fd < 0)
+                continue;
+            int rc = 0;
+            if (events[i].events & (EPOLLERR | EPOLLHUP))
+                rc = -1;
+            if (rc == 0 && (events[i].events & EPOLLOUT))
+                rc = conn_flush (epfd, c);
+            if (rc == 0 && (events[i].events & EPOLLIN))
+                rc = conn_read (epfd, c);
+            if (rc < 0 && !c->heaped)
+                conn_close (epfd, c);
+            else if (rc < 0)
+                c->fd = -c->fd - 2; // closed once it leaves the heap
+        }
+
+        /* Release the responses that are due */
+        int64_t now = now_ns ();
+        while (heap_size > 0 && heap[0]->head->due <= now) {
+            conn_t *c = heap_pop ();
+            if (c->fd < -1) {
+                c->fd = -c->fd - 2;
+                conn_close (epfd, c);
+            } else if (conn_release (epfd, c, now) < 0) {
+                conn_close (epfd, c);
+            }
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,89 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sitetime.h"
+
+/*******************************************************
+ *                                                     *
+ *                    Site Time                        *
+ *                                                     *
+ *******************************************************/
+
+/* Days since 1970-01-01 of a proleptic Gregorian date */
+static int64_t days_from_civil (int64_t y, int m, int d)
+{
+    y -= m <= 2;
+    int64_t era = (y >= 0 ? y : y - 399) / 400;
+    int64_t yoe = y - era * 400;
+    int64_t doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+    int64_t doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097 + doe - 719468;
+}
+
+/* Date of a day since 1970-01-01 */
+static void civil_from_days (int64_t z, int *y, int *m, int *d)
+{
+    z += 719468;
+    int64_t era = (z >= 0 ? z : z - 146096) / 146097;
+    int64_t doe = z - era * 146097;
+    int64_t yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    int64_t doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    int64_t mp = (5 * doy + 2) / 153;
+    *d = (int) (doy - (153 * mp + 2) / 5 + 1);
+    *m = (int) (mp < 10 ? mp + 3 : mp - 9);
+    *y = (int) (yoe + era * 400 + (*m <= 2));
+}
+
+/* Value of n digits at s, -1 if one is not a digit */
+static int digits (const char *s, int n)
+{
+    int v = 0, i = 0;
+    for (i = 0; i < n; i++) {
+        if (s[i] < '0' || s[i] > '9')
+            return -1;
+        v = v * 10 + (s[i] - '0');
+    }
+    return v;
+}
+
+/* site_time_parse()
+ * "YYYY-MM-DDTHH:MM:SS" to nanoseconds, -1 if malformed or outside
+ * the years int64 ns can hold
+ */
+int site_time_parse (const char *str, int64_t *ns)
+{
+    if (str == NULL || strlen (str) < SITE_TIME_LEN || str[4] != '-' || str[7] != '-'
+            || str[10] != 'T' || str[13] != ':' || str[16] != ':')
+        return -1;
+
+    int y = digits (str, 4), mo = digits (str + 5, 2), d = digits (str + 8, 2);
+    int h = digits (str + 11, 2), mi = digits (str + 14, 2), s = digits (str + 17, 2);
+    if (y < 1678 || y > 2261 || mo < 1 || mo > 12 || d < 1 || d > 31 || h < 0 || h > 23 || mi < 0 || mi > 59 || s < 0 || s > 60)
+        return -1;
+
+    *ns = ((days_from_civil (y, mo, d) * 24 + h) * 3600 + mi * 60 + s) * NS_PER_SEC;
+    return 0;
+}
+
+/* site_time_format()
+ * ns as "YYYY-MM-DDTHH:MM:SS" into buf of SITE_TIME_LEN + 1 bytes.
+ * int64 ns span the years 1677 to 2262, the unsigned fields and
+ * their moduli only let the compiler see that they fit.
+ */
+char *site_time_format (int64_t ns, char *buf)
+{
+    int y, m, d;
+    int64_t secs = ns / NS_PER_SEC;
+    int64_t days = secs / 86400;
+    int64_t rem = secs % 86400;
+    if (rem < 0) {
+        rem += 86400;
+        days -= 1;
+    }
+    civil_from_days (days, &y, &m, &d);
+    snprintf (buf, SITE_TIME_LEN + 1, "%04u-%02u-%02uT%02u:%02u:%02u",
+              (unsigned) y % 10000, (unsigned) m % 100, (unsigned) d % 100,
+              (unsigned) (rem / 3600) % 100, (unsigned) (rem / 60 % 60), (unsigned) (rem % 60));
+    return buf;
+}
@@ -0,0 +1,43 @@
+#ifndef SITETIME_H
+#define SITETIME_H
+
+#include <stdint.h>
+
+/* Time at the machine site.
+ * The env-sensor reports the local time of the site as
+ * "YYYY-MM-DDTHH:MM:SS" without a zone. It is kept as int64 nanoseconds
+ * since 1970-01-01T00:00:00 of that same wall clock, so hours and days
+ * of the site are plain divisions. No zone or libc conversion is
+ * involved.
+ */
+
+#define NS_PER_SEC 1000000000LL
+#define NS_PER_HOUR (3600 * NS_PER_SEC)
+#define NS_PER_DAY (24 * NS_PER_HOUR)
+
+#define SITE_TIME_LEN 19                /* Characters of "YYYY-MM-DDTHH:MM:SS" */
+
+int site_time_parse (const char *str, int64_t *ns);
+char *site_time_format (int64_t ns, char *buf);
+
+/* Hour of the day, 0..23 */
+static inline int site_hour (int64_t ns)
+{
+    return (int) ((ns / NS_PER_HOUR) % 24);
+}
+
+/* First hour:00:00 strictly after ns */
+static inline int64_t site_hour_after (int64_t ns, int hour)
+{
+    int64_t t = ns - ns % NS_PER_DAY + hour * NS_PER_HOUR;
+    return (t <= ns) ? t + NS_PER_DAY : t;
+}
+
+/* Last hour:00:00 at or before ns */
+static inline int64_t site_hour_before (int64_t ns, int hour)
+{
+    int64_t t = ns - ns % NS_PER_DAY + hour * NS_PER_HOUR;
+    return (t > ns) ? t - NS_PER_DAY : t;
+}
+
+#endif
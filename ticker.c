@@ -0,0 +1,104 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/timerfd.h>
+
+#include "ticker.h"
+#include "logger.h"
+
+static int64_t clock_ns (clockid_t clock)
+{
+    struct timespec ts;
+    clock_gettime (clock, &ts);
+    return (int64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/*******************************************************
+ *                                                     *
+ *                      Ticker                         *
+ *                                                     *
+ *******************************************************/
+
+/* ticker_init()
+ * Arms a timer firing every period seconds, the first deadline
+ * being now
+ */
+int ticker_init (ticker_t *t, double period)
+{
+    struct itimerspec its;
+
+    memset (t, 0, sizeof (ticker_t));
+    t->period_ns = (int64_t) (period * 1e9);
+    t->fd = timerfd_create (CLOCK_MONOTONIC, TFD_CLOEXEC);
+    if (t->fd < 0) {
+        printf ("ERROR: Could not create the tick timer: %s\n", strerror (errno));
+        return -1;
+    }
+
+    t->start_ns = clock_ns (CLOCK_MONOTONIC);
+    t->wall_offset_ns = clock_ns (CLOCK_REALTIME) - t->start_ns;
+    its.it_value.tv_sec = t->start_ns / 1000000000;
+    its.it_value.tv_nsec = t->start_ns % 1000000000;
+    its.it_interval.tv_sec = t->period_ns / 1000000000;
+    its.it_interval.tv_nsec = t->period_ns % 1000000000;
+    if (timerfd_settime (t->fd, TFD_TIMER_ABSTIME, &its, NULL) < 0) {
+        printf ("ERROR: Could not arm the tick timer: %s\n", strerror (errno));
+        close (t->fd);
+        t->fd = -1;
+        return -1;
+    }
+    return 0;
+}
+
+/* ticker_wait()
+ * Blocks until the next deadline and returns it as epoch nanoseconds,
+ * the timestamp of the samples of the tick. Deadlines that passed
+ * while the previous tick ran are counted as skipped.
+ */
+int64_t ticker_wait (ticker_t *t)
+{
+    uint64_t n = 0;
+    int64_t idle = clock_ns (CLOCK_MONOTONIC);
+
+    while (read (t->fd, &n, sizeof (n)) != sizeof (n)) {
+        if (errno != EINTR) {
+            LOG (LOG_ERROR, "ERROR: Tick timer failed: %s\n", strerror (errno));
+            return -1;
+        }
+    }
+
+    /* The tick runs for the latest deadline */
+    t->expirations += n;
+    int64_t deadline = t->start_ns + (t->expirations - 1) * t->period_ns;
+    int64_t late = clock_ns (CLOCK_MONOTONIC) - deadline;
+    if (n > 1 && t->ticks > 0) {
+        int64_t over = idle - (deadline - (int64_t) (n - 1) * t->period_ns);
+        t->overruns++;
+        t->skipped += n - 1;
+        LOG_RATE (LOG_WARN, 1, "Overrun: tick %lld ran %.1f ms past its period, %llu ticks skipped\n",
+                (long long) t->ticks, over / 1e6, (unsigned long long) n - 1);
+    }
+    if (late > t->late_max_ns)
+        t->late_max_ns = late;
+    t->late_total_ns += late;
+    t->ticks++;
+
+    return deadline + t->wall_offset_ns;
+}
+
+void ticker_print (ticker_t *t)
+{
+    LOG (LOG_INFO, "Schedule: %lld ticks every %.3f s, %lld overruns, %lld skipped, wakeup late avg %.3f ms max %.3f ms\n",
+            (long long) t->ticks, t->period_ns / 1e9, (long long) t->overruns, (long long) t->skipped,
+            t->ticks ? t->late_total_ns / 1e6 / t->ticks : 0, t->late_max_ns / 1e6);
+}
+
+void ticker_free (ticker_t *t)
+{
+    if (t->fd >= 0)
+        close (t->fd);
+    t->fd = -1;
+}
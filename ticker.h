@@ -0,0 +1,30 @@
+#ifndef TICKER_H
+#define TICKER_H
+
+#include <stdint.h>
+
+/* Fixed-rate tick scheduler.
+ * Ticks fire on absolute CLOCK_MONOTONIC deadlines start + k * period
+ * from a timerfd, so the time a tick takes does not shift the next
+ * one. A tick that overruns its period makes the ticks it covered be
+ * skipped rather than fired late, keeping the sampling grid.
+ */
+typedef struct ticker {
+    int         fd;                     /* timerfd */
+    int64_t     period_ns;              /* Tick period */
+    int64_t     start_ns;               /* Monotonic time of the first deadline */
+    int64_t     wall_offset_ns;         /* CLOCK_REALTIME - CLOCK_MONOTONIC at start */
+    int64_t     expirations;            /* Deadlines passed so far */
+    int64_t     ticks;                  /* Ticks fired */
+    int64_t     overruns;               /* Ticks that ran past the next deadline */
+    int64_t     skipped;                /* Deadlines skipped by overruns */
+    int64_t     late_max_ns;            /* Largest delay of a wakeup past its deadline */
+    int64_t     late_total_ns;          /* Sum of the wakeup delays */
+} ticker_t;
+
+int ticker_init (ticker_t *t, double period);
+int64_t ticker_wait (ticker_t *t);
+void ticker_print (ticker_t *t);
+void ticker_free (ticker_t *t);
+
+#endif
@@ -0,0 +1,58 @@
+/* Summary of raw sample segments, read in place
+ *
+ * Build with `make tools` and run ./tools/tsdump <segment>...
+ * Prints the rows and epoch time range of every segment, the env-sensor
+ * averages, and per machine the number of samples and mean current.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "tstore.h"
+
+int main (int argc, char *argv[])
+{
+    int a = 0, i = 0;
+    uint64_t r = 0;
+
+    if (argc < 2) {
+        printf ("Usage: %s <segment>...\n", argv[0]);
+        return -1;
+    }
+    for (a = 1; a < argc; a++) {
+        tseg_t seg;
+        if (tseg_open (&seg, argv[a]) < 0)
+            return -1;
+
+        uint64_t rows = __atomic_load_n (&seg.hdr->count, __ATOMIC_ACQUIRE);
+        double temp = 0, pres = 0, humd = 0;
+        for (r = 0; r < rows; r++) {
+            temp += seg.temperature[r];
+            pres += seg.pressure[r];
+            humd += seg.humidity[r];
+        }
+        printf ("%s: %llu of %llu rows, %u machines, %.3f .. %.3f s\n", argv[a],
+                (unsigned long long) rows, (unsigned long long) seg.hdr->capacity, seg.hdr->nmachines,
+                rows ? seg.timestamp[0] / 1e9 : 0, rows ? seg.timestamp[rows - 1] / 1e9 : 0);
+        if (rows == 0) {
+            tseg_close (&seg);
+            continue;
+        }
+        printf ("  temperature %.3f, pressure %.3f, humidity %.3f\n", temp / rows, pres / rows, humd / rows);
+
+        for (i = 0; i < (int) seg.hdr->nmachines; i++) {
+            const double *column = tseg_column (&seg, i);
+            double sum = 0;
+            int n = 0;
+            for (r = 0; r < rows; r++) {
+                if (!isnan (column[r])) {
+                    sum += column[r];
+                    n++;
+                }
+            }
+            printf ("  %s  %6d samples  mean %.3f\n", seg.uuid[i], n, n ? sum / n : 0);
+        }
+        tseg_close (&seg);
+    }
+    return 0;
+}
@@ -0,0 +1,90 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "tstats.h"
+#include "logger.h"
+
+/*******************************************************
+ *                                                     *
+ *                  Tick Statistics                    *
+ *                                                     *
+ *******************************************************/
+
+int tstats_init (tstats_t *ts, int cap)
+{
+    memset (ts, 0, sizeof (tstats_t));
+    ts->wall_ns = (int64_t *) calloc (cap, sizeof (int64_t));
+    ts->cpu_ns = (int64_t *) calloc (cap, sizeof (int64_t));
+    if (!ts->wall_ns || !ts->cpu_ns) {
+        printf ("ERROR: Could not allocate tick statistics\n");
+        return -1;
+    }
+    ts->cap = cap;
+    return 0;
+}
+
+static int64_t clock_ns (clockid_t clock)
+{
+    struct timespec t;
+    clock_gettime (clock, &t);
+    return (int64_t) t.tv_sec * 1000000000 + t.tv_nsec;
+}
+
+void tstats_mark (tmark_t *mark)
+{
+    mark->wall = clock_ns (CLOCK_MONOTONIC);
+    mark->cpu = clock_ns (CLOCK_PROCESS_CPUTIME_ID);
+}
+
+/* tstats_record()
+ * Records a tick that began at start and ends now,
+ * returns its wall time in ns
+ */
+int64_t tstats_record (tstats_t *ts, const tmark_t *start, int requests)
+{
+    tmark_t end;
+    tstats_mark (&end);
+
+    int slot = ts->ticks % ts->cap;
+    ts->wall_ns[slot] = end.wall - start->wall;
+    ts->cpu_ns[slot] = end.cpu - start->cpu;
+    ts->wall_total += ts->wall_ns[slot];
+    ts->cpu_total += ts->cpu_ns[slot];
+    ts->requests += requests;
+    ts->ticks += 1;
+    return ts->wall_ns[slot];
+}
+
+static int cmp_int64 (const void *a, const void *b)
+{
+    int64_t x = *(const int64_t *) a, y = *(const int64_t *) b;
+    return (x > y) - (x < y);
+}
+
+void tstats_print (tstats_t *ts)
+{
+    int n = (ts->ticks < ts->cap) ? (int) ts->ticks : ts->cap;
+
+    if (n == 0)
+        return;
+    int64_t *sorted = (int64_t *) malloc (sizeof (int64_t) * n);
+    memcpy (sorted, ts->wall_ns, sizeof (int64_t) * n);
+    qsort (sorted, n, sizeof (int64_t), cmp_int64);
+
+    LOG (LOG_INFO, "Ticks: %lld, tick ms p50 %.2f p90 %.2f p99 %.2f max %.2f, %.0f req/s, CPU %.2f ms/tick\n",
+            (long long) ts->ticks, sorted[n / 2] / 1e6, sorted[(int) (n * 0.9)] / 1e6,
+            sorted[(int) (n * 0.99)] / 1e6, sorted[n - 1] / 1e6,
+            (ts->wall_total > 0) ? ts->requests * 1e9 / ts->wall_total : 0,
+            ts->cpu_total / 1e6 / ts->ticks);
+    free (sorted);
+}
+
+void tstats_free (tstats_t *ts)
+{
+    free (ts->wall_ns);
+    free (ts->cpu_ns);
+    ts->wall_ns = NULL;
+    ts->cpu_ns = NULL;
+}
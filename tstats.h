@@ -0,0 +1,32 @@
+#ifndef TSTATS_H
+#define TSTATS_H
+
+#include <stdint.h>
+
+/* Per-tick cost of the monitor: wall time and CPU time of every
+ * tick (without the sleep between ticks) and the requests it made.
+ * The last cap ticks are kept for the percentiles.
+ */
+typedef struct tick_stats {
+    int64_t     *wall_ns;               /* Ring of tick wall times */
+    int64_t     *cpu_ns;                /* Ring of tick CPU times */
+    int         cap;                    /* Capacity of the rings */
+    int64_t     ticks;                  /* Ticks recorded */
+    int64_t     requests;               /* Requests made by all ticks */
+    int64_t     wall_total;             /* Sum of the tick wall times */
+    int64_t     cpu_total;              /* Sum of the tick CPU times */
+} tstats_t;
+
+/* A point in time to measure a tick from */
+typedef struct tick_mark {
+    int64_t     wall;                   /* CLOCK_MONOTONIC, ns */
+    int64_t     cpu;                    /* CLOCK_PROCESS_CPUTIME_ID, ns */
+} tmark_t;
+
+int tstats_init (tstats_t *ts, int cap);
+void tstats_mark (tmark_t *mark);
+int64_t tstats_record (tstats_t *ts, const tmark_t *start, int requests);
+void tstats_print (tstats_t *ts);
+void tstats_free (tstats_t *ts);
+
+#endif
@@ -0,0 +1,222 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "tstore.h"
+
+/*******************************************************
+ *                                                     *
+ *                    Segments                         *
+ *                                                     *
+ *******************************************************/
+
+static uint64_t tseg_align (uint64_t off)
+{
+    return (off + TSEG_ALIGN - 1) / TSEG_ALIGN * TSEG_ALIGN;
+}
+
+/* Points the column pointers into the mapping */
+static void tseg_bind (tseg_t *seg)
+{
+    char *base = (char *) seg->hdr;
+    uint64_t cap = seg->hdr->capacity;
+
+    seg->timestamp = (int64_t *) (base + seg->hdr->off_ts);
+    seg->temperature = (double *) (base + seg->hdr->off_env);
+    seg->pressure = seg->temperature + cap;
+    seg->humidity = seg->pressure + cap;
+    seg->uuid = (char (*)[TSEG_UUID]) (base + seg->hdr->off_uuid);
+    seg->current = (double *) (base + seg->hdr->off_current);
+}
+
+/* tseg_create()
+ * Creates and maps a segment file for capacity rows of nmachines
+ */
+static int tseg_create (tseg_t *seg, const char *path, fleet_t *fleet, uint64_t capacity, double frequency)
+{
+    int i = 0;
+    tseg_header_t hdr = {0};
+
+    memcpy (hdr.magic, TSEG_MAGIC, 8);
+    hdr.nmachines = fleet->size;
+    hdr.capacity = capacity;
+    hdr.frequency = frequency;
+    hdr.off_ts = tseg_align (sizeof (tseg_header_t));
+    hdr.off_env = tseg_align (hdr.off_ts + capacity * sizeof (int64_t));
+    hdr.off_uuid = tseg_align (hdr.off_env + 3 * capacity * sizeof (double));
+    hdr.off_current = tseg_align (hdr.off_uuid + (uint64_t) fleet->size * TSEG_UUID);
+    hdr.size = tseg_align (hdr.off_current + (uint64_t) fleet->size * capacity * sizeof (double));
+
+    int fd = open (path, O_RDWR | O_CREAT | O_EXCL, 0644);
+    if (fd < 0) {
+        printf ("ERROR: Could not create segment %s\n", path);
+        return -1;
+    }
+    if (posix_fallocate (fd, 0, hdr.size) != 0) {
+        printf ("ERROR: Could not allocate %llu bytes for segment %s\n", (unsigned long long) hdr.size, path);
+        close (fd);
+        unlink (path);
+        return -1;
+    }
+    void *map = mmap (NULL, hdr.size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close (fd);
+    if (map == MAP_FAILED) {
+        printf ("ERROR: Could not map segment %s\n", path);
+        return -1;
+    }
+
+    seg->hdr = (tseg_header_t *) map;
+    *seg->hdr = hdr;
+    tseg_bind (seg);
+    for (i = 0; i < fleet->size; i++)
+        memcpy (seg->uuid[i], fleet->meta[i].uuid, 37);
+    return 0;
+}
+
+/* Column of len bytes at off lies within the size bytes of the file */
+static int tseg_within (uint64_t off, uint64_t len, uint64_t size)
+{
+    return off <= size && len <= size - off;
+}
+
+/* Every column the header describes lies within the file, so a
+ * truncated or foreign segment cannot be read past its mapping
+ */
+static int tseg_valid (const tseg_header_t *hdr)
+{
+    uint64_t cap = hdr->capacity;
+    uint64_t n = hdr->nmachines;
+
+    if (hdr->size < sizeof (tseg_header_t) || hdr->count > cap)
+        return 0;
+    /* bounding the counts first keeps the products below from overflowing */
+    if (cap > hdr->size / sizeof (double) || n > hdr->size / TSEG_UUID)
+        return 0;
+    return tseg_within (hdr->off_ts, cap * sizeof (int64_t), hdr->size)
+        && tseg_within (hdr->off_env, 3 * cap * sizeof (double), hdr->size)
+        && tseg_within (hdr->off_uuid, n * TSEG_UUID, hdr->size)
+        && (n == 0 || cap <= (hdr->size / sizeof (double)) / n)
+        && tseg_within (hdr->off_current, n * cap * sizeof (double), hdr->size);
+}
+
+/* tseg_open()
+ * Maps an existing segment read-only, for analysis in place
+ */
+int tseg_open (tseg_t *seg, const char *path)
+{
+    struct stat st;
+    int fd = open (path, O_RDONLY);
+
+    seg->hdr = NULL;
+    if (fd < 0 || fstat (fd, &st) < 0 || (size_t) st.st_size < sizeof (tseg_header_t)) {
+        printf ("ERROR: Could not open segment %s\n", path);
+        if (fd >= 0)
+            close (fd);
+        return -1;
+    }
+    void *map = mmap (NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close (fd);
+    if (map == MAP_FAILED) {
+        printf ("ERROR: Could not map segment %s\n", path);
+        return -1;
+    }
+    seg->hdr = (tseg_header_t *) map;
+    if (memcmp (seg->hdr->magic, TSEG_MAGIC, 8) != 0 || seg->hdr->size > (uint64_t) st.st_size
+            || !tseg_valid (seg->hdr)) {
+        printf ("ERROR: %s is not a sample segment\n", path);
+        munmap (map, st.st_size);
+        seg->hdr = NULL;
+        return -1;
+    }
+    tseg_bind (seg);
+    return 0;
+}
+
+void tseg_close (tseg_t *seg)
+{
+    if (seg->hdr)
+        munmap (seg->hdr, seg->hdr->size);
+    seg->hdr = NULL;
+}
+
+/*******************************************************
+ *                                                     *
+ *                     Store                           *
+ *                                                     *
+ *******************************************************/
+
+/* tstore_open()
+ * Opens the store in dir. New segments are numbered after the
+ * ones already there; existing segments are never written again.
+ */
+int tstore_open (tstore_t *store, const char *dir, uint64_t capacity, double frequency)
+{
+    struct dirent *ent;
+    int seq = 0;
+
+    memset (store, 0, sizeof (tstore_t));
+    mkdir (dir, 0755);
+    DIR *dp = opendir (dir);
+    if (dp == NULL) {
+        printf ("ERROR: Could not open sample store %s\n", dir);
+        return -1;
+    }
+    while ((ent = readdir (dp)) != NULL) {
+        if (sscanf (ent->d_name, "seg-%d.mps", &seq) == 1 && seq >= store->seq)
+            store->seq = seq + 1;
+    }
+    closedir (dp);
+
+    store->dir = strdup (dir);
+    store->capacity = capacity;
+    store->frequency = frequency;
+    return 0;
+}
+
+/* tstore_append()
+ * Appends one row. A full segment is unmapped and the next one created.
+ */
+int tstore_append (tstore_t *store, fleet_t *fleet, double temp, double pres, double humd, int64_t timestamp)
+{
+    int i = 0;
+    tseg_t *seg = &store->seg;
+
+    if (seg->hdr && (seg->hdr->count == seg->hdr->capacity || seg->hdr->nmachines != (uint32_t) fleet->size))
+        tseg_close (seg);
+    if (seg->hdr == NULL) {
+        char *path;
+        asprintf (&path, "%s/seg-%06d.mps", store->dir, store->seq);
+        int rc = tseg_create (seg, path, fleet, store->capacity, store->frequency);
+        free (path);
+        if (rc < 0)
+            return rc;
+        store->seq++;
+    }
+
+    uint64_t row = seg->hdr->count;
+    uint64_t cap = seg->hdr->capacity;
+    seg->timestamp[row] = timestamp;
+    seg->temperature[row] = temp;
+    seg->pressure[row] = pres;
+    seg->humidity[row] = humd;
+    for (i = 0; i < fleet->size; i++)
+        seg->current[(size_t) i * cap + row] = fleet->fresh[i] ? fleet->current[i] : NAN;
+
+    /* Readers of a live segment only see complete rows */
+    __atomic_store_n (&seg->hdr->count, row + 1, __ATOMIC_RELEASE);
+    return 0;
+}
+
+void tstore_close (tstore_t *store)
+{
+    tseg_close (&store->seg);
+    free (store->dir);
+    store->dir = NULL;
+}
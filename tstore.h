@@ -0,0 +1,66 @@
+#ifndef TSTORE_H
+#define TSTORE_H
+
+#include <stdint.h>
+#include "fleet.h"
+
+/* Append-only, memory-mapped columnar store of the raw samples.
+ * Samples go to fixed-size segment files, one row per tick: the tick
+ * timestamp, the env-sensor readings and the current of every machine
+ * (NaN when a machine did not report). Each machine's currents form one
+ * contiguous column, so a segment can be analysed in place through
+ * tseg_open(). Appending is plain stores into the mapping; syscalls
+ * only happen when a segment is full and the next one is created.
+ */
+
+#define TSEG_MAGIC "MPTS0002"           /* 0001 stamped rows in epoch seconds */
+#define TSEG_ALIGN 64
+#define TSEG_UUID 40                    /* Bytes per uuid, null padded */
+
+typedef struct tseg_header {
+    char            magic[8];           /* TSEG_MAGIC */
+    uint32_t        nmachines;          /* Machines per row */
+    uint32_t        reserved;
+    uint64_t        capacity;           /* Rows the segment holds */
+    volatile uint64_t count;            /* Rows written, published after the row */
+    double          frequency;          /* Nominal seconds between rows */
+    uint64_t        off_ts;             /* int64_t  timestamp[capacity], epoch ns */
+    uint64_t        off_env;            /* double   temperature, pressure, humidity [capacity] each */
+    uint64_t        off_uuid;           /* char     uuid[nmachines][TSEG_UUID] */
+    uint64_t        off_current;        /* double   current[nmachines][capacity] */
+    uint64_t        size;               /* Bytes in the file */
+} tseg_header_t;
+
+/* A mapped segment and its columns */
+typedef struct tseg {
+    tseg_header_t   *hdr;               /* Mapping, starts with the header */
+    int64_t         *timestamp;         /* Row timestamps */
+    double          *temperature;       /* Env-sensor columns */
+    double          *pressure;
+    double          *humidity;
+    char            (*uuid)[TSEG_UUID]; /* Machine of every current column */
+    double          *current;           /* Current columns, capacity apart */
+} tseg_t;
+
+typedef struct tstore {
+    char            *dir;               /* Directory of the segments */
+    int             seq;                /* Number of the open segment */
+    uint64_t        capacity;           /* Rows per segment */
+    double          frequency;          /* Nominal seconds between rows */
+    tseg_t          seg;                /* Open segment, hdr NULL if none */
+} tstore_t;
+
+int tstore_open (tstore_t *store, const char *dir, uint64_t capacity, double frequency);
+int tstore_append (tstore_t *store, fleet_t *fleet, double temp, double pres, double humd, int64_t timestamp);
+void tstore_close (tstore_t *store);
+
+int tseg_open (tseg_t *seg, const char *path);
+void tseg_close (tseg_t *seg);
+
+/* Current column of machine idx in a segment */
+static inline double *tseg_column (tseg_t *seg, int idx)
+{
+    return seg->current + (size_t) idx * seg->hdr->capacity;
+}
+
+#endif
@@ -0,0 +1,119 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "twheel.h"
+
+/*******************************************************
+ *                                                     *
+ *                   Timer Wheel                       *
+ *                                                     *
+ *******************************************************/
+
+/* Files t by its distance from w->now; due timers go to the fired list */
+static void twheel_place (twheel_t *w, twtimer_t *t)
+{
+    int l = 0;
+    int64_t delta = t->expires - w->now;
+
+    if (delta <= 0) {
+        t->next = w->fired;
+        w->fired = t;
+        return;
+    }
+    for (l = 0; l < TWHEEL_LEVELS - 1; l++) {
+        if (delta < ((int64_t) 1 << (TWHEEL_BITS * (l + 1))))
+            break;
+    }
+    /* beyond the top level the timer waits in its last slot and is
+     * filed again when that slot comes around */
+    int64_t at = (delta < ((int64_t) 1 << (TWHEEL_BITS * TWHEEL_LEVELS))) ? t->expires
+                 : w->now + ((int64_t) 1 << (TWHEEL_BITS * TWHEEL_LEVELS)) - 1;
+    int slot = (int) ((at >> (TWHEEL_BITS * l)) & (TWHEEL_SLOTS - 1));
+    t->next = w->slots[l][slot];
+    w->slots[l][slot] = t;
+}
+
+/* Takes the timers of a slot out and files them again */
+static void twheel_cascade (twheel_t *w, int level, int slot)
+{
+    twtimer_t *t = w->slots[level][slot];
+    w->slots[level][slot] = NULL;
+    while (t) {
+        twtimer_t *next = t->next;
+        twheel_place (w, t);
+        t = next;
+    }
+}
+
+/* twheel_init()
+ * An empty wheel at now_ns
+ */
+void twheel_init (twheel_t *w, int64_t res_ns, int64_t now_ns)
+{
+    memset (w, 0, sizeof (twheel_t));
+    w->res_ns = res_ns;
+    w->now = now_ns / res_ns;
+}
+
+/* twheel_add()
+ * Arms t to fire at the first advance to deadline_ns or later
+ */
+void twheel_add (twheel_t *w, twtimer_t *t, int64_t deadline_ns)
+{
+    t->deadline = deadline_ns;
+    t->expires = (deadline_ns + w->res_ns - 1) / w->res_ns;
+    w->count++;
+    twheel_place (w, t);
+}
+
+/* twheel_advance()
+ * Moves the wheel to now_ns and returns the timers that came due,
+ * linked through next
+ */
+twtimer_t *twheel_advance (twheel_t *w, int64_t now_ns)
+{
+    int l = 0, i = 0;
+    int64_t target = now_ns / w->res_ns;
+
+    if (target - w->now > TWHEEL_SLOTS) {
+        /* a long way: file every timer again from the target */
+        twtimer_t *all = NULL;
+        for (l = 0; l < TWHEEL_LEVELS; l++) {
+            for (i = 0; i < TWHEEL_SLOTS && w->count > 0; i++) {
+                twtimer_t *t = w->slots[l][i];
+                w->slots[l][i] = NULL;
+                while (t) {
+                    twtimer_t *next = t->next;
+                    t->next = all;
+                    all = t;
+                    t = next;
+                }
+            }
+        }
+        w->now = target;
+        while (all) {
+            twtimer_t *next = all->next;
+            twheel_place (w, all);
+            all = next;
+        }
+    }
+
+    while (w->now < target) {
+        int64_t unit = ++w->now;
+        /* the levels above move down one slot whenever the one below wraps */
+        for (l = 1; l < TWHEEL_LEVELS; l++) {
+            if (unit & (((int64_t) 1 << (TWHEEL_BITS * l)) - 1))
+                break;
+        }
+        for (l = l - 1; l >= 1; l--)
+            twheel_cascade (w, l, (int) ((unit >> (TWHEEL_BITS * l)) & (TWHEEL_SLOTS - 1)));
+        twheel_cascade (w, 0, (int) (unit & (TWHEEL_SLOTS - 1)));
+    }
+
+    twtimer_t *fired = w->fired;
+    w->fired = NULL;
+    for (twtimer_t *t = fired; t; t = t->next)
+        w->count--;
+    return fired;
+}
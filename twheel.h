@@ -0,0 +1,42 @@
+#ifndef TWHEEL_H
+#define TWHEEL_H
+
+#include <stdint.h>
+
+/* Hierarchical timer wheel over epoch nanoseconds.
+ * Time advances in units of res_ns. Level l has TWHEEL_SLOTS slots of
+ * TWHEEL_SLOTS^l units each; a timer goes to the lowest level whose
+ * span covers its distance and moves down a level whenever the level
+ * below wraps, so adding a timer and advancing by one unit are O(1).
+ * An advance over more than TWHEEL_SLOTS units, e.g. after a jump of
+ * the clock, rebuilds the wheel from its timers instead of walking
+ * every unit. Timers are intrusive and owned by the caller; a fired
+ * timer is out of the wheel until it is added again.
+ */
+
+#define TWHEEL_BITS 6
+#define TWHEEL_SLOTS (1 << TWHEEL_BITS)
+#define TWHEEL_LEVELS 4                 /* 64^4 units: 194 days at 1 s */
+
+typedef struct wheel_timer twtimer_t;
+
+struct wheel_timer {
+    int64_t         deadline;           /* Epoch ns it is due at */
+    int64_t         expires;            /* Deadline in units, rounded up */
+    int             id;                 /* Free for the owner */
+    twtimer_t       *next;              /* Next timer of the slot or of the fired list */
+};
+
+typedef struct timer_wheel {
+    int64_t         res_ns;             /* Length of a unit */
+    int64_t         now;                /* Last unit advanced to */
+    int             count;              /* Timers in the wheel */
+    twtimer_t       *fired;             /* Timers due at the next advance */
+    twtimer_t       *slots[TWHEEL_LEVELS][TWHEEL_SLOTS];
+} twheel_t;
+
+void twheel_init (twheel_t *w, int64_t res_ns, int64_t now_ns);
+void twheel_add (twheel_t *w, twtimer_t *t, int64_t deadline_ns);
+twtimer_t *twheel_advance (twheel_t *w, int64_t now_ns);
+
+#endif